@@ -0,0 +1,129 @@
+// Cost per suggestion: a full Levenshtein matrix against every command, as
+// suggest_command would need over all of PATH, vs the BK-tree index with
+// the bounded bit-parallel kernel
+//
+//   make bench && ./bin/autocorrect_bench [queries]
+
+#include "edushell.h"
+#include <dirent.h>
+
+#define MAX_NAMES 65536
+
+static char *names[MAX_NAMES];
+static int name_count;
+
+// Every executable name on PATH, duplicates included, for the linear scan
+static void collect_names(void) {
+    char *path_env = strdup(getenv("PATH") ? getenv("PATH") : "");
+    for (char *dir = strtok(path_env, ":"); dir; dir = strtok(NULL, ":")) {
+        DIR *d = opendir(dir);
+        if (!d) continue;
+        struct dirent *entry;
+        while ((entry = readdir(d)) && name_count < MAX_NAMES) {
+            struct stat st;
+            if (entry->d_name[0] != '.' && fstatat(dirfd(d), entry->d_name, &st, 0) == 0 &&
+                S_ISREG(st.st_mode) && faccessat(dirfd(d), entry->d_name, X_OK, 0) == 0) {
+                names[name_count++] = strdup(entry->d_name);
+            }
+        }
+        closedir(d);
+    }
+    free(path_env);
+}
+
+// The distance as it was before the index: the whole matrix, every time
+static int legacy_distance(const char *s1, const char *s2) {
+    int len1 = strlen(s1), len2 = strlen(s2);
+    int *matrix = malloc((len1 + 1) * (len2 + 1) * sizeof(int));
+    for (int i = 0; i <= len1; i++) matrix[i * (len2 + 1)] = i;
+    for (int j = 0; j <= len2; j++) matrix[j] = j;
+    for (int i = 1; i <= len1; i++) {
+        for (int j = 1; j <= len2; j++) {
+            int cost = s1[i - 1] == s2[j - 1] ? 0 : 1;
+            matrix[i * (len2 + 1) + j] = MIN3(matrix[(i - 1) * (len2 + 1) + j] + 1,
+                                              matrix[i * (len2 + 1) + j - 1] + 1,
+                                              matrix[(i - 1) * (len2 + 1) + j - 1] + cost);
+        }
+    }
+    int distance = matrix[len1 * (len2 + 1) + len2];
+    free(matrix);
+    return distance;
+}
+
+static const char *legacy_lookup(const char *input) {
+    const char *best = NULL;
+    int best_distance = 4;
+    for (int i = 0; i < name_count; i++) {
+        int distance = legacy_distance(input, names[i]);
+        if (distance > 0 && distance < best_distance) {
+            best = names[i];
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+    long queries = argc > 1 ? atol(argv[1]) : 2000;
+    struct timespec start, end;
+
+    collect_names();
+    if (name_count == 0) {
+        handle_error("No executables on PATH");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int indexed = autocorrect_index_size();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double build_ns = elapsed_ns(&start, &end);
+
+    // Typos of real commands: one character dropped, swapped or replaced
+    char (*inputs)[64] = malloc(queries * sizeof(*inputs));
+    srand(42);
+    for (long q = 0; q < queries; q++) {
+        const char *name = names[rand() % name_count];
+        snprintf(inputs[q], sizeof(inputs[q]), "%s", name);
+        int length = strlen(inputs[q]);
+        int at = rand() % length;
+        if (q % 3 == 0) {
+            memmove(inputs[q] + at, inputs[q] + at + 1, length - at);
+        } else if (q % 3 == 1 && at + 1 < length) {
+            char c = inputs[q][at];
+            inputs[q][at] = inputs[q][at + 1];
+            inputs[q][at + 1] = c;
+        } else {
+            inputs[q][at] = 'a' + rand() % 26;
+        }
+    }
+
+    long found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long q = 0; q < queries; q++) {
+        if (legacy_lookup(inputs[q])) found++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy_ns = elapsed_ns(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long q = 0; q < queries; q++) {
+        if (autocorrect_lookup(inputs[q], NULL)) found++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double index_ns = elapsed_ns(&start, &end);
+
+    printf("%ld queries against %d commands (%d distinct, index built in %.1f ms, %ld found)\n\n",
+           queries, name_count, indexed, build_ns / 1e6, found);
+    printf("%-34s %-12s\n", "Lookup", "us/query");
+    printf("----------------------------------------------\n");
+    printf("%-34s %-12.1f\n", "linear scan, full matrix", legacy_ns / queries / 1e3);
+    printf("%-34s %-12.1f\n", "BK-tree, bounded Myers", index_ns / queries / 1e3);
+    printf("\nSpeedup: %.2fx\n", legacy_ns / index_ns);
+
+    free(inputs);
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Cost of a Ctrl-R lookup over a large history: a scan from the newest
+// line back, as a plain array of lines would need, vs the trigram index
+//
+//   make bench && ./bin/history_bench [entries] [queries]
+
+#include "edushell.h"
+
+static const char *TEMPLATES[] = {
+    "git commit -m 'fix issue %d'", "make -j%d all", "ssh build%d.example.org",
+    "cd ~/src/project%d", "grep -rn symbol_%d src/", "ls -la /var/log/app%d",
+    "python3 run.py --seed %d", "docker logs worker-%d", "vim notes/%d.md",
+    "curl -s http://localhost:%d/health",
+};
+#define TEMPLATE_COUNT (int)(sizeof(TEMPLATES) / sizeof(TEMPLATES[0]))
+
+static int64_t scan(const char *text, int64_t before) {
+    for (int64_t i = before - 1; i >= 0; i--) {
+        if (strstr(history_entry(i), text)) return i;
+    }
+    return -1;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+    long entries = argc > 1 ? atol(argv[1]) : 1000000;
+    long queries = argc > 2 ? atol(argv[2]) : 200;
+    struct timespec start, end;
+
+    char path[] = "/tmp/history_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || !history_open(path)) {
+        handle_error("Could not create a history file");
+        return 1;
+    }
+    close(fd);
+
+    char line[128];
+    srand(42);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < entries; i++) {
+        snprintf(line, sizeof(line), TEMPLATES[rand() % TEMPLATE_COUNT], rand() % 100000);
+        history_add(line);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double append_ns = elapsed_ns(&start, &end);
+
+    // Reopening indexes the file; the first search builds the trigram index
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    history_open(path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double open_ns = elapsed_ns(&start, &end);
+    uint64_t count = history_count();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    history_find("xyz", count, false);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double build_ns = elapsed_ns(&start, &end);
+
+    // Half the queries are a piece of some line, old or new; half aren't
+    // in the history at all, the worst case for a scan
+    char (*inputs)[32] = malloc(queries * sizeof(*inputs));
+    for (long q = 0; q < queries; q++) {
+        if (q % 2) {
+            snprintf(inputs[q], sizeof(inputs[q]), "symbol_%d%c", rand() % 100000, 'a' + rand() % 26);
+            continue;
+        }
+        const char *entry = history_entry(rand() % count);
+        int length = strlen(entry), at = rand() % (length - 8);
+        snprintf(inputs[q], sizeof(inputs[q]), "%.*s", 8, entry + at);
+    }
+
+    long agree = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int64_t *expected = malloc(queries * sizeof(int64_t));
+    for (long q = 0; q < queries; q++) expected[q] = scan(inputs[q], count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double scan_ns = elapsed_ns(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long q = 0; q < queries; q++) {
+        if (history_find(inputs[q], count, false) == expected[q]) agree++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double index_ns = elapsed_ns(&start, &end);
+
+    printf("%llu entries (appended in %.2f s, opened in %.1f ms, trigram index built in %.1f ms)\n",
+           (unsigned long long)count, append_ns / 1e9, open_ns / 1e6, build_ns / 1e6);
+    printf("%ld queries, %ld/%ld answers agree\n\n", queries, agree, queries);
+    printf("%-34s %-12s\n", "Search", "ms/query");
+    printf("----------------------------------------------\n");
+    printf("%-34s %-12.3f\n", "scan newest to oldest", scan_ns / queries / 1e6);
+    printf("%-34s %-12.3f\n", "trigram index", index_ns / queries / 1e6);
+    printf("\nSpeedup: %.2fx\n", scan_ns / index_ns);
+
+    free(expected);
+    free(inputs);
+    history_close();
+    unlink(path);
+    return 0;
+}
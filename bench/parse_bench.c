@@ -0,0 +1,113 @@
+// Parse throughput: the original strtok/strdup parser vs the arena tokenizer
+//
+//   make bench && ./bin/parse_bench [iterations]
+
+#include "edushell.h"
+
+static const char *SAMPLE_LINES[] = {
+    "ls -la /usr/local/bin",
+    "grep -n pattern src/shell.c src/utils.c > matches.txt",
+    "cat < input.txt >> output.log",
+    "sort -k2 -n data.csv",
+    "echo hello world from the benchmark &",
+    "find . -name *.c -type f -newer Makefile",
+    "gcc -Wall -Wextra -I./include -c src/analytics.c -o obj/analytics.o",
+    "cp notes.txt backup/notes.txt",
+    NULL
+};
+
+// The parser as it was before the arena tokenizer, kept for comparison
+static Command *legacy_parse_command(char *line) {
+    Command *cmd = malloc(sizeof(Command));
+    if (!cmd) return NULL;
+
+    cmd->arg_count = 0;
+    cmd->is_background = false;
+    cmd->input_file = NULL;
+    cmd->output_file = NULL;
+    cmd->append_output = false;
+
+    char *token = strtok(line, " \t");
+    while (token && cmd->arg_count < MAX_ARGS - 1) {
+        if (strcmp(token, "<") == 0) {
+            token = strtok(NULL, " \t");
+            if (token) cmd->input_file = strdup(token);
+        } else if (strcmp(token, ">") == 0) {
+            token = strtok(NULL, " \t");
+            if (token) cmd->output_file = strdup(token);
+        } else if (strcmp(token, ">>") == 0) {
+            token = strtok(NULL, " \t");
+            if (token) {
+                cmd->output_file = strdup(token);
+                cmd->append_output = true;
+            }
+        } else if (strcmp(token, "&") == 0) {
+            cmd->is_background = true;
+            break;
+        } else {
+            cmd->args[cmd->arg_count++] = strdup(token);
+        }
+        token = strtok(NULL, " \t");
+    }
+    cmd->args[cmd->arg_count] = NULL;
+    return cmd;
+}
+
+static void legacy_free_command(Command *cmd) {
+    for (int i = 0; i < cmd->arg_count; i++) {
+        free(cmd->args[i]);
+    }
+    free(cmd->input_file);
+    free(cmd->output_file);
+    free(cmd);
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    int line_count = 0;
+    size_t bytes_per_round = 0;
+    for (; SAMPLE_LINES[line_count]; line_count++) {
+        bytes_per_round += strlen(SAMPLE_LINES[line_count]);
+    }
+
+    char line[MAX_COMMAND_LENGTH];
+    struct timespec start, end;
+    long checksum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) {
+        strcpy(line, SAMPLE_LINES[i % line_count]);
+        Command *cmd = legacy_parse_command(line);
+        checksum += cmd->arg_count;
+        legacy_free_command(cmd);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy_ns = elapsed_ns(&start, &end);
+
+    Arena arena;
+    parse_arena_init(&arena);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) {
+        strcpy(line, SAMPLE_LINES[i % line_count]);
+        Pipeline *pipeline = parse_pipeline(line, &arena);
+        checksum -= pipeline->stages[0]->arg_count;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double arena_ns = elapsed_ns(&start, &end);
+    arena_free(&arena);
+
+    double mb = (double)bytes_per_round * iterations / line_count / 1e6;
+    printf("Parsed %ld lines (checksum %ld)\n\n", iterations, checksum);
+    printf("%-22s %-12s %-12s\n", "Parser", "ns/line", "MB/s");
+    printf("----------------------------------------------\n");
+    printf("%-22s %-12.1f %-12.1f\n", "strtok + strdup",
+           legacy_ns / iterations, mb / (legacy_ns / 1e9));
+    printf("%-22s %-12.1f %-12.1f\n", "arena tokenizer",
+           arena_ns / iterations, mb / (arena_ns / 1e9));
+    printf("\nSpeedup: %.2fx\n", legacy_ns / arena_ns);
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Cost per resource sample: fopen + fscanf as get_cpu_usage/get_memory_usage
+// used to do it vs the pread sampler that keeps /proc files open. Both
+// sides read /proc/stat, /proc/meminfo and /proc/diskstats, so they do the
+// same work.
+//
+//   make bench && ./bin/sampler_bench [iterations]
+
+#include "edushell.h"
+#include "analytics.h"
+
+// The sampling code as it was before the pread sampler, kept for comparison
+static unsigned long long legacy_last_idle, legacy_last_total;
+
+static double legacy_cpu_usage(void) {
+    FILE *fp = fopen("/proc/stat", "r");
+    if (!fp) return 0.0;
+
+    unsigned long long user, nice, system, idle, iowait, irq, softirq;
+    if (fscanf(fp, "cpu %llu %llu %llu %llu %llu %llu %llu",
+               &user, &nice, &system, &idle, &iowait, &irq, &softirq) != 7) {
+        fclose(fp);
+        return 0.0;
+    }
+    fclose(fp);
+
+    unsigned long long total = user + nice + system + idle + iowait + irq + softirq;
+    unsigned long long current_idle = idle + iowait;
+    unsigned long long total_delta = total - legacy_last_total;
+    unsigned long long idle_delta = current_idle - legacy_last_idle;
+    legacy_last_total = total;
+    legacy_last_idle = current_idle;
+
+    if (total_delta == 0) return 0.0;
+    return 100.0 * (1.0 - ((double)idle_delta / total_delta));
+}
+
+static double legacy_memory_usage(void) {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp) return 0.0;
+
+    unsigned long total = 0, free = 0, buffers = 0, cached = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "MemTotal:", 9) == 0)
+            sscanf(line, "MemTotal: %lu", &total);
+        else if (strncmp(line, "MemFree:", 8) == 0)
+            sscanf(line, "MemFree: %lu", &free);
+        else if (strncmp(line, "Buffers:", 8) == 0)
+            sscanf(line, "Buffers: %lu", &buffers);
+        else if (strncmp(line, "Cached:", 7) == 0) {
+            sscanf(line, "Cached: %lu", &cached);
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (total == 0) return 0.0;
+    return (100.0 * (total - free - buffers - cached)) / total;
+}
+
+// The same stdio approach applied to /proc/diskstats: sectors moved per
+// sample, over every device listed
+static unsigned long long legacy_last_sectors;
+
+static double legacy_disk_io(void) {
+    FILE *fp = fopen("/proc/diskstats", "r");
+    if (!fp) return 0.0;
+
+    unsigned long long sectors = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned int major, minor;
+        char name[32];
+        unsigned long long reads, reads_merged, sectors_read, read_ms, writes, writes_merged,
+            sectors_written;
+        if (sscanf(line, " %u %u %31s %llu %llu %llu %llu %llu %llu %llu", &major, &minor, name,
+                   &reads, &reads_merged, &sectors_read, &read_ms, &writes, &writes_merged,
+                   &sectors_written) == 10) {
+            sectors += sectors_read + sectors_written;
+        }
+    }
+    fclose(fp);
+
+    double delta = (sectors - legacy_last_sectors) * 512.0;
+    legacy_last_sectors = sectors;
+    return delta / 1e6;
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+    struct timespec start, end;
+    double checksum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) {
+        checksum += legacy_cpu_usage() + legacy_memory_usage() + legacy_disk_io();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy_ns = elapsed_ns(&start, &end);
+
+    static Sampler sampler;
+    if (!sampler_open(&sampler)) {
+        handle_error("Could not open /proc files");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++) {
+        sampler_sample(&sampler);
+        checksum += sampler.cpu[0].busy + sampler_memory_usage(&sampler) +
+                    (sampler.disk_read_bps + sampler.disk_write_bps) / 1e6;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double sampler_ns = elapsed_ns(&start, &end);
+
+    printf("Took %ld samples (checksum %.0f, %d cores)\n\n", iterations, checksum,
+           sampler.cpu_count);
+    printf("%-34s %-12s\n", "Sampler", "us/sample");
+    printf("----------------------------------------------\n");
+    printf("%-34s %-12.2f\n", "fopen + fscanf (aggregate CPU)", legacy_ns / iterations / 1e3);
+    printf("%-34s %-12.2f\n", "pread + scanner (every core)", sampler_ns / iterations / 1e3);
+    printf("\nSpeedup: %.2fx\n", legacy_ns / sampler_ns);
+
+    sampler_close(&sampler);
+    return 0;
+}
@@ -0,0 +1,67 @@
+// Throughput of a cross-filesystem move (what `rm` does when the trash is
+// on another filesystem) with one copy worker vs several
+//
+//   make bench && ./bin/treecopy_bench [from-dir] [to-dir] [dirs] [files-per-dir] [file-kb]
+//
+// from-dir and to-dir have to be on different filesystems; by default a
+// tree in /dev/shm (tmpfs) is moved to /var/tmp.
+
+#include "edushell.h"
+
+static bool make_tree(const char *root, int dirs, int files, int kb) {
+    char *data = malloc((size_t)kb * 1024);
+    if (!data || mkdir(root, 0755) != 0) return false;
+    for (size_t i = 0; i < (size_t)kb * 1024; i++) data[i] = rand();
+
+    char path[MAX_PATH_LENGTH * 2];
+    for (int d = 0; d < dirs; d++) {
+        snprintf(path, sizeof(path), "%s/dir%d", root, d);
+        if (mkdir(path, 0755) != 0) return false;
+        for (int f = 0; f < files; f++) {
+            snprintf(path, sizeof(path), "%s/dir%d/file%d", root, d, f);
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0 || write(fd, data, (size_t)kb * 1024) != (ssize_t)kb * 1024) return false;
+            close(fd);
+        }
+    }
+    free(data);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    const char *from = argc > 1 ? argv[1] : "/dev/shm";
+    const char *to = argc > 2 ? argv[2] : "/var/tmp";
+    int dirs = argc > 3 ? atoi(argv[3]) : 64;
+    int files = argc > 4 ? atoi(argv[4]) : 64;
+    int kb = argc > 5 ? atoi(argv[5]) : 64;
+    int worker_counts[] = {1, 2, 4, 8};
+
+    char src[MAX_PATH_LENGTH], dst[MAX_PATH_LENGTH];
+    snprintf(src, sizeof(src), "%s/treecopy_bench.%d", from, (int)getpid());
+    snprintf(dst, sizeof(dst), "%s/treecopy_bench.%d", to, (int)getpid());
+
+    printf("%d directories x %d files x %d KB, %s -> %s\n\n", dirs, files, kb, from, to);
+    printf("%-10s %-10s %-12s %-12s %-10s\n", "Workers", "Seconds", "MB/s", "Files/s", "Reflinked");
+    printf("-------------------------------------------------------\n");
+    srand(42);
+    for (size_t i = 0; i < sizeof(worker_counts) / sizeof(worker_counts[0]); i++) {
+        TreeCopyStats stats;
+        if (!make_tree(src, dirs, files, kb)) {
+            handle_error("Could not create the source tree");
+            remove_tree(src);
+            return 1;
+        }
+        bool ok = move_tree(src, dst, worker_counts[i], &stats);
+        remove_tree(src);
+        remove_tree(dst);
+        if (!ok || !stats.copied) {
+            if (ok) fprintf(stderr, "%s and %s are on the same filesystem\n", from, to);
+            else handle_error("Move failed");
+            return 1;
+        }
+        double mb = stats.bytes / (1024.0 * 1024.0);
+        printf("%-10d %-10.3f %-12.1f %-12.0f %-10ld\n", worker_counts[i], stats.seconds,
+               mb / stats.seconds, stats.files / stats.seconds, stats.cloned);
+    }
+    return 0;
+}
@@ -3,45 +3,301 @@
 
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
 
-#define MAX_RESOURCE_POINTS 60  // Store last 60 data points
-#define MAX_TRACKED_COMMANDS 50
+#define RESOURCE_RING_SIZE 60  // buckets kept at each resolution
+#define RESOURCE_LEVELS 3      // 1 s, 1 min and 1 h buckets
+#define COMMAND_TABLE_INITIAL_SLOTS 64
 #define GRAPH_WIDTH 60
 #define GRAPH_HEIGHT 8
 #define UPDATE_INTERVAL 1  // Update every second
+#define SAMPLE_RING_SIZE 512   // samples the sampler thread can get ahead by; a power of two
+#define MAX_SAMPLED_CPUS 256
+#define SAMPLER_STAT_BUFFER 32768
+#define SAMPLER_MEMINFO_BUFFER 8192
+#define MAX_SAMPLED_DISKS 32
+
+// Latency histograms: exact below 2^SUB_BITS microseconds, then
+// SUB_BUCKETS linear buckets per power of two (~6% relative error) up to
+// 2^MAX_EXPONENT us (about 19 hours); slower runs land in the last bucket
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_EXPONENT 36
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// Persistent analytics under ~/.edushell/analytics: an append-only log of
+// fixed-size events plus a checkpoint of the aggregates, rewritten every
+// EVENT_CHECKPOINT_INTERVAL events and on exit so startup replays only
+// the log's tail
+#define EVENT_RECORD_SIZE 128
+#define EVENT_CHECKPOINT_INTERVAL 65536
+// A log holding more than EVENT_LOG_MAX_EVENTS records is compacted at
+// startup to its newest EVENT_LOG_KEEP_EVENTS, the checkpoint keeping the
+// totals of the ones dropped
+#define EVENT_LOG_MAX_EVENTS (1 << 20)
+#define EVENT_LOG_KEEP_EVENTS (1 << 19)
+
+// OpenMetrics exporter: per-command families cover at most
+// EXPORT_MAX_COMMANDS commands, the exposition is rebuilt at most every
+// EXPORT_REFRESH_INTERVAL seconds, and a scraper gets EXPORT_REQUEST_WAIT_MS
+// to send its request and EXPORT_CLIENT_TIMEOUT seconds to read the answer
+#define EXPORT_MAX_COMMANDS 200
+#define EXPORT_REFRESH_INTERVAL 1
+#define EXPORT_REQUEST_WAIT_MS 100
+#define EXPORT_CLIENT_TIMEOUT 1
 
 // Resource monitoring structures
 typedef struct {
     time_t timestamp;
     double cpu_usage;
+    double cpu_steal;   // time a hypervisor gave to other guests
+    double cpu_guest;   // time this machine spent running guests
     double memory_usage;
-    double disk_io;
+    double disk_io;     // MB/s read + written across all disks
+    double disk_iops;
 } ResourcePoint;
 
+// Cumulative jiffies from one "cpu" line of /proc/stat
+typedef struct {
+    unsigned long long user, nice, system, idle, iowait, irq, softirq;
+    unsigned long long steal, guest, guest_nice;
+} CpuTimes;
+
+// Share of the last interval, in percent
+typedef struct {
+    double busy;
+    double iowait;
+    double steal;
+    double guest;
+} CpuUsage;
+
+// One block device from /proc/diskstats. Rates cover the last interval.
+typedef struct {
+    char name[32];
+    bool whole_disk;    // partitions, loop and device-mapper devices would count I/O twice
+    bool present;       // listed in the latest sample
+    bool sampled;       // has a baseline to compute rates from
+    unsigned long long reads, sectors_read;
+    unsigned long long writes, sectors_written;
+    double read_bps, write_bps;
+    double read_iops, write_iops;
+} DiskStats;
+
+// Keeps /proc/stat and /proc/meminfo open and rereads them with pread into
+// fixed buffers, so a sample costs a few syscalls and no allocation. Index 0
+// of the CPU arrays is the aggregate line, index i + 1 is core i.
+typedef struct {
+    int stat_fd;
+    int meminfo_fd;
+    int diskstats_fd;
+    int cpu_count;
+    CpuTimes prev[MAX_SAMPLED_CPUS + 1];
+    CpuUsage cpu[MAX_SAMPLED_CPUS + 1];
+    bool have_prev;
+    unsigned long long mem_total_kb;
+    unsigned long long mem_available_kb;
+    unsigned long long mem_free_kb;
+    unsigned long long mem_buffers_kb;
+    unsigned long long mem_cached_kb;
+    DiskStats disks[MAX_SAMPLED_DISKS];
+    int disk_count;
+    struct timespec disk_time;
+    double disk_read_bps;   // totals over whole disks
+    double disk_write_bps;
+    double disk_iops;
+    char buf[SAMPLER_STAT_BUFFER];
+} Sampler;
+
+// What a finished process used, collected just before it is reaped
+typedef struct {
+    unsigned long long read_bytes;   // from /proc/<pid>/io: storage actually touched
+    unsigned long long write_bytes;
+    double user_time;                // the rest from wait4/waitid rusage, in seconds
+    double sys_time;
+    long max_rss_kb;
+    long major_faults;
+    long minor_faults;
+    long voluntary_switches;
+    long involuntary_switches;
+} CommandUsage;
+
+// What the sampler thread hands the shell: the point plus the detail the
+// monitor shows for the newest sample only
+typedef struct {
+    ResourcePoint point;
+    float disk_read_mbps;
+    float disk_write_mbps;
+    char busiest_disk[32];      // empty when all disks were idle
+    int cpu_count;
+    uint8_t core_busy[MAX_SAMPLED_CPUS];   // percent per core
+} ResourceSample;
+
+typedef enum {
+    METRIC_CPU,
+    METRIC_STEAL,
+    METRIC_GUEST,
+    METRIC_MEMORY,
+    METRIC_DISK_IO,
+    METRIC_DISK_IOPS,
+    RESOURCE_METRIC_COUNT
+} ResourceMetric;
+
+// Everything sampled in one stretch of `width` seconds
+typedef struct {
+    int64_t start;          // first second covered, 0 while never used
+    uint32_t count;
+    float min[RESOURCE_METRIC_COUNT];
+    float max[RESOURCE_METRIC_COUNT];
+    double sum[RESOURCE_METRIC_COUNT];
+} ResourceBucket;
+
+// A bucket's slot follows from its start time, so inserting never walks
+// the ring and a slot holding an older stretch is simply reused
 typedef struct {
-    ResourcePoint points[MAX_RESOURCE_POINTS];
-    int current_index;
-    int total_points;
+    int width;
+    ResourceBucket buckets[RESOURCE_RING_SIZE];
+} ResourceRing;
+
+typedef struct {
+    float min, max, mean;
+    uint32_t samples;
+} MetricSummary;
+
+// Every sample lands in its bucket at each resolution: the last minute by
+// the second, the last hour by the minute and the last 60 hours by the
+// hour, in fixed memory
+typedef struct {
+    ResourceRing rings[RESOURCE_LEVELS];
 } ResourceHistory;
 
+typedef struct {
+    unsigned int counts[HISTOGRAM_BUCKETS];
+    unsigned long long total;
+    unsigned long long max_us;      // exact, not bucketed
+} LatencyHistogram;
+
 // Learning analytics structures
 typedef struct {
     char command[64];
+    unsigned int hash;
     int usage_count;
     time_t first_use;
     time_t last_use;
     int error_count;
     double avg_execution_time;
+    int measured_runs;          // runs with a CommandUsage (external processes)
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    double user_time;
+    double sys_time;
+    long max_rss_kb;            // largest of any run
+    long major_faults;
+    long minor_faults;
+    long voluntary_switches;
+    long involuntary_switches;
+    LatencyHistogram latency;
 } CommandStats;
 
+typedef enum {
+    EVENT_COMMAND = 1,      // a command finished: wall time and error status
+    EVENT_USAGE,            // rusage and I/O of a finished process
+    EVENT_RESOURCE,         // one resource monitor sample
+    EVENT_FORK_AVOIDED,     // a command ran in-process instead of exec'd
+    EVENT_TYPE_MAX = EVENT_FORK_AVOIDED
+} EventType;
+
+#define EVENT_FLAG_ERROR 0x01
+
+// One record of the event log, exactly EVENT_RECORD_SIZE bytes. A record
+// whose checksum doesn't match was torn by a crash and is skipped.
+typedef struct {
+    uint32_t checksum;      // event_checksum() of everything after this field
+    uint8_t type;
+    uint8_t flags;
+    uint16_t reserved;
+    int64_t timestamp;      // seconds since the epoch
+    union {
+        struct {
+            char name[64];
+            double seconds;
+        } command;
+        struct {
+            char name[64];
+            uint64_t read_bytes;
+            uint64_t write_bytes;
+            float user_time;
+            float sys_time;
+            uint32_t max_rss_kb;
+            uint32_t major_faults;
+            uint32_t minor_faults;
+            uint32_t voluntary_switches;
+            uint32_t involuntary_switches;
+        } usage;
+        struct {
+            double cpu_usage;
+            double cpu_steal;
+            double cpu_guest;
+            double memory_usage;
+            double disk_io;
+            double disk_iops;
+        } resource;
+        uint8_t payload[EVENT_RECORD_SIZE - 16];
+    };
+} StoredEvent;
+
 typedef struct {
-    CommandStats commands[MAX_TRACKED_COMMANDS];
+    int fd;
+    char *path;
+    pid_t owner;            // process the descriptor was opened by
+    int64_t created;        // identifies this log to its checkpoints
+    uint64_t first_event;   // records before this one were compacted away
+    uint64_t event_count;   // records ever logged, as of the last look
+} EventStore;
+
+typedef void (*EventHandler)(const StoredEvent *event, void *context);
+
+// Commands live densely in `commands` in first-use order; `slots` is an
+// open-addressing index over them (linear probing, index + 1, 0 = empty)
+// kept at most half full
+typedef struct {
+    CommandStats *commands;
     int command_count;
+    int command_capacity;
+    int *slots;
+    int slot_count;
     int total_commands_executed;
     int total_errors;
+    int forks_avoided;   // commands served in-process instead of exec'd
     time_t session_start;
+    time_t tracking_since;   // when the event log was started
 } LearningStats;
 
+typedef enum {
+    EXPORTER_OFF,
+    EXPORTER_SOCKET,
+    EXPORTER_TEXTFILE
+} ExporterMode;
+
+// One character cell of a frame: a UTF-8 character, NUL-padded
+typedef struct {
+    char glyph[4];
+} Cell;
+
+// Off-screen picture of the monitor area. `cells` is drawn into;
+// `shown` is what the terminal displays, so a flush sends only the cells
+// that differ, all in one write.
+typedef struct {
+    int rows;
+    int cols;
+    Cell *cells;
+    Cell *shown;
+    bool valid;         // false when the terminal's copy is unknown: repaint all
+    char *out;          // escape sequences for one flush
+    size_t out_capacity;
+} Frame;
+
 // Function prototypes
 void initialize_analytics(void);
 void cleanup_analytics(void);
@@ -49,13 +305,68 @@ void cleanup_analytics(void);
 // Resource monitoring functions
 void update_resource_usage(void);
 void display_resource_graphs(void);
+void hide_resource_graphs(void);
+void invalidate_resource_graphs(void);
 double get_cpu_usage(void);
 double get_memory_usage(void);
 double get_disk_io(void);
+bool sampler_open(Sampler *sampler);
+bool sampler_sample(Sampler *sampler);
+void sampler_close(Sampler *sampler);
+double sampler_memory_usage(const Sampler *sampler);
+void resource_history_init(ResourceHistory *history);
+void resource_history_add(ResourceHistory *history, const ResourcePoint *point);
+bool resource_history_window(const ResourceHistory *history, int64_t now, int seconds,
+                             ResourceMetric metric, MetricSummary *summary);
+void set_monitor_window(int seconds);
+bool sampler_thread_start(double period);
+void sampler_thread_stop(void);
+double sampler_thread_period(void);
+int sampler_thread_fd(void);
+bool sampler_thread_pop(ResourceSample *sample);
+unsigned long sampler_thread_dropped(void);
+void histogram_record(LatencyHistogram *histogram, double seconds);
+double histogram_percentile(const LatencyHistogram *histogram, double percentile);
+unsigned long long histogram_count_at_most(const LatencyHistogram *histogram, double seconds);
+uint32_t event_checksum(const void *data, size_t size);
+bool event_store_open(EventStore *store, const char *path);
+bool event_store_append(EventStore *store, StoredEvent *event);
+uint64_t event_store_replay(EventStore *store, uint64_t from, EventHandler handler, void *context);
+uint64_t event_store_replay_range(EventStore *store, uint64_t from, uint64_t to,
+                                  EventHandler handler, void *context);
+uint64_t event_store_find_time(EventStore *store, int64_t since);
+bool event_store_read(EventStore *store, uint64_t index, StoredEvent *event);
+bool event_store_compact(EventStore *store, uint64_t keep_from);
+bool event_store_sync(EventStore *store);
+void event_store_close(EventStore *store);
+const DiskStats *sampler_busiest_disk(const Sampler *sampler);
+bool frame_resize(Frame *frame, int rows, int cols);
+void frame_clear(Frame *frame);
+void frame_text(Frame *frame, int row, int col, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+void frame_sparkline(Frame *frame, int row, int col, int height, const float *values, int count,
+                     double max);
+bool frame_flush(Frame *frame, int fd, const char *prefix);
+void frame_invalidate(Frame *frame);
+void frame_free(Frame *frame);
 
 // Learning analytics functions
 void track_command_execution(const char *command, double execution_time, bool had_error);
+void track_fork_avoided(void);
+void track_command_usage(const char *command, const CommandUsage *usage);
 void display_learning_dashboard(void);
+bool display_command_costs(const char *key);
+EventStore *analytics_event_store(void);
+int analytics_command_uses(const char *command);
+const LearningStats *analytics_stats(void);
+const ResourceHistory *analytics_resource_history(void);
+const ResourceSample *analytics_latest_sample(void);
+bool exporter_start(ExporterMode mode, const char *path);
+void exporter_stop(void);
+bool exporter_refresh(void);
+ExporterMode exporter_mode(void);
+const char *exporter_path(void);
+bool analytics_query(char **args, int arg_count);
 void generate_learning_suggestions(void);
 const char *get_proficiency_level(int usage_count, int error_rate);
 
@@ -8,12 +8,14 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <time.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <sched.h>
 #include <sys/mount.h>
+#include <stdint.h>
 #include <sys/capability.h>
 #include <linux/capability.h>
 #include "analytics.h"
@@ -22,7 +24,20 @@
 #define MAX_COMMAND_LENGTH 1024
 #define MAX_ARGS 64
 #define MAX_PATH_LENGTH 256
-#define HISTORY_SIZE 100
+#define HISTORY_SIZE 100            // lines `history` shows by default
+#define MAX_PIPELINE_STAGES 16
+#define LOG_RING_SIZE 1024         // commands queued for the log writer
+#define LOG_BATCH_BYTES 65536      // most the writer formats per write
+#define LOG_FLUSH_MS 200           // how long the writer collects a batch
+#define LOG_FSYNC_INTERVAL_DEFAULT 5
+#define LOG_MAX_SIZE_DEFAULT (10LL << 20)
+#define LOG_KEEP_DEFAULT 5
+#define COMPLETION_CACHE_SIZE 64   // directory listings kept for tab completion
+#define COMPLETION_LIST_MAX 256    // more matches than this are counted, not listed
+#define TREE_COPY_STAGING ".edushell-partial-"  // cross-filesystem moves in progress
+#define TREE_COPY_RESTORING ".edushell-restoring-"  // restores out of the trash in progress
+#define TREE_COPY_REPORT_BYTES (64LL << 20)     // copies this big, or with this many
+#define TREE_COPY_REPORT_FILES 1000             // files, report their throughput
 
 
 #define COLOR_GREEN "\033[0;32m"
@@ -41,6 +56,59 @@ typedef struct {
     struct timespec start_time;  //for tracking execution time
 } Command;
 
+// Bump allocator for per-line parse results
+typedef struct {
+    char *base;
+    size_t size;
+    size_t used;
+} Arena;
+
+// A chain of commands connected with '|'
+typedef struct {
+    Command *stages[MAX_PIPELINE_STAGES];
+    int stage_count;
+    bool is_background;
+} Pipeline;
+
+// What a command log record describes
+typedef enum {
+    LOG_COMMAND,        // a foreground external command
+    LOG_PIPELINE,       // one stage of a pipeline
+    LOG_BUILTIN,        // a builtin run by the shell
+    LOG_JOB             // a background process, when reaped
+} LogKind;
+
+// When the command log is flushed to disk
+typedef enum {
+    LOG_FSYNC_NEVER,    // left to the kernel
+    LOG_FSYNC_BATCH,    // after every batch
+    LOG_FSYNC_INTERVAL  // at most every so many seconds
+} LogFsync;
+
+typedef enum {
+    SPAWN_POSIX,    // posix_spawn (vfork-style, no page-table copy)
+    SPAWN_FORK      // classic fork + exec
+} SpawnMode;
+
+// Tab completion matches for one word
+typedef struct {
+    int count;            // matching names (an upper bound when not listed)
+    char *common;         // the word extended by what every match shares
+    char **matches;       // sorted names, or NULL past COMPLETION_LIST_MAX
+    bool *directories;    // per listed name, as far as d_type tells
+    bool directory;       // the only match is a directory
+} Completions;
+
+// What a cross-filesystem move copied, and how fast
+typedef struct {
+    bool copied;         // rename() couldn't do it
+    long files;
+    long directories;
+    long cloned;         // files reflinked rather than copied
+    long long bytes;
+    double seconds;
+} TreeCopyStats;
+
 typedef struct DeletedFile {
     char original_path[MAX_PATH_LENGTH];
     char trash_path[MAX_PATH_LENGTH];
@@ -49,35 +117,171 @@ typedef struct DeletedFile {
 } DeletedFile;
 
 typedef struct {
-    char *history[HISTORY_SIZE];
-    int history_count;
     char trash_dir[MAX_PATH_LENGTH];
     bool tutorial_mode;
-    FILE *log_file;
     struct DeletedFile *trash_list;
     int trash_count;
     bool sandbox_enabled;
     char sandbox_root[MAX_PATH_LENGTH];
     bool monitor_mode;  
     bool analytics_enabled;
+    SpawnMode spawn_mode;
+    bool spawn_trace;   // print launch latency for every command
+    int script_jobs;    // concurrent script lines allowed (-j)
 } ShellState;
 
+// Compiled .esh scripts: one instruction stream per script
+enum {
+    SCRIPT_OP_LINE,     // a = line number, b = source text; starts a command
+    SCRIPT_OP_ARG,      // a = argument string
+    SCRIPT_OP_INPUT,    // a = file for <
+    SCRIPT_OP_OUTPUT,   // a = file for > (>> when flags is set)
+    SCRIPT_OP_PIPE,     // start the next pipeline stage
+    SCRIPT_OP_RUN,      // execute; flags set means background
+    SCRIPT_OP_REPARSE,  // a = line that didn't parse; parse it at run time
+    SCRIPT_OP_BEGIN,    // a = line number; opens a block, parallel when flags is set
+    SCRIPT_OP_END       // a = line number; closes the innermost block
+};
+
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t a;
+    uint32_t b;
+} ScriptInsn;
+
+typedef struct {
+    const ScriptInsn *code;
+    uint32_t insn_count;
+    char *strtab;           // strings referenced by offset
+    uint32_t line_count;
+    uint64_t parse_ns;      // cost of compiling from source
+    uint64_t load_ns;       // cost of getting the program this run
+    bool cache_hit;
+    bool cached;            // compiled this run and stored for the next one
+    void *map;              // mmap'ed cache file, if loaded from cache
+    size_t map_size;
+    char *image;            // heap copy, if compiled this run
+} ScriptProgram;
+
+// Builtin flags
+#define BUILTIN_SHELL_STATE 0x1  // reads or changes the shell's own state
+#define BUILTIN_NO_FORK     0x2  // in-process stand-in for an external program
+#define BUILTIN_PREFIX      0x4  // runs another command, which analytics records instead
+
+// One entry of the builtin table generated from builtins.def
+typedef struct {
+    const char *name;
+    int (*handler)(Command *cmd, ShellState *state);
+    bool (*accepts)(const Command *cmd);
+    unsigned int flags;
+    const char *usage;
+    const char *summary;
+} Builtin;
+
+// Name hash shared by the builtin dispatcher and tools/gen_builtin_hash.c,
+// which searches for a seed that makes it collision-free over builtins.def
+static inline uint32_t builtin_name_hash(const char *name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;  // FNV-1a
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
 // Function prototypes
 void initialize_shell(ShellState *state);
 void cleanup_shell(ShellState *state);
 void shell_loop(ShellState *state);
-char *read_line(void);
+char *read_line(bool *eof);
 Command *parse_command(char *line);
 int execute_command(Command *cmd, ShellState *state);
+int execute_command_usage(Command *cmd, ShellState *state, CommandUsage *usage);
 void free_command(Command *cmd);
+Pipeline *parse_pipeline(char *line, Arena *arena);
+Pipeline *parse_pipeline_quiet(char *line, Arena *arena);
+int execute_pipeline(Pipeline *pipeline, ShellState *state, int *stage_status);
+void arena_init(Arena *arena, size_t size);
+void *arena_alloc(Arena *arena, size_t size);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+void parse_arena_init(Arena *arena);
 void handle_error(const char *message);
-bool handle_builtin(Command *cmd, ShellState *state);
-void log_command(ShellState *state, const char *command, int status);
+const Builtin *find_builtin(const char *name);
+const Builtin *builtin_at(int index);
+int builtin_count(void);
+bool is_builtin(const Command *cmd);
+bool run_builtin(Command *cmd, ShellState *state, int *status);
+bool handle_builtin(Command *cmd, ShellState *state, int *status);
+void print_builtin_usage(const char *name);
+void display_builtin_stats(void);
+void log_command(const char *command, LogKind kind, int status, double seconds);
+bool logger_start(const char *path);
+void logger_stop(void);
+void logger_poll(void);
+int logger_fd(void);
+void logger_set_fsync(LogFsync mode, double interval);
+void logger_set_rotation(long long bytes, int keep);
+void display_log_status(void);
 void suggest_command(const char *input);
 int levenshtein_distance(const char *s1, const char *s2);
+const char *autocorrect_lookup(const char *input, int *distance_out);
+int autocorrect_index_size(void);
 bool find_command_path(const char *cmd, char *path_buf, size_t buf_size);
+void hash_reset(void);
+void hash_list(void);
+pid_t spawn_command(const Command *cmd, const char *path, int in_fd, int out_fd,
+                    ShellState *state);
+const char *spawn_mode_name(SpawnMode mode);
+void display_spawn_stats(ShellState *state);
+double spawn_average_latency_us(void);
+bool read_process_io(pid_t pid, CommandUsage *usage);
+int wait_for_command(pid_t pid, CommandUsage *usage);
+void usage_from_rusage(CommandUsage *usage, const struct rusage *ru);
+bool copy_fd(int in_fd, int out_fd);
+bool clone_fd(int in_fd, int out_fd);
+bool fileops_supported(const Command *cmd);
+int builtin_cat(Command *cmd, ShellState *state);
+int builtin_cp(Command *cmd, ShellState *state);
+int jobs_add(Command *const *stages, const pid_t *pids, int count);
+int jobs_reap(ShellState *state);
+void jobs_notify(ShellState *state);
+int jobs_pidfds(int *fds, int max);
+void jobs_cleanup(void);
+void complete_command(const char *prefix, Completions *out);
+void complete_path(const char *word, Completions *out);
+void completions_free(Completions *completions);
+void line_editor_start(void);
+void line_editor_stop(void);
+char *line_editor_feed(bool *eof);
+bool line_editor_buffered(void);
+void line_editor_cancel(void);
+void line_editor_refresh(void);
+bool history_open(const char *path);
+void history_close(void);
+void history_refresh(void);
+bool history_add(const char *line);
+uint64_t history_count(void);
+const char *history_entry(uint64_t index);
+int64_t history_find(const char *text, int64_t before, bool prefix);
+bool events_init(void);
+void events_cleanup(void);
+void reset_child_signals(void);
+char *events_read_line(ShellState *state, bool *eof);
+int builtin_jobs(Command *cmd, ShellState *state);
+int builtin_wait(Command *cmd, ShellState *state);
+int builtin_fg(Command *cmd, ShellState *state);
+int builtin_bg(Command *cmd, ShellState *state);
 bool execute_script(const char *filename, ShellState *state);
+bool load_script_program(const char *filename, ScriptProgram *program);
+void free_script_program(ScriptProgram *program);
+bool move_tree(const char *src, const char *dst, int workers, TreeCopyStats *stats);
+void tree_copy_staging_path(const char *dst, pid_t pid, char *out, size_t size);
+bool remove_tree(const char *path);
 bool move_to_trash(const char *path, ShellState *state);
+void trash_cleanup(ShellState *state);
 bool restore_from_trash(const char *path, ShellState *state);
 void start_tutorial(ShellState *state);
 bool create_sandbox_env(const char *sandbox_root);
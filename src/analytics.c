@@ -6,182 +6,650 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/sysinfo.h>
-#include <sys/statvfs.h>
 #include <sys/times.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <limits.h>
+
+#define CHECKPOINT_MAGIC 0x314b4345u  // "ECK1"
+#define CHECKPOINT_VERSION 2
+
+// Aggregates as of the first event_count records of the log whose
+// creation time is log_created, followed by command_count CommandStats
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t stats_size;    // sizeof(CommandStats); other layouts are rebuilt from the log
+    uint32_t checksum;      // over everything after this field
+    int64_t log_created;
+    uint64_t event_count;
+    int64_t tracking_since;
+    int32_t command_count;
+    int32_t total_commands_executed;
+    int32_t total_errors;
+    int32_t forks_avoided;
+} CheckpointHeader;
 
 static ResourceHistory resource_history;
 static LearningStats learning_stats;
-static struct timespec last_update_time;
-static unsigned long long last_idle = 0, last_total = 0;
+static ResourceSample latest_sample;   // newest from the sampler thread
+static bool have_sample = false;
+static Sampler sampler;
+static EventStore event_store = {.fd = -1};
+static uint64_t events_applied;      // log records folded into learning_stats
+static uint64_t checkpoint_events;   // records covered by the checkpoint on disk
+static char checkpoint_path[PATH_MAX + 16];
+static int monitor_window = 60;      // seconds summarized under the live values
+static ResourcePoint recent_points[GRAPH_WIDTH];   // newest samples, for the graphs
+static int recent_count;
+static int recent_next;
+static Frame monitor_frame;
+static bool monitor_shown = false;
+static int monitor_term_rows;        // terminal height the scroll region was set for
+
+// Monitor rows besides the graphs (header, three labels, cores, summary)
+// and the least the shell keeps below it
+#define MONITOR_TEXT_ROWS 9
+#define MONITOR_SHELL_ROWS 6
 
-static const char *GRAPH_CHARS[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+static void open_history(void);
+static void save_checkpoint(void);
+static void record_event(StoredEvent *event);
 
 void initialize_analytics(void) {
-    memset(&resource_history, 0, sizeof(ResourceHistory));
+    resource_history_init(&resource_history);
     memset(&learning_stats, 0, sizeof(LearningStats));
     learning_stats.session_start = time(NULL);
-    clock_gettime(CLOCK_MONOTONIC, &last_update_time);
-    last_idle = last_total = 0;
+    learning_stats.tracking_since = learning_stats.session_start;
+    sampler_open(&sampler);
+    open_history();
+}
+
+void cleanup_analytics(void) {
+    exporter_stop();
+    hide_resource_graphs();
+    sampler_thread_stop();
+    sampler_close(&sampler);
+    if (event_store.fd >= 0) {
+        if (events_applied > checkpoint_events) save_checkpoint();
+        event_store_close(&event_store);
+    }
+    events_applied = checkpoint_events = 0;
+    free(learning_stats.commands);
+    free(learning_stats.slots);
+    learning_stats.commands = NULL;
+    learning_stats.slots = NULL;
+    learning_stats.command_count = learning_stats.command_capacity = 0;
+    learning_stats.slot_count = 0;
 }
 
 double get_cpu_usage(void) {
-    FILE *fp = fopen("/proc/stat", "r");
-    if (!fp) return 0.0;
+    if (!sampler_sample(&sampler)) return 0.0;
+    return sampler.cpu[0].busy;
+}
+
+double get_memory_usage(void) {
+    if (!sampler_sample(&sampler)) return 0.0;
+    return sampler_memory_usage(&sampler);
+}
+
+// Read + write throughput of all disks over the last interval, in MB/s
+double get_disk_io(void) {
+    if (!sampler_sample(&sampler)) return 0.0;
+    return (sampler.disk_read_bps + sampler.disk_write_bps) / 1e6;
+}
+
+// Take in what the sampler thread measured since the last call. Never
+// touches /proc, so it is cheap enough for the prompt path.
+void update_resource_usage(void) {
+    ResourceSample sample;
+    while (sampler_thread_pop(&sample)) {
+        // The rings get it back through the log, along with other shells' samples
+        const ResourcePoint *point = &sample.point;
+        StoredEvent event = {.type = EVENT_RESOURCE, .timestamp = point->timestamp};
+        event.resource.cpu_usage = point->cpu_usage;
+        event.resource.cpu_steal = point->cpu_steal;
+        event.resource.cpu_guest = point->cpu_guest;
+        event.resource.memory_usage = point->memory_usage;
+        event.resource.disk_io = point->disk_io;
+        event.resource.disk_iops = point->disk_iops;
+        record_event(&event);
 
-    unsigned long long user, nice, system, idle, iowait, irq, softirq;
-    if (fscanf(fp, "cpu %llu %llu %llu %llu %llu %llu %llu",
-               &user, &nice, &system, &idle, &iowait, &irq, &softirq) != 7) {
-        fclose(fp);
-        return 0.0;
+        latest_sample = sample;
+        have_sample = true;
+        recent_points[recent_next] = sample.point;
+        recent_next = (recent_next + 1) % GRAPH_WIDTH;
+        if (recent_count < GRAPH_WIDTH) recent_count++;
     }
-    fclose(fp);
+}
 
-    unsigned long long total = user + nice + system + idle + iowait + irq + softirq;
-    unsigned long long current_idle = idle + iowait;
+void set_monitor_window(int seconds) {
+    monitor_window = seconds;
+}
 
-    unsigned long long total_delta = total - last_total;
-    unsigned long long idle_delta = current_idle - last_idle;
+static const char *window_name(int seconds) {
+    if (seconds >= 86400) return "day";
+    if (seconds >= 3600) return "hour";
+    return "minute";
+}
 
-    last_total = total;
-    last_idle = current_idle;
+// Values of one metric over the recent samples, oldest first
+static int recent_series(ResourceMetric metric, float *values) {
+    for (int i = 0; i < recent_count; i++) {
+        const ResourcePoint *point = &recent_points[(recent_next - recent_count + i + GRAPH_WIDTH) % GRAPH_WIDTH];
+        values[i] = metric == METRIC_CPU      ? point->cpu_usage
+                    : metric == METRIC_MEMORY ? point->memory_usage
+                                              : point->disk_io;
+    }
+    return recent_count;
+}
 
-    if (total_delta == 0) return 0.0;
-    return 100.0 * (1.0 - ((double)idle_delta / total_delta));
+// A label line followed by a graph of the recent samples, newest at the
+// right, with its scale beside it. Returns the next free row.
+static int draw_graph(int row, int width, int height, ResourceMetric metric, double max,
+                      const char *top_label) {
+    float values[GRAPH_WIDTH];
+    int count = recent_series(metric, values);
+    if (count > width) {
+        memmove(values, values + count - width, width * sizeof(float));
+        count = width;
+    }
+    if (max <= 0) {
+        // Scale to the busiest sample shown, so quiet disks still register
+        for (int i = 0; i < count; i++) {
+            if (values[i] > max) max = values[i];
+        }
+        if (max < 0.1) max = 0.1;
+        char label[32];
+        snprintf(label, sizeof(label), "%.2f%s", max, top_label);
+        frame_text(&monitor_frame, row, 3 + width, "%s", label);
+    } else {
+        frame_text(&monitor_frame, row, 3 + width, "%s", top_label);
+    }
+    frame_text(&monitor_frame, row + height - 1, 3 + width, "0");
+    frame_sparkline(&monitor_frame, row, 2 + width - count, height, values, count, max);
+    return row + height;
 }
 
-double get_memory_usage(void) {
-    FILE *fp = fopen("/proc/meminfo", "r");
-    if (!fp) return 0.0;
-
-    unsigned long total = 0, free = 0, buffers = 0, cached = 0;
-    char line[256];
-
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "MemTotal:", 9) == 0)
-            sscanf(line, "MemTotal: %lu", &total);
-        else if (strncmp(line, "MemFree:", 8) == 0)
-            sscanf(line, "MemFree: %lu", &free);
-        else if (strncmp(line, "Buffers:", 8) == 0)
-            sscanf(line, "Buffers: %lu", &buffers);
-        else if (strncmp(line, "Cached:", 7) == 0) {
-            sscanf(line, "Cached: %lu", &cached);
-            break;
+void display_resource_graphs(void) {
+    struct winsize size;
+    int term_rows = 24, term_cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+        term_rows = size.ws_row;
+        term_cols = size.ws_col;
+    }
+
+    // Graphs shrink to leave the shell room below them; a terminal too
+    // small for even one-row graphs shows no monitor
+    int height = (term_rows - MONITOR_TEXT_ROWS - MONITOR_SHELL_ROWS) / 3;
+    if (height > GRAPH_HEIGHT) height = GRAPH_HEIGHT;
+    if (height < 1) return;
+    int width = term_cols - 14;
+    if (width > GRAPH_WIDTH) width = GRAPH_WIDTH;
+    if (width < 1) return;
+
+    int rows = MONITOR_TEXT_ROWS + 3 * height;
+    if (!frame_resize(&monitor_frame, rows, term_cols)) return;
+    if (term_rows != monitor_term_rows) frame_invalidate(&monitor_frame);
+    frame_clear(&monitor_frame);
+
+    Frame *frame = &monitor_frame;
+    double period = sampler_thread_period();
+    char dropped[64] = "";
+    if (sampler_thread_dropped() > 0) {
+        snprintf(dropped, sizeof(dropped), ", %lu samples dropped while the shell was busy",
+                 sampler_thread_dropped());
+    }
+    frame_text(frame, 0, 0, "Resource Usage Monitor (sampled every %g second%s%s)", period,
+               period != 1 ? "s" : "", dropped);
+
+    // Nothing sampled yet: show zeros rather than an unwritten sample
+    static const ResourceSample none;
+    const ResourceSample *latest = have_sample ? &latest_sample : &none;
+    int row = 1;
+    frame_text(frame, row++, 0, "CPU Usage: %.2f%% (steal %.2f%%, guest %.2f%%)",
+               latest->point.cpu_usage, latest->point.cpu_steal, latest->point.cpu_guest);
+    row = draw_graph(row, width, height, METRIC_CPU, 100, "100%");
+    frame_text(frame, row++, 0, "Memory Usage: %.2f%%", latest->point.memory_usage);
+    row = draw_graph(row, width, height, METRIC_MEMORY, 100, "100%");
+    frame_text(frame, row++, 0, "Disk I/O: %.2f MB/s (read %.2f, write %.2f), %.0f IOPS%s%s",
+               latest->point.disk_io, latest->disk_read_mbps, latest->disk_write_mbps,
+               latest->point.disk_iops, latest->busiest_disk[0] ? ", busiest " : "",
+               latest->busiest_disk);
+    row = draw_graph(row, width, height, METRIC_DISK_IO, 0, " MB/s");
+
+    // One bar per core; a tall bar next to low overall usage is a hot core,
+    // steal above a few percent means a noisy neighbour on the host
+    float cores[MAX_SAMPLED_CPUS];
+    int shown = latest->cpu_count < term_cols - 12 ? latest->cpu_count : term_cols - 12;
+    if (shown < 0) shown = 0;
+    for (int i = 0; i < shown; i++) cores[i] = latest->core_busy[i];
+    frame_text(frame, row, 0, "Cores:");
+    frame_sparkline(frame, row, 7, 1, cores, shown, 100);
+    if (latest->cpu_count > shown) frame_text(frame, row, 8 + shown, "+%d", latest->cpu_count - shown);
+    row++;
+
+    static const struct {
+        const char *label;
+        ResourceMetric metric;
+        const char *unit;
+    } ROWS[] = {
+        {"CPU", METRIC_CPU, "%"},
+        {"Memory", METRIC_MEMORY, "%"},
+        {"Disk", METRIC_DISK_IO, " MB/s"},
+    };
+    frame_text(frame, row++, 0, "Last %s (min / mean / max):", window_name(monitor_window));
+    for (size_t i = 0; i < sizeof(ROWS) / sizeof(ROWS[0]); i++) {
+        MetricSummary summary;
+        if (resource_history_window(&resource_history, time(NULL), monitor_window,
+                                    ROWS[i].metric, &summary)) {
+            frame_text(frame, row++, 0, "  %-7s %.2f%s / %.2f%s / %.2f%s", ROWS[i].label,
+                       summary.min, ROWS[i].unit, summary.mean, ROWS[i].unit, summary.max, ROWS[i].unit);
+        } else {
+            frame_text(frame, row++, 0, "  %-7s no samples", ROWS[i].label);
         }
     }
-    fclose(fp);
 
-    if (total == 0) return 0.0;
-    unsigned long used = total - free - buffers - cached;
-    return (100.0 * used) / total;
+    // The area stays put at the top of the screen: the shell scrolls in a
+    // region below it. A repaint re-establishes the region, since whatever
+    // drew over the area may have reset it.
+    char prefix[32] = "";
+    if (!monitor_shown) {
+        printf("\033[2J\033[%d;1H", rows + 1);
+    }
+    if (!frame->valid) {
+        snprintf(prefix, sizeof(prefix), "\033[%d;%dr", rows + 1, term_rows);
+    }
+    frame_flush(frame, STDOUT_FILENO, prefix[0] ? prefix : NULL);
+    monitor_shown = true;
+    monitor_term_rows = term_rows;
 }
 
-double get_disk_io(void) {
-    struct statvfs fs;
-    if (statvfs("/", &fs) != 0) return 0.0;
-    
-    unsigned long total = fs.f_blocks;
-    unsigned long free = fs.f_bfree;
-    if (total == 0) return 0.0;
-    
-    return 100.0 * (1.0 - ((double)free / total));
+// Give the monitor's rows back to the shell
+void hide_resource_graphs(void) {
+    if (!monitor_shown) return;
+    printf("\0337\033[r");
+    for (int row = 0; row < monitor_frame.rows; row++) {
+        printf("\033[%d;1H\033[2K", row + 1);
+    }
+    printf("\0338");
+    fflush(stdout);
+    frame_free(&monitor_frame);
+    monitor_shown = false;
+    monitor_term_rows = 0;
 }
 
-void update_resource_usage(void) {
-    struct timespec current_time;
-    clock_gettime(CLOCK_MONOTONIC, &current_time);
+// The next display repaints the whole area: after a foreground command,
+// which may have cleared or scrolled the screen
+void invalidate_resource_graphs(void) {
+    frame_invalidate(&monitor_frame);
+}
 
-    // Only update every UPDATE_INTERVAL seconds
-    double elapsed = (current_time.tv_sec - last_update_time.tv_sec) +
-                    (current_time.tv_nsec - last_update_time.tv_nsec) / 1e9;
-    
-    if (elapsed < UPDATE_INTERVAL) return;
+static unsigned int hash_command(const char *command) {
+    unsigned int h = 2166136261u;  // FNV-1a
+    while (*command) {
+        h ^= (unsigned char)*command++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Rebuild the index with slot_count slots (a power of two, more than
+// twice the commands) from the stored hashes
+static bool resize_slots(int slot_count) {
+    int *slots = calloc(slot_count, sizeof(int));
+    if (!slots) return false;
+
+    for (int i = 0; i < learning_stats.command_count; i++) {
+        unsigned int slot = learning_stats.commands[i].hash & (slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i + 1;
+    }
+    free(learning_stats.slots);
+    learning_stats.slots = slots;
+    learning_stats.slot_count = slot_count;
+    return true;
+}
+
+// Existing stats entry for a command, or NULL with *slot set to the empty
+// slot where it would go
+static CommandStats *lookup_command_stats(const char *command, unsigned int hash, unsigned int *slot) {
+    int mask = learning_stats.slot_count - 1;
+    *slot = hash & mask;
+    if (learning_stats.slot_count == 0) return NULL;
+
+    for (; learning_stats.slots[*slot]; *slot = (*slot + 1) & mask) {
+        CommandStats *stats = &learning_stats.commands[learning_stats.slots[*slot] - 1];
+        if (stats->hash == hash && strncmp(stats->command, command, sizeof(stats->command) - 1) == 0) {
+            return stats;
+        }
+    }
+    return NULL;
+}
+
+// Stats entry for a command, created on first use; NULL only when out of
+// memory. The pointer is good until the next new command is added.
+static CommandStats *find_command_stats(const char *command, time_t when) {
+    unsigned int hash = hash_command(command);
+    unsigned int slot;
+    CommandStats *found = lookup_command_stats(command, hash, &slot);
+    if (found) return found;
+
+    if (learning_stats.command_count == learning_stats.command_capacity) {
+        int capacity = learning_stats.command_capacity ? learning_stats.command_capacity * 2 : 32;
+        CommandStats *commands = realloc(learning_stats.commands, capacity * sizeof(CommandStats));
+        if (!commands) return NULL;
+        learning_stats.commands = commands;
+        learning_stats.command_capacity = capacity;
+    }
+    if ((learning_stats.command_count + 1) * 2 > learning_stats.slot_count) {
+        if (!resize_slots(learning_stats.slot_count ? learning_stats.slot_count * 2
+                                                    : COMMAND_TABLE_INITIAL_SLOTS)) {
+            return NULL;
+        }
+        lookup_command_stats(command, hash, &slot);
+    }
+
+    CommandStats *stats = &learning_stats.commands[learning_stats.command_count];
+    memset(stats, 0, sizeof(*stats));
+    strncpy(stats->command, command, sizeof(stats->command) - 1);
+    stats->hash = hash;
+    stats->first_use = when;
+    learning_stats.slots[slot] = ++learning_stats.command_count;
+    return stats;
+}
+
+static void add_resource_event(const StoredEvent *event, void *context) {
+    (void)context;
+    if (event->type != EVENT_RESOURCE) return;
 
     ResourcePoint point = {
-        .timestamp = time(NULL),
-        .cpu_usage = get_cpu_usage(),
-        .memory_usage = get_memory_usage(),
-        .disk_io = get_disk_io()
+        .timestamp = event->timestamp,
+        .cpu_usage = event->resource.cpu_usage,
+        .cpu_steal = event->resource.cpu_steal,
+        .cpu_guest = event->resource.cpu_guest,
+        .memory_usage = event->resource.memory_usage,
+        .disk_io = event->resource.disk_io,
+        .disk_iops = event->resource.disk_iops
     };
-    
-    resource_history.points[resource_history.current_index] = point;
-    resource_history.current_index = (resource_history.current_index + 1) % MAX_RESOURCE_POINTS;
-    if (resource_history.total_points < MAX_RESOURCE_POINTS) {
-        resource_history.total_points++;
-    }
+    resource_history_add(&resource_history, &point);
+}
 
-    last_update_time = current_time;
+// Fold one event into the aggregates. Both live tracking and replay at
+// startup come through here, so the aggregates are always exactly the
+// log's records so far.
+static void apply_event(const StoredEvent *event, void *context) {
+    (void)context;
+    CommandStats *stats;
+    bool had_error = event->flags & EVENT_FLAG_ERROR;
+
+    switch (event->type) {
+        case EVENT_COMMAND:
+            stats = find_command_stats(event->command.name, event->timestamp);
+            if (stats) {
+                stats->usage_count++;
+                stats->last_use = event->timestamp;
+                if (had_error) stats->error_count++;
+                stats->avg_execution_time = ((stats->avg_execution_time * (stats->usage_count - 1)) +
+                                             event->command.seconds) / stats->usage_count;
+                histogram_record(&stats->latency, event->command.seconds);
+            }
+            learning_stats.total_commands_executed++;
+            if (had_error) learning_stats.total_errors++;
+            break;
+
+        case EVENT_USAGE:
+            stats = find_command_stats(event->usage.name, event->timestamp);
+            if (!stats) break;
+            stats->measured_runs++;
+            stats->read_bytes += event->usage.read_bytes;
+            stats->write_bytes += event->usage.write_bytes;
+            stats->user_time += event->usage.user_time;
+            stats->sys_time += event->usage.sys_time;
+            if ((long)event->usage.max_rss_kb > stats->max_rss_kb) stats->max_rss_kb = event->usage.max_rss_kb;
+            stats->major_faults += event->usage.major_faults;
+            stats->minor_faults += event->usage.minor_faults;
+            stats->voluntary_switches += event->usage.voluntary_switches;
+            stats->involuntary_switches += event->usage.involuntary_switches;
+            break;
+
+        case EVENT_FORK_AVOIDED:
+            learning_stats.forks_avoided++;
+            break;
+
+        case EVENT_RESOURCE:
+            add_resource_event(event, NULL);
+            break;
+    }
 }
 
-void display_resource_graphs(void) {
-    static bool first_display = true;
-    double cpu_values[MAX_RESOURCE_POINTS];
-    double mem_values[MAX_RESOURCE_POINTS];
-    double disk_values[MAX_RESOURCE_POINTS];
-    
-    int start_idx = (resource_history.current_index - resource_history.total_points + MAX_RESOURCE_POINTS) % MAX_RESOURCE_POINTS;
-    
-    for (int i = 0; i < resource_history.total_points; i++) {
-        int idx = (start_idx + i) % MAX_RESOURCE_POINTS;
-        cpu_values[i] = resource_history.points[idx].cpu_usage;
-        mem_values[i] = resource_history.points[idx].memory_usage;
-        disk_values[i] = resource_history.points[idx].disk_io;
+// Log an event and fold in everything new in the log, including what other
+// shells appended meanwhile. Without a log the event still counts for this
+// session.
+static void record_event(StoredEvent *event) {
+    if (!event_store_append(&event_store, event)) {
+        apply_event(event, NULL);
+        return;
     }
 
-    if (first_display) {
-        // On first display, clear screen and add padding
-        printf("\033[2J");  // Clear entire screen
-        printf("\033[H");   // Move cursor to top
-        // Add some padding lines to preserve command history
-        for (int i = 0; i < 35; i++) printf("\n");
-        first_display = false;
+    events_applied = event_store_replay(&event_store, events_applied, apply_event, NULL);
+    if (events_applied - checkpoint_events >= EVENT_CHECKPOINT_INTERVAL) {
+        save_checkpoint();
     }
-    
-    // Move cursor up to the start of the monitoring area
-    printf("\033[35A");  // Move up 35 lines
-    printf("\033[K");    // Clear line
-    
-    printf("Resource Usage Monitor (Updated every %d second%s)\n", 
-           UPDATE_INTERVAL, UPDATE_INTERVAL > 1 ? "s" : "");
-    
-    // Display numerical statistics instead of graphs
-    printf("CPU Usage: %.2f%%\n", cpu_values[resource_history.current_index]);
-    printf("Memory Usage: %.2f%%\n", mem_values[resource_history.current_index]);
-    printf("Disk Usage: %.2f%%\n", disk_values[resource_history.current_index]);
 
-    // Move cursor to the bottom of the monitoring area
-    printf("\033[E");  // Move to beginning of next line
-    
-    fflush(stdout);
+    // Keep the log bounded: once it is long, drop the oldest records, which
+    // only ever go as far as a checkpoint that already counts them
+    if (events_applied - event_store.first_event > EVENT_LOG_MAX_EVENTS) {
+        if (checkpoint_events != events_applied) save_checkpoint();
+        uint64_t keep_from = events_applied - EVENT_LOG_KEEP_EVENTS;
+        if (keep_from > checkpoint_events) keep_from = checkpoint_events;
+        event_store_compact(&event_store, keep_from);
+    }
 }
 
 void track_command_execution(const char *command, double execution_time, bool had_error) {
-    // Find existing command or create new entry
-    int cmd_idx = -1;
-    for (int i = 0; i < learning_stats.command_count; i++) {
-        if (strcmp(learning_stats.commands[i].command, command) == 0) {
-            cmd_idx = i;
-            break;
+    StoredEvent event = {
+        .type = EVENT_COMMAND,
+        .flags = had_error ? EVENT_FLAG_ERROR : 0,
+        .timestamp = time(NULL)
+    };
+    strncpy(event.command.name, command, sizeof(event.command.name) - 1);
+    event.command.seconds = execution_time;
+    record_event(&event);
+}
+
+static uint32_t clamp_u32(long value) {
+    if (value < 0) return 0;
+    return value > (long)UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+void track_command_usage(const char *command, const CommandUsage *usage) {
+    StoredEvent event = {.type = EVENT_USAGE, .timestamp = time(NULL)};
+    strncpy(event.usage.name, command, sizeof(event.usage.name) - 1);
+    event.usage.read_bytes = usage->read_bytes;
+    event.usage.write_bytes = usage->write_bytes;
+    event.usage.user_time = usage->user_time;
+    event.usage.sys_time = usage->sys_time;
+    event.usage.max_rss_kb = clamp_u32(usage->max_rss_kb);
+    event.usage.major_faults = clamp_u32(usage->major_faults);
+    event.usage.minor_faults = clamp_u32(usage->minor_faults);
+    event.usage.voluntary_switches = clamp_u32(usage->voluntary_switches);
+    event.usage.involuntary_switches = clamp_u32(usage->involuntary_switches);
+    record_event(&event);
+}
+
+// The open event log, or NULL when analytics only live for this session
+EventStore *analytics_event_store(void) {
+    return event_store.fd >= 0 ? &event_store : NULL;
+}
+
+// Times the command was run at the prompt, over the whole history
+int analytics_command_uses(const char *command) {
+    unsigned int slot;
+    CommandStats *stats = lookup_command_stats(command, hash_command(command), &slot);
+    return stats ? stats->usage_count : 0;
+}
+
+const LearningStats *analytics_stats(void) {
+    return &learning_stats;
+}
+
+const ResourceHistory *analytics_resource_history(void) {
+    return &resource_history;
+}
+
+// Newest sample from the sampler thread, or NULL before the first
+const ResourceSample *analytics_latest_sample(void) {
+    return have_sample ? &latest_sample : NULL;
+}
+
+void track_fork_avoided(void) {
+    StoredEvent event = {.type = EVENT_FORK_AVOIDED, .timestamp = time(NULL)};
+    record_event(&event);
+}
+
+// Start from the checkpoint if it describes a prefix of this log
+static bool load_checkpoint(void) {
+    int fd = open(checkpoint_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const CheckpointHeader *h = map;
+    size_t body = (size_t)st.st_size - offsetof(CheckpointHeader, log_created);
+    bool valid = h->magic == CHECKPOINT_MAGIC && h->version == CHECKPOINT_VERSION &&
+                 h->stats_size == sizeof(CommandStats) &&
+                 h->log_created == event_store.created &&
+                 h->event_count >= event_store.first_event &&
+                 h->event_count <= event_store.event_count &&
+                 h->command_count >= 0 &&
+                 (size_t)st.st_size == sizeof(*h) + (size_t)h->command_count * sizeof(CommandStats) &&
+                 h->checksum == event_checksum(&h->log_created, body);
+
+    if (valid && h->command_count > 0) {
+        int capacity = 32;
+        while (capacity < h->command_count) capacity *= 2;
+        learning_stats.commands = malloc(capacity * sizeof(CommandStats));
+        valid = learning_stats.commands != NULL;
+        if (valid) {
+            memcpy(learning_stats.commands, (const char *)map + sizeof(*h),
+                   h->command_count * sizeof(CommandStats));
+            learning_stats.command_capacity = capacity;
+            learning_stats.command_count = h->command_count;
+            int slot_count = COMMAND_TABLE_INITIAL_SLOTS;
+            while (slot_count < learning_stats.command_count * 2) slot_count *= 2;
+            valid = resize_slots(slot_count);
         }
     }
-    
-    if (cmd_idx == -1 && learning_stats.command_count < MAX_TRACKED_COMMANDS) {
-        cmd_idx = learning_stats.command_count++;
-        strncpy(learning_stats.commands[cmd_idx].command, command, sizeof(learning_stats.commands[cmd_idx].command) - 1);
-        learning_stats.commands[cmd_idx].first_use = time(NULL);
+
+    if (valid) {
+        learning_stats.tracking_since = h->tracking_since;
+        learning_stats.total_commands_executed = h->total_commands_executed;
+        learning_stats.total_errors = h->total_errors;
+        learning_stats.forks_avoided = h->forks_avoided;
+        events_applied = checkpoint_events = h->event_count;
+    } else {
+        free(learning_stats.commands);
+        free(learning_stats.slots);
+        learning_stats.commands = NULL;
+        learning_stats.slots = NULL;
+        learning_stats.command_count = learning_stats.command_capacity = 0;
+        learning_stats.slot_count = 0;
     }
-    
-    if (cmd_idx != -1) {
-        CommandStats *stats = &learning_stats.commands[cmd_idx];
-        stats->usage_count++;
-        stats->last_use = time(NULL);
-        if (had_error) stats->error_count++;
-        stats->avg_execution_time = ((stats->avg_execution_time * (stats->usage_count - 1)) + execution_time) / stats->usage_count;
+    munmap(map, st.st_size);
+    return valid;
+}
+
+// Write the aggregates next to the log: the log is synced first so the
+// checkpoint never covers events a power cut could take back, and the file
+// is replaced with a rename so readers see the old or the new one whole
+static void save_checkpoint(void) {
+    if (!event_store_sync(&event_store)) return;
+
+    size_t commands_size = (size_t)learning_stats.command_count * sizeof(CommandStats);
+    size_t size = sizeof(CheckpointHeader) + commands_size;
+    CheckpointHeader *h = calloc(1, size);
+    if (!h) return;
+
+    h->magic = CHECKPOINT_MAGIC;
+    h->version = CHECKPOINT_VERSION;
+    h->stats_size = sizeof(CommandStats);
+    h->log_created = event_store.created;
+    h->event_count = events_applied;
+    h->tracking_since = learning_stats.tracking_since;
+    h->command_count = learning_stats.command_count;
+    h->total_commands_executed = learning_stats.total_commands_executed;
+    h->total_errors = learning_stats.total_errors;
+    h->forks_avoided = learning_stats.forks_avoided;
+    if (commands_size > 0) memcpy(h + 1, learning_stats.commands, commands_size);
+    h->checksum = event_checksum(&h->log_created, size - offsetof(CheckpointHeader, log_created));
+
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", checkpoint_path, (int)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool ok = fd >= 0 && write(fd, h, size) == (ssize_t)size && fsync(fd) == 0;
+    if (fd >= 0) close(fd);
+    if (ok && rename(tmp_path, checkpoint_path) == 0) {
+        checkpoint_events = events_applied;
+    } else {
+        unlink(tmp_path);
+    }
+    free(h);
+}
+
+// Open ~/.edushell/analytics and rebuild the aggregates: the checkpoint
+// plus whatever was logged after it. Without a usable log the shell keeps
+// analytics for this session only.
+static void open_history(void) {
+    const char *home = getenv("HOME");
+    if (!home) return;
+
+    char dir[PATH_MAX], log_path[PATH_MAX + 16];
+    snprintf(dir, sizeof(dir), "%s/.edushell", home);
+    mkdir(dir, 0700);
+    snprintf(dir, sizeof(dir), "%s/.edushell/analytics", home);
+    mkdir(dir, 0700);
+    snprintf(log_path, sizeof(log_path), "%s/events.log", dir);
+    snprintf(checkpoint_path, sizeof(checkpoint_path), "%s/checkpoint", dir);
+
+    if (!event_store_open(&event_store, log_path)) {
+        fprintf(stderr, COLOR_RED "analytics: %s is unusable; history is kept for this session only\n"
+                COLOR_RESET, log_path);
+        return;
+    }
+    if (!load_checkpoint()) {
+        learning_stats.tracking_since = event_store.created;
+    }
+
+    // The rings aren't checkpointed: refill them with the samples of their
+    // span up to the checkpoint; the replay below brings in the rest
+    int64_t span = (int64_t)3600 * RESOURCE_RING_SIZE;
+    uint64_t span_start = event_store_find_time(&event_store, time(NULL) - span);
+    if (span_start < events_applied) {
+        event_store_replay_range(&event_store, span_start, events_applied, add_resource_event, NULL);
+    }
+    events_applied = event_store_replay(&event_store, events_applied, apply_event, NULL);
+    if (events_applied - checkpoint_events >= EVENT_CHECKPOINT_INTERVAL) {
+        save_checkpoint();
+    }
+
+    // Keep the log bounded: once it is long, drop the oldest records, which
+    // only ever go as far as a checkpoint that already counts them
+    if (events_applied - event_store.first_event > EVENT_LOG_MAX_EVENTS) {
+        if (checkpoint_events != events_applied) save_checkpoint();
+        uint64_t keep_from = events_applied - EVENT_LOG_KEEP_EVENTS;
+        if (keep_from > checkpoint_events) keep_from = checkpoint_events;
+        event_store_compact(&event_store, keep_from);
     }
-    
-    learning_stats.total_commands_executed++;
-    if (had_error) learning_stats.total_errors++;
 }
 
 const char *get_proficiency_level(int usage_count, int error_rate) {
@@ -191,6 +659,91 @@ const char *get_proficiency_level(int usage_count, int error_rate) {
     return "Proficient";
 }
 
+// Indices of the commands `keep` accepts (all when NULL), sorted by `key`
+// from highest to lowest. The caller frees the array.
+static double (*rank_key)(const CommandStats *stats);
+
+static int compare_rank(const void *a, const void *b) {
+    double ka = rank_key(&learning_stats.commands[*(const int *)a]);
+    double kb = rank_key(&learning_stats.commands[*(const int *)b]);
+    if (ka != kb) return ka < kb ? 1 : -1;
+    return *(const int *)a - *(const int *)b;  // ties keep first-use order
+}
+
+static int *rank_commands(double (*key)(const CommandStats *stats),
+                          bool (*keep)(const CommandStats *stats), int *count) {
+    int *indices = malloc((learning_stats.command_count + 1) * sizeof(int));
+    *count = 0;
+    if (!indices) return NULL;
+
+    for (int i = 0; i < learning_stats.command_count; i++) {
+        if (!keep || keep(&learning_stats.commands[i])) indices[(*count)++] = i;
+    }
+    rank_key = key;
+    qsort(indices, *count, sizeof(int), compare_rank);
+    return indices;
+}
+
+static const char *format_bytes(double bytes, char *buf, size_t size) {
+    static const char *UNITS[] = {"B", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+        bytes /= 1024;
+        unit++;
+    }
+    snprintf(buf, size, unit ? "%.1f %s" : "%.0f %s", bytes, UNITS[unit]);
+    return buf;
+}
+
+// Latencies span microseconds to minutes; keep three significant digits
+static const char *format_seconds(double seconds, char *buf, size_t size) {
+    if (seconds < 1e-3) snprintf(buf, size, "%.0fus", seconds * 1e6);
+    else if (seconds < 1.0) snprintf(buf, size, "%.3gms", seconds * 1e3);
+    else snprintf(buf, size, "%.3gs", seconds);
+    return buf;
+}
+
+static double usage_count(const CommandStats *stats) {
+    return stats->usage_count;
+}
+
+// Script lines report rusage without counting as runs typed at the prompt
+static bool was_run(const CommandStats *stats) {
+    return stats->usage_count > 0;
+}
+
+static double io_per_run(const CommandStats *stats) {
+    if (stats->measured_runs == 0) return 0.0;
+    return (double)(stats->read_bytes + stats->write_bytes) / stats->measured_runs;
+}
+
+static bool did_io(const CommandStats *stats) {
+    return io_per_run(stats) > 0;
+}
+
+// Commands ranked by storage I/O per run, from /proc/<pid>/io
+static void display_io_heavy_commands(void) {
+    int count;
+    int *indices = rank_commands(io_per_run, did_io, &count);
+    if (count == 0) {
+        free(indices);
+        return;
+    }
+
+    printf("\nI/O Heavy Commands:\n");
+    printf("%-20s %-14s %-14s %-14s\n", "Command", "Read", "Written", "Per Run");
+    printf("------------------------------------------------------------\n");
+    for (int i = 0; i < count && i < 5; i++) {
+        CommandStats *stats = &learning_stats.commands[indices[i]];
+        char read_buf[16], write_buf[16], run_buf[16];
+        printf("%-20s %-14s %-14s %-14s\n", stats->command,
+               format_bytes(stats->read_bytes, read_buf, sizeof(read_buf)),
+               format_bytes(stats->write_bytes, write_buf, sizeof(write_buf)),
+               format_bytes(io_per_run(stats), run_buf, sizeof(run_buf)));
+    }
+    free(indices);
+}
+
 void display_learning_dashboard(void) {
     time_t current_time = time(NULL);
     double session_duration = difftime(current_time, learning_stats.session_start);
@@ -201,43 +754,108 @@ void display_learning_dashboard(void) {
     
     printf("Session Statistics:\n");
     printf("- Duration: %.1f minutes\n", session_duration / 60.0);
+
+    char since[32];
+    strftime(since, sizeof(since), "%Y-%m-%d %H:%M", localtime(&learning_stats.tracking_since));
+    printf("\nHistory (since %s, %llu events on disk):\n", since,
+           (unsigned long long)(event_store.event_count - event_store.first_event));
     printf("- Total Commands: %d\n", learning_stats.total_commands_executed);
-    printf("- Success Rate: %.1f%%\n\n", 
+    printf("- Success Rate: %.1f%%\n", 
            100.0 * (1.0 - (double)learning_stats.total_errors / learning_stats.total_commands_executed));
+    printf("- Forks Avoided: %d (~%.2f ms of process launch saved)\n\n",
+           learning_stats.forks_avoided,
+           learning_stats.forks_avoided * spawn_average_latency_us() / 1000.0);
     
     printf("Command Usage (Top 10):\n");
-    printf("%-20s %-10s %-15s %-10s %-15s\n", 
-           "Command", "Uses", "Errors", "Avg Time", "Proficiency");
-    printf("------------------------------------------------------------\n");
-    
+    printf("%-16s %-6s %-7s %-9s %-9s %-9s %-9s %-9s %-13s\n",
+           "Command", "Uses", "Errors", "Avg", "p50", "p90", "p99", "Max", "Proficiency");
+    printf("------------------------------------------------------------"
+           "----------------------------------\n");
+
     // Sort commands by usage count
-    int indices[MAX_TRACKED_COMMANDS];
-    for (int i = 0; i < learning_stats.command_count; i++) indices[i] = i;
-    
-    for (int i = 0; i < learning_stats.command_count - 1; i++) {
-        for (int j = 0; j < learning_stats.command_count - i - 1; j++) {
-            if (learning_stats.commands[indices[j]].usage_count < 
-                learning_stats.commands[indices[j + 1]].usage_count) {
-                int temp = indices[j];
-                indices[j] = indices[j + 1];
-                indices[j + 1] = temp;
-            }
-        }
-    }
-    
+    int count;
+    int *indices = rank_commands(usage_count, was_run, &count);
+
     // Display top 10 commands
-    for (int i = 0; i < learning_stats.command_count && i < 10; i++) {
+    for (int i = 0; i < count && i < 10; i++) {
         CommandStats *stats = &learning_stats.commands[indices[i]];
         int error_rate = (int)(100.0 * stats->error_count / stats->usage_count);
-        printf("%-20s %-10d %-15d %-10.2fs %-15s\n",
+        char avg[16], p50[16], p90[16], p99[16], max[16];
+        printf("%-16s %-6d %-7d %-9s %-9s %-9s %-9s %-9s %-13s\n",
                stats->command, stats->usage_count, stats->error_count,
-               stats->avg_execution_time,
+               format_seconds(stats->avg_execution_time, avg, sizeof(avg)),
+               format_seconds(histogram_percentile(&stats->latency, 50), p50, sizeof(p50)),
+               format_seconds(histogram_percentile(&stats->latency, 90), p90, sizeof(p90)),
+               format_seconds(histogram_percentile(&stats->latency, 99), p99, sizeof(p99)),
+               format_seconds(stats->latency.max_us / 1e6, max, sizeof(max)),
                get_proficiency_level(stats->usage_count, error_rate));
     }
-    
+    free(indices);
+
+    display_io_heavy_commands();
     generate_learning_suggestions();
 }
 
+static double cpu_per_run(const CommandStats *stats) {
+    if (stats->measured_runs == 0) return 0.0;
+    return (stats->user_time + stats->sys_time) / stats->measured_runs;
+}
+
+static double max_rss(const CommandStats *stats) {
+    return stats->max_rss_kb;
+}
+
+static double avg_wall(const CommandStats *stats) {
+    return stats->avg_execution_time;
+}
+
+// Only processes have rusage; builtins rank by wall time alone
+static bool was_measured(const CommandStats *stats) {
+    return stats->measured_runs > 0;
+}
+
+// Rank commands by cpu, mem, io or wall cost per run. Returns false for
+// an unknown key.
+bool display_command_costs(const char *key) {
+    double (*rank)(const CommandStats *stats);
+    if (strcmp(key, "cpu") == 0) rank = cpu_per_run;
+    else if (strcmp(key, "mem") == 0) rank = max_rss;
+    else if (strcmp(key, "io") == 0) rank = io_per_run;
+    else if (strcmp(key, "wall") == 0) rank = avg_wall;
+    else return false;
+
+    int count;
+    int *indices = rank_commands(rank, rank == avg_wall ? NULL : was_measured, &count);
+
+    printf("Command Cost by %s (per run):\n", key);
+    printf("%-16s %-6s %-10s %-10s %-10s %-12s %-14s %-12s\n", "Command", "Runs",
+           "Wall", "User", "Sys", "Max RSS", "Faults maj/min", "Ctx vol/inv");
+    printf("------------------------------------------------------------"
+           "------------------------------------\n");
+    for (int i = 0; i < count; i++) {
+        CommandStats *stats = &learning_stats.commands[indices[i]];
+        int runs = stats->measured_runs ? stats->measured_runs : 1;
+        char rss[16], faults[24], switches[24];
+        format_bytes(stats->max_rss_kb * 1024.0, rss, sizeof(rss));
+        snprintf(faults, sizeof(faults), "%ld/%ld",
+                 stats->major_faults / runs, stats->minor_faults / runs);
+        snprintf(switches, sizeof(switches), "%ld/%ld",
+                 stats->voluntary_switches / runs, stats->involuntary_switches / runs);
+        char wall[16], user[16], sys[16];
+        snprintf(wall, sizeof(wall), "%.3fs", stats->avg_execution_time);
+        snprintf(user, sizeof(user), "%.3fs", stats->user_time / runs);
+        snprintf(sys, sizeof(sys), "%.3fs", stats->sys_time / runs);
+        printf("%-16s %-6d %-10s %-10s %-10s %-12s %-14s %-12s\n",
+               stats->command, stats->usage_count, wall, user, sys,
+               stats->measured_runs ? rss : "-", faults, switches);
+    }
+    if (count == 0) {
+        printf("No external commands measured yet\n");
+    }
+    free(indices);
+    return true;
+}
+
 void generate_learning_suggestions(void) {
     printf("\nLearning Suggestions:\n");
     printf("-------------------\n");
@@ -245,7 +863,7 @@ void generate_learning_suggestions(void) {
     // Find least used commands
     printf("1. Try exploring these commands more:\n");
     for (int i = 0; i < learning_stats.command_count; i++) {
-        if (learning_stats.commands[i].usage_count < 5) {
+        if (was_run(&learning_stats.commands[i]) && learning_stats.commands[i].usage_count < 5) {
             printf("   - %s (used %d times)\n", 
                    learning_stats.commands[i].command,
                    learning_stats.commands[i].usage_count);
@@ -270,12 +888,12 @@ void generate_learning_suggestions(void) {
 void display_resource_statistics(void) {
     double cpu_usage = get_cpu_usage();
     double memory_usage = get_memory_usage();
-    double disk_usage = get_disk_io();
+    double disk_io = get_disk_io();
 
     printf("Resource Usage Statistics:\n");
     printf("CPU Usage: %.2f%%\n", cpu_usage);
     printf("Memory Usage: %.2f%%\n", memory_usage);
-    printf("Disk Usage: %.2f%%\n", disk_usage);
+    printf("Disk I/O: %.2f MB/s\n", disk_io);
 
     fflush(stdout);
 }
\ No newline at end of file
@@ -1,74 +1,403 @@
 #include "edushell.h"
+#include <dirent.h>
 #include <limits.h>
-// Common Unix commands for suggestions
-static const char *COMMON_COMMANDS[] = {
-    "ls", "cd", "pwd", "mkdir", "rm", "cp", "mv", "cat", "grep",
-    "echo", "touch", "chmod", "chown", "man", "find", "ps",
-    "kill", "top", "clear", "history", "exit", "help",NULL
-};
+#include <math.h>
+
+// Candidate commands: every executable on PATH plus the builtins, in a
+// BK-tree keyed by edit distance. A lookup for distance <= k only visits
+// children whose edge lies within k of the distance to their parent, so
+// most of the tree is never compared against.
+typedef struct {
+    uint32_t name;           // offset into the name pool
+    uint16_t length;
+    uint16_t edge;           // distance to the parent
+    int32_t first_child;
+    int32_t next_sibling;
+    bool builtin;
+} BkNode;
+
+typedef struct {
+    char *pool;
+    size_t pool_length;
+    size_t pool_capacity;
+    BkNode *nodes;
+    int count;
+    int capacity;
+    // PATH and its directories' mtimes when built; any change rebuilds
+    char *path_env;
+    struct timespec *mtimes;
+    int dir_count;
+} CorrectionIndex;
+
+// Bit-parallel matching state for one pattern (Myers 1999, in Hyyrö's
+// formulation for whole-string distance): bit i of peq[c] is set when
+// pattern[i] == c
+typedef struct {
+    uint64_t peq[256];
+    const char *pattern;
+    int length;
+} Pattern;
+
+static CorrectionIndex index_;
+
+static const char *node_name(const BkNode *node) {
+    return index_.pool + node->name;
+}
+
+static void pattern_init(Pattern *pattern, const char *text, int length) {
+    memset(pattern->peq, 0, sizeof(pattern->peq));
+    pattern->pattern = text;
+    pattern->length = length;
+    for (int i = 0; i < length && i < 64; i++) {
+        pattern->peq[(unsigned char)text[i]] |= 1ULL << i;
+    }
+}
+
+// Plain two-row dynamic program, for patterns too long for one word
+static int dp_distance(const char *a, int la, const char *b, int lb, int max) {
+    int *row = malloc((lb + 1) * sizeof(int));
+    if (!row) return max + 1;
+    for (int j = 0; j <= lb; j++) row[j] = j;
+
+    for (int i = 1; i <= la; i++) {
+        int diagonal = row[0];
+        int best = row[0] = i;
+        for (int j = 1; j <= lb; j++) {
+            int above = row[j];
+            row[j] = MIN3(above + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1]));
+            diagonal = above;
+            if (row[j] < best) best = row[j];
+        }
+        // Every path to the corner goes through this row
+        if (best > max) {
+            free(row);
+            return max + 1;
+        }
+    }
+    int distance = row[lb];
+    free(row);
+    return distance;
+}
+
+// Edit distance from the pattern to `text`, or max + 1 as soon as it is
+// certain to exceed max
+static int bounded_distance(const Pattern *pattern, const char *text, int length, int max) {
+    int m = pattern->length;
+    if (abs(m - length) > max) return max + 1;
+    if (m == 0) return length;
+    if (m > 64) return dp_distance(pattern->pattern, m, text, length, max);
+
+    uint64_t pv = ~0ULL, mv = 0, high = 1ULL << (m - 1);
+    int score = m;
+    for (int j = 0; j < length; j++) {
+        uint64_t eq = pattern->peq[(unsigned char)text[j]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & high) score++;
+        else if (mh & high) score--;
+
+        // Row 0 of the matrix grows by one per text character
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        // The last row can fall by at most one per remaining character
+        if (score - (length - j - 1) > max) return max + 1;
+    }
+    return score;
+}
 
 int levenshtein_distance(const char *s1, const char *s2) {
-    int len1 = strlen(s1);
-    int len2 = strlen(s2);
-
-    int matrix[len1 + 1][len2 + 1];
-    
-
-    for (int i = 0; i <= len1; i++)
-        matrix[i][0] = i;
-    for (int j = 0; j <= len2; j++)
-        matrix[0][j] = j;
-
-    for (int i = 1; i <= len1; i++) {
-        for (int j = 1; j <= len2; j++) {
-            int cost = (s1[i-1] == s2[j-1]) ? 0 : 1;
-            
-            matrix[i][j] = MIN3(
-                matrix[i-1][j] + 1,      
-                matrix[i][j-1] + 1,      
-                matrix[i-1][j-1] + cost  
-            );
+    Pattern pattern;
+    int length = strlen(s1);
+    pattern_init(&pattern, s1, length);
+    return bounded_distance(&pattern, s2, strlen(s2), INT_MAX - 1);
+}
+
+static void free_index(void) {
+    free(index_.pool);
+    free(index_.nodes);
+    free(index_.path_env);
+    free(index_.mtimes);
+    memset(&index_, 0, sizeof(index_));
+}
+
+static void dir_mtime(const char *dir, struct timespec *mtime) {
+    struct stat st;
+    if (stat(dir, &st) == 0) {
+        *mtime = st.st_mtim;
+    } else {
+        mtime->tv_sec = 0;
+        mtime->tv_nsec = 0;
+    }
+}
+
+// Call `visit` for each PATH directory, in order
+static void for_each_path_dir(const char *path_env, void (*visit)(const char *dir, int i)) {
+    char dir[PATH_MAX];
+    int i = 0;
+    for (const char *start = path_env;; i++) {
+        const char *end = strchr(start, ':');
+        size_t length = end ? (size_t)(end - start) : strlen(start);
+        // An empty PATH element means the current directory
+        if (length == 0) snprintf(dir, sizeof(dir), ".");
+        else snprintf(dir, sizeof(dir), "%.*s", (int)length, start);
+        visit(dir, i);
+        if (!end) break;
+        start = end + 1;
+    }
+}
+
+static bool stale = false;
+
+static void check_mtime(const char *dir, int i) {
+    struct timespec now;
+    dir_mtime(dir, &now);
+    if (i >= index_.dir_count || now.tv_sec != index_.mtimes[i].tv_sec ||
+        now.tv_nsec != index_.mtimes[i].tv_nsec) {
+        stale = true;
+    }
+}
+
+static bool index_current(const char *path_env) {
+    if (!index_.path_env || strcmp(index_.path_env, path_env) != 0) return false;
+    stale = false;
+    for_each_path_dir(path_env, check_mtime);
+    return !stale;
+}
+
+static bool add_name(const char *name, bool builtin) {
+    size_t length = strlen(name);
+    if (length == 0 || length > UINT16_MAX) return true;
+    if (index_.count == index_.capacity) {
+        int capacity = index_.capacity ? index_.capacity * 2 : 1024;
+        BkNode *nodes = realloc(index_.nodes, capacity * sizeof(BkNode));
+        if (!nodes) return false;
+        index_.nodes = nodes;
+        index_.capacity = capacity;
+    }
+    if (index_.pool_length + length + 1 > index_.pool_capacity) {
+        size_t capacity = index_.pool_capacity ? index_.pool_capacity * 2 : 16384;
+        while (index_.pool_length + length + 1 > capacity) capacity *= 2;
+        char *pool = realloc(index_.pool, capacity);
+        if (!pool) return false;
+        index_.pool = pool;
+        index_.pool_capacity = capacity;
+    }
+
+    // Walk down to where the name belongs; an exact match is a duplicate
+    // (a command shadowed by one earlier on PATH, or also a builtin)
+    Pattern pattern;
+    pattern_init(&pattern, name, length);
+    int parent = -1, edge = 0;
+    for (int node = index_.count ? 0 : -1; node >= 0;) {
+        BkNode *n = &index_.nodes[node];
+        int distance = bounded_distance(&pattern, node_name(n), n->length, INT_MAX - 1);
+        if (distance == 0) return true;
+
+        parent = node;
+        edge = distance;
+        int child = n->first_child;
+        while (child >= 0 && index_.nodes[child].edge != distance) child = index_.nodes[child].next_sibling;
+        node = child;
+    }
+
+    BkNode *added = &index_.nodes[index_.count];
+    added->name = index_.pool_length;
+    added->length = length;
+    added->edge = edge;
+    added->first_child = -1;
+    added->next_sibling = -1;
+    added->builtin = builtin;
+    if (parent >= 0) {
+        added->next_sibling = index_.nodes[parent].first_child;
+        index_.nodes[parent].first_child = index_.count;
+    }
+    memcpy(index_.pool + index_.pool_length, name, length + 1);
+    index_.pool_length += length + 1;
+    index_.count++;
+    return true;
+}
+
+static void index_dir(const char *dir, int i) {
+    dir_mtime(dir, &index_.mtimes[i]);
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(d))) {
+        if (entry->d_name[0] == '.') continue;
+        // d_type saves a stat for most entries; symlinks and unknowns
+        // need one to tell files from directories
+        if (entry->d_type == DT_DIR) continue;
+        struct stat st;
+        if (entry->d_type != DT_REG &&
+            (fstatat(dirfd(d), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))) {
+            continue;
         }
+        if (faccessat(dirfd(d), entry->d_name, X_OK, 0) != 0) continue;
+        if (!add_name(entry->d_name, false)) break;
     }
-    
-    return matrix[len1][len2];
+    closedir(d);
 }
 
-void suggest_command(const char *input) {
-    if (!input || strlen(input) == 0) return;
-    
-    const char *best_match = NULL;
-    int min_distance = INT_MAX;
-    
-    // Find the command with minimum Levenshtein distance
-    for (int i = 0; COMMON_COMMANDS[i] != NULL; i++) {
-        int distance = levenshtein_distance(input, COMMON_COMMANDS[i]);
-        if (distance < min_distance && distance <= 3) {  // Only suggest if distance ≤ 3
-            min_distance = distance;
-            best_match = COMMON_COMMANDS[i];
+static void count_dir(const char *dir, int i) {
+    (void)dir;
+    index_.dir_count = i + 1;
+}
+
+// Build the index when PATH or any of its directories changed since the
+// last build. Builtins go in first, so they win over executables of the
+// same name.
+static bool refresh_index(void) {
+    const char *path_env = getenv("PATH");
+    if (!path_env) path_env = "";
+    if (index_current(path_env)) return true;
+
+    free_index();
+    index_.path_env = strdup(path_env);
+    for_each_path_dir(path_env, count_dir);
+    index_.mtimes = calloc(index_.dir_count, sizeof(struct timespec));
+    if (!index_.path_env || !index_.mtimes) {
+        free_index();
+        return false;
+    }
+
+    for (int i = 0; i < builtin_count(); i++) {
+        add_name(builtin_at(i)->name, true);
+    }
+    for_each_path_dir(path_env, index_dir);
+    return true;
+}
+
+// Edits tolerated for an input of this length: one in a two-letter
+// command is already half of it
+static int max_edits(int length) {
+    if (length <= 2) return 1;
+    if (length <= 5) return 2;
+    return 3;
+}
+
+// Edits counting a swap of neighbours as one (optimal string alignment),
+// which is how typing goes wrong. It breaks the triangle inequality the
+// BK-tree relies on, so it only rescores the few candidates found.
+static int typo_distance(const char *a, const char *b) {
+    int la = strlen(a), lb = strlen(b);
+    int *rows = malloc(3 * (lb + 1) * sizeof(int));
+    if (!rows) return la > lb ? la : lb;
+    int *before = rows, *previous = rows + lb + 1, *current = rows + 2 * (lb + 1);
+
+    for (int j = 0; j <= lb; j++) previous[j] = j;
+    for (int i = 1; i <= la; i++) {
+        current[0] = i;
+        for (int j = 1; j <= lb; j++) {
+            current[j] = MIN3(previous[j] + 1, current[j - 1] + 1,
+                              previous[j - 1] + (a[i - 1] != b[j - 1]));
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] &&
+                before[j - 2] + 1 < current[j]) {
+                current[j] = before[j - 2] + 1;
+            }
         }
+        int *oldest = before;
+        before = previous;
+        previous = current;
+        current = oldest;
     }
-    
+    int distance = previous[lb];
+    free(rows);
+    return distance;
+}
+
+// Between equally good candidates, prefer the one keeping the input's
+// first letter (typos rarely hit it), then a builtin
+static bool better_tie(const char *input, const BkNode *node, const BkNode *best) {
+    bool first = node_name(node)[0] == input[0];
+    bool best_first = node_name(best)[0] == input[0];
+    if (first != best_first) return first;
+    return node->builtin && !best->builtin;
+}
+
+// Closest known command to `input`, or NULL when none is within reach.
+// Candidates are ranked by typo_distance, less an eighth of an edit for
+// every doubling of the command's use count: a command the user runs all
+// the time beats a rare one at the same distance, and with hundreds of
+// runs can beat one an edit closer. NULL as well when `input` is itself a
+// known command: the failure was not a typo.
+const char *autocorrect_lookup(const char *input, int *distance_out) {
+    int length = strlen(input);
+    if (length == 0 || !refresh_index() || index_.count == 0) return NULL;
+
+    Pattern pattern;
+    pattern_init(&pattern, input, length);
+    int max = max_edits(length);
+
+    int *stack = malloc(index_.count * sizeof(int));
+    if (!stack) return NULL;
+    int top = 0;
+    stack[top++] = 0;
+
+    const BkNode *best = NULL;
+    double best_score = 0;
+    int best_distance = 0;
+    bool exact = false;
+    while (top > 0 && !exact) {
+        const BkNode *node = &index_.nodes[stack[--top]];
+        // Stopping at 2 * max still bounds the children to search: all
+        // of them lie beyond any edge below distance - max
+        int distance = bounded_distance(&pattern, node_name(node), node->length, 2 * max);
+        exact = distance == 0;
+
+        if (distance > 0 && distance <= max) {
+            double score = typo_distance(input, node_name(node)) -
+                           log2(1 + analytics_command_uses(node_name(node))) / 8;
+            if (!best || score < best_score ||
+                (score == best_score && better_tie(input, node, best))) {
+                best = node;
+                best_score = score;
+                best_distance = distance;
+            }
+        }
+
+        for (int child = node->first_child; child >= 0; child = index_.nodes[child].next_sibling) {
+            int edge = index_.nodes[child].edge;
+            if (edge >= distance - max && (distance > 2 * max || edge <= distance + max)) {
+                stack[top++] = child;
+            }
+        }
+    }
+    free(stack);
+
+    if (!best || exact) return NULL;
+    if (distance_out) *distance_out = best_distance;
+    return node_name(best);
+}
+
+// Commands the index currently holds (building it if needed)
+int autocorrect_index_size(void) {
+    return refresh_index() ? index_.count : 0;
+}
+
+void suggest_command(const char *input) {
+    if (!input || strlen(input) == 0) return;
+
+    const char *best_match = autocorrect_lookup(input, NULL);
     if (best_match) {
         printf(COLOR_GREEN "Did you mean '%s'? (y/n): " COLOR_RESET, best_match);
-        char response = getchar();
+        int response = getchar();
         // Clear input buffer
-        while (getchar() != '\n');
-        
+        for (int c = response; c != '\n' && c != EOF; c = getchar()) {}
+
         if (response == 'y' || response == 'Y') {
             // Show command usage hint
             printf("\n");
-            if (strcmp(best_match, "ls") == 0)
-                printf("Usage: ls [OPTION]... [FILE]... - list directory contents\n");
-            else if (strcmp(best_match, "cd") == 0)
-                printf("Usage: cd [dir] - change directory (empty for home)\n");
-            else if (strcmp(best_match, "pwd") == 0)
-                printf("Usage: pwd - print working directory\n");
-            else if (strcmp(best_match, "rm") == 0)
-                printf("Usage: rm <file> - remove file (moves to trash)\n");
-            else if (strcmp(best_match, "help") == 0)
-                printf("Usage: help - show available commands and features\n");
-            // Add more command hints as needed
+            const Builtin *builtin = find_builtin(best_match);
+            if (builtin)
+                printf("Usage: %s - %s\n", builtin->usage, builtin->summary);
+            else
+                printf("Try 'man %s' for usage information\n", best_match);
         }
     }
-} 
\ No newline at end of file
+}
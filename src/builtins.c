@@ -0,0 +1,633 @@
+#include "edushell.h"
+#include "analytics.h"
+#include "builtin_hash.h"
+
+static int builtin_cd(Command *cmd, ShellState *state);
+static int builtin_pwd(Command *cmd, ShellState *state);
+static int builtin_history(Command *cmd, ShellState *state);
+static int builtin_clear(Command *cmd, ShellState *state);
+static int builtin_hash(Command *cmd, ShellState *state);
+static int builtin_spawn(Command *cmd, ShellState *state);
+static int builtin_time(Command *cmd, ShellState *state);
+static int builtin_rm(Command *cmd, ShellState *state);
+static int builtin_restore(Command *cmd, ShellState *state);
+static int builtin_trash_list(Command *cmd, ShellState *state);
+static int builtin_sandbox(Command *cmd, ShellState *state);
+static int builtin_monitor(Command *cmd, ShellState *state);
+static int builtin_analytics(Command *cmd, ShellState *state);
+static int builtin_log(Command *cmd, ShellState *state);
+static int builtin_tutorial(Command *cmd, ShellState *state);
+static int builtin_help(Command *cmd, ShellState *state);
+static int builtin_exit(Command *cmd, ShellState *state);
+
+#define BUILTIN(name, handler, accepts, flags, usage, summary) \
+    {name, handler, accepts, flags, usage, summary},
+static const Builtin BUILTINS[] = {
+#include "builtins.def"
+};
+#undef BUILTIN
+
+#define BUILTIN_COUNT (int)(sizeof(BUILTINS) / sizeof(BUILTINS[0]))
+
+// Per-builtin call counts and time spent, for `analytics builtins`
+typedef struct {
+    long calls;
+    double total_time;
+    double max_time;
+} BuiltinStats;
+
+static BuiltinStats builtin_stats[BUILTIN_COUNT];
+
+// One probe of the generated perfect hash and a single strcmp, so external
+// commands don't pay for a walk over every builtin name.
+const Builtin *find_builtin(const char *name) {
+    uint32_t slot = builtin_name_hash(name, BUILTIN_HASH_SEED) & (BUILTIN_HASH_SIZE - 1);
+    int index = BUILTIN_HASH_SLOTS[slot];
+    if (index < 0 || strcmp(BUILTINS[index].name, name) != 0) return NULL;
+    return &BUILTINS[index];
+}
+
+const Builtin *builtin_at(int index) {
+    return index >= 0 && index < BUILTIN_COUNT ? &BUILTINS[index] : NULL;
+}
+
+int builtin_count(void) {
+    return BUILTIN_COUNT;
+}
+
+// True if handle_builtin would run this command itself
+bool is_builtin(const Command *cmd) {
+    if (cmd->arg_count == 0) return false;
+
+    const Builtin *builtin = find_builtin(cmd->args[0]);
+    return builtin && (!builtin->accepts || builtin->accepts(cmd));
+}
+
+bool run_builtin(Command *cmd, ShellState *state, int *status) {
+    if (!cmd || cmd->arg_count == 0 || !is_builtin(cmd)) return false;
+
+    const Builtin *builtin = find_builtin(cmd->args[0]);
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    int result = builtin->handler(cmd, state);
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double execution_time =
+        (end_time.tv_sec - start_time.tv_sec) +
+        (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+
+    log_command(builtin->name, LOG_BUILTIN, (result & 0xff) << 8, execution_time);
+
+    BuiltinStats *stats = &builtin_stats[builtin - BUILTINS];
+    stats->calls++;
+    stats->total_time += execution_time;
+    if (execution_time > stats->max_time) stats->max_time = execution_time;
+
+    if (state->analytics_enabled && !(builtin->flags & BUILTIN_PREFIX)) {
+        track_command_execution(builtin->name, execution_time, result != 0);
+        if (builtin->flags & BUILTIN_NO_FORK) {
+            track_fork_avoided();
+        }
+    }
+
+    if (status) *status = result;
+    return true;
+}
+
+// Run cmd if it is a builtin, leaving its exit status in *status (which
+// may be NULL). Returns false for anything that isn't a builtin.
+bool handle_builtin(Command *cmd, ShellState *state, int *status) {
+    return run_builtin(cmd, state, status);
+}
+
+void print_builtin_usage(const char *name) {
+    const Builtin *builtin = find_builtin(name);
+    if (builtin) {
+        printf("Usage: %s\n", builtin->usage);
+    }
+}
+
+void display_builtin_stats(void) {
+    printf("Builtin Usage:\n");
+    printf("%-12s %-8s %-14s %-14s\n", "Builtin", "Calls", "Avg Time", "Max Time");
+    printf("------------------------------------------------------------\n");
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        BuiltinStats *stats = &builtin_stats[i];
+        if (stats->calls == 0) continue;
+        printf("%-12s %-8ld %8.3f ms    %8.3f ms\n", BUILTINS[i].name, stats->calls,
+               1000.0 * stats->total_time / stats->calls, 1000.0 * stats->max_time);
+    }
+}
+
+static int builtin_cd(Command *cmd, ShellState *state) {
+    (void)state;
+    if (cmd->arg_count < 2) {
+        // Change to home directory if no argument
+        return chdir(getenv("HOME")) == 0 ? 0 : 1;
+    }
+    if (chdir(cmd->args[1]) != 0) {
+        handle_error("Could not change directory");
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_pwd(Command *cmd, ShellState *state) {
+    (void)cmd;
+    (void)state;
+    char cwd[MAX_PATH_LENGTH];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        handle_error("Could not get current directory");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+// Set of history lines already shown, for `history -u`
+typedef struct {
+    const char **lines;
+    uint64_t capacity;
+    uint64_t count;
+} LineSet;
+
+// Adds `line`; false if it was already there
+static bool line_set_add(LineSet *set, const char *line) {
+    if (set->count * 2 >= set->capacity) {
+        LineSet grown = {calloc(set->capacity ? set->capacity * 2 : 256, sizeof(char *)),
+                         set->capacity ? set->capacity * 2 : 256, 0};
+        if (!grown.lines) return true;
+        for (uint64_t i = 0; i < set->capacity; i++) {
+            if (set->lines[i]) line_set_add(&grown, set->lines[i]);
+        }
+        free(set->lines);
+        *set = grown;
+    }
+    uint64_t slot = event_checksum(line, strlen(line)) & (set->capacity - 1);
+    while (set->lines[slot]) {
+        if (strcmp(set->lines[slot], line) == 0) return false;
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->lines[slot] = line;
+    set->count++;
+    return true;
+}
+
+static int builtin_history(Command *cmd, ShellState *state) {
+    (void)state;
+    history_refresh();
+    uint64_t count = history_count();
+    uint64_t from = 0, to = count, limit = HISTORY_SIZE;
+    bool unique = false;
+    const char *prefix = NULL;
+
+    for (int i = 1; i < cmd->arg_count; i++) {
+        const char *arg = cmd->args[i];
+        unsigned long long first, last;
+        int used = 0;
+        if (strcmp(arg, "-u") == 0) {
+            unique = true;
+        } else if (sscanf(arg, "%llu-%llu%n", &first, &last, &used) == 2 && arg[used] == '\0' &&
+                   first >= 1 && first <= last) {
+            // Entry numbers as listed, both ends included
+            from = first - 1;
+            to = last < count ? last : count;
+            limit = UINT64_MAX;
+        } else if (sscanf(arg, "%llu%n", &first, &used) == 1 && arg[used] == '\0') {
+            limit = first;
+        } else if (!prefix && arg[0] != '-') {
+            prefix = arg;
+        } else {
+            print_builtin_usage("history");
+            return 1;
+        }
+    }
+
+    // Walk back from the newest line, then print oldest first
+    uint64_t *shown = malloc((limit < count ? limit : count) * sizeof(uint64_t) + 1);
+    LineSet seen = {0};
+    uint64_t shown_count = 0;
+    int64_t at = to;
+    while (shown && shown_count < limit) {
+        at = prefix ? history_find(prefix, at, true) : at - 1;
+        if (at < (int64_t)from) break;
+        if (!unique || line_set_add(&seen, history_entry(at))) shown[shown_count++] = at;
+    }
+    for (uint64_t i = shown_count; i-- > 0;) {
+        printf("%5llu  %s\n", (unsigned long long)shown[i] + 1, history_entry(shown[i]));
+    }
+    free(seen.lines);
+    free(shown);
+    return 0;
+}
+
+static int builtin_clear(Command *cmd, ShellState *state) {
+    (void)cmd;
+    (void)state;
+    printf("\033[H\033[J");  // ANSI escape sequence to clear screen
+    return 0;
+}
+
+static int builtin_hash(Command *cmd, ShellState *state) {
+    (void)state;
+    if (cmd->arg_count > 1 && strcmp(cmd->args[1], "-r") == 0) {
+        hash_reset();
+    } else if (cmd->arg_count > 1) {
+        print_builtin_usage("hash");
+        return 1;
+    } else {
+        hash_list();
+    }
+    return 0;
+}
+
+static int builtin_spawn(Command *cmd, ShellState *state) {
+    if (cmd->arg_count < 2) {
+        display_spawn_stats(state);
+    } else if (strcmp(cmd->args[1], "posix") == 0) {
+        state->spawn_mode = SPAWN_POSIX;
+        printf("Using posix_spawn to launch commands\n");
+    } else if (strcmp(cmd->args[1], "fork") == 0) {
+        state->spawn_mode = SPAWN_FORK;
+        printf("Using fork to launch commands\n");
+    } else if (strcmp(cmd->args[1], "trace") == 0 && cmd->arg_count > 2) {
+        state->spawn_trace = strcmp(cmd->args[2], "on") == 0;
+        printf("Spawn latency trace %s\n", state->spawn_trace ? "enabled" : "disabled");
+    } else {
+        print_builtin_usage("spawn");
+        return 1;
+    }
+    return 0;
+}
+
+static double seconds_between(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int builtin_time(Command *cmd, ShellState *state) {
+    if (cmd->arg_count < 2) {
+        print_builtin_usage("time");
+        return 1;
+    }
+
+    // The timed command is this one without its first word
+    Command timed = *cmd;
+    memmove(timed.args, cmd->args + 1, cmd->arg_count * sizeof(char *));
+    timed.arg_count = cmd->arg_count - 1;
+
+    CommandUsage usage;
+    struct timespec start_time, end_time;
+    int status;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    if (is_builtin(&timed)) {
+        // Runs in the shell: charge it the difference in our own rusage
+        struct rusage before, after;
+        getrusage(RUSAGE_SELF, &before);
+        run_builtin(&timed, state, &status);
+        getrusage(RUSAGE_SELF, &after);
+
+        CommandUsage start_usage;
+        usage_from_rusage(&start_usage, &before);
+        usage_from_rusage(&usage, &after);
+        usage.user_time -= start_usage.user_time;
+        usage.sys_time -= start_usage.sys_time;
+        usage.major_faults -= start_usage.major_faults;
+        usage.minor_faults -= start_usage.minor_faults;
+        usage.voluntary_switches -= start_usage.voluntary_switches;
+        usage.involuntary_switches -= start_usage.involuntary_switches;
+        usage.read_bytes = usage.write_bytes = 0;
+    } else {
+        status = execute_command_usage(&timed, state, &usage);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double real_time = seconds_between(&start_time, &end_time);
+    // A timed builtin was recorded by run_builtin, and a background
+    // command is recorded by the job table when it finishes
+    if (!is_builtin(&timed) && !timed.is_background && state->analytics_enabled) {
+        track_command_execution(timed.args[0], real_time, status != 0);
+    }
+
+    if (timed.is_background) return status;
+
+    fprintf(stderr, "\nreal     %.3fs\n", real_time);
+    fprintf(stderr, "user     %.3fs\n", usage.user_time);
+    fprintf(stderr, "sys      %.3fs\n", usage.sys_time);
+    fprintf(stderr, "max RSS  %ld KB%s\n", usage.max_rss_kb,
+            is_builtin(&timed) ? " (the shell's)" : "");
+    fprintf(stderr, "faults   %ld major, %ld minor\n", usage.major_faults, usage.minor_faults);
+    fprintf(stderr, "switches %ld voluntary, %ld involuntary\n",
+            usage.voluntary_switches, usage.involuntary_switches);
+    if (!is_builtin(&timed)) {
+        fprintf(stderr, "I/O      %llu bytes read, %llu written\n",
+                usage.read_bytes, usage.write_bytes);
+    }
+    return status;
+}
+
+static int builtin_rm(Command *cmd, ShellState *state) {
+    if (cmd->arg_count < 2) {
+        print_builtin_usage("rm");
+        return 1;
+    }
+
+    // Move file to trash instead of deleting
+    if (!move_to_trash(cmd->args[1], state)) {
+        handle_error("Failed to move file to trash");
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_restore(Command *cmd, ShellState *state) {
+    if (cmd->arg_count < 2) {
+        print_builtin_usage("restore");
+        return 1;
+    }
+
+    if (!restore_from_trash(cmd->args[1], state)) {
+        handle_error("Failed to restore file");
+        return 1;
+    }
+    return 0;
+}
+
+static int builtin_trash_list(Command *cmd, ShellState *state) {
+    (void)cmd;
+    if (state->trash_count == 0) {
+        printf("Trash is empty\n");
+        return 0;
+    }
+
+    printf("Files in trash:\n");
+    printf("%-40s %-30s\n", "Original Path", "Deletion Time");
+    printf("---------------------------------------- ------------------------------\n");
+
+    DeletedFile *current = state->trash_list;
+    while (current) {
+        char time_str[30];
+        struct tm *tm_info = localtime(&current->deletion_time);
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
+        printf("%-40s %-30s\n", current->original_path, time_str);
+        current = current->next;
+    }
+    return 0;
+}
+
+static int builtin_sandbox(Command *cmd, ShellState *state) {
+    if (cmd->arg_count < 2) {
+        print_builtin_usage("sandbox");
+        return 1;
+    }
+
+    if (strcmp(cmd->args[1], "on") == 0) {
+        if (geteuid() != 0) {
+            printf("Sandbox mode requires root privileges\n");
+            return 1;
+        }
+
+        if (state->sandbox_enabled) {
+            printf("Sandbox is already enabled\n");
+            return 0;
+        }
+
+        // Create sandbox environment path
+        snprintf(state->sandbox_root, MAX_PATH_LENGTH,
+                "%s/.edushell_sandbox", getenv("HOME"));
+
+        // Create sandbox environment first
+        if (!create_sandbox_env(state->sandbox_root)) {
+            printf("Failed to create sandbox environment\n");
+            return 1;
+        }
+
+        // Setup namespaces (this will fork)
+        pid_t child_pid = setup_sandbox();
+        if (child_pid == -1) {
+            printf("Failed to setup sandbox namespaces\n");
+            return 1;
+        }
+
+        if (child_pid > 0) {
+            // Parent process - wait for child to exit
+            int status;
+            waitpid(child_pid, &status, 0);
+            return 0;
+        }
+
+        // We are now in the child process (PID 1 in new namespace)
+
+        // Change root to sandbox environment
+        if (chroot(state->sandbox_root) != 0) {
+            handle_error("Failed to change root to sandbox");
+            _exit(1);
+        }
+
+        // Change to home directory inside sandbox
+        if (chdir("/home/user") != 0) {
+            handle_error("Failed to change directory in sandbox");
+            _exit(1);
+        }
+
+        //Now mount proc inside the new root
+        if (mount("proc", "/proc", "proc", 0, NULL) != 0) {
+            handle_error("Failed to mount proc filesystem");
+            _exit(1);
+        }
+
+        snprintf(state->trash_dir, MAX_PATH_LENGTH, "/home/user/.edushell_trash");
+
+        // Paths remembered outside the chroot no longer apply
+        hash_reset();
+
+        state->sandbox_enabled = true;
+        printf("Sandbox mode enabled\n");
+        shell_loop(state);
+        _exit(0);
+    } else if (strcmp(cmd->args[1], "off") == 0) {
+        if (state->sandbox_enabled) {
+            //cannot exit chroot once entered.
+            printf("Cannot disable sandbox once enabled. Please start a new shell.\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Samples are taken by a background thread, so they keep coming while a
+// long command runs; the prompt only collects them
+static bool start_monitor(ShellState *state, double period) {
+    if (!sampler_thread_start(period)) {
+        handle_error("Could not start the resource sampler");
+        return false;
+    }
+    state->monitor_mode = true;
+    return true;
+}
+
+static int builtin_monitor(Command *cmd, ShellState *state) {
+    if (cmd->arg_count < 2) {
+        print_builtin_usage("monitor");
+        return 1;
+    }
+
+    if (strcmp(cmd->args[1], "on") == 0) {
+        if (!start_monitor(state, 0)) return 1;
+        printf("Resource monitoring enabled\n");
+    } else if (strcmp(cmd->args[1], "off") == 0) {
+        sampler_thread_stop();
+        hide_resource_graphs();
+        state->monitor_mode = false;
+        printf("Resource monitoring disabled\n");
+    } else if (strcmp(cmd->args[1], "minute") == 0 || strcmp(cmd->args[1], "hour") == 0 ||
+               strcmp(cmd->args[1], "day") == 0) {
+        set_monitor_window(cmd->args[1][0] == 'm' ? 60 : cmd->args[1][0] == 'h' ? 3600 : 86400);
+        if (!start_monitor(state, 0)) return 1;
+        printf("Resource monitoring enabled, summarizing the last %s\n", cmd->args[1]);
+    } else if (strcmp(cmd->args[1], "interval") == 0 && cmd->arg_count > 2) {
+        double period = atof(cmd->args[2]);
+        if (period < 0.05 || period > 3600) {
+            printf("Interval must be between 0.05 and 3600 seconds\n");
+            return 1;
+        }
+        if (!start_monitor(state, period)) return 1;
+        printf("Resource monitoring enabled, sampling every %g seconds\n", period);
+    } else {
+        print_builtin_usage("monitor");
+        return 1;
+    }
+    return 0;
+}
+
+// analytics export socket|file PATH, off, or status with no argument
+static bool analytics_export(Command *cmd) {
+    const char *what = cmd->arg_count > 2 ? cmd->args[2] : "status";
+
+    if (strcmp(what, "status") == 0) {
+        ExporterMode mode = exporter_mode();
+        if (mode == EXPORTER_OFF) printf("Metrics exporter is off\n");
+        else printf("Serving OpenMetrics %s %s\n", mode == EXPORTER_SOCKET ? "on socket" : "in file",
+                    exporter_path());
+    } else if (strcmp(what, "off") == 0) {
+        exporter_stop();
+        printf("Metrics exporter stopped\n");
+    } else if ((strcmp(what, "socket") == 0 || strcmp(what, "file") == 0) && cmd->arg_count > 3) {
+        ExporterMode mode = what[0] == 's' ? EXPORTER_SOCKET : EXPORTER_TEXTFILE;
+        if (!exporter_start(mode, cmd->args[3])) {
+            handle_error("analytics export");
+            return false;
+        }
+        printf("Serving OpenMetrics %s %s\n", mode == EXPORTER_SOCKET ? "on socket" : "in file",
+               cmd->args[3]);
+    } else {
+        print_builtin_usage("analytics");
+        return false;
+    }
+    return true;
+}
+
+static int builtin_analytics(Command *cmd, ShellState *state) {
+    if (cmd->arg_count < 2) {
+        print_builtin_usage("analytics");
+        return 1;
+    }
+
+    if (strcmp(cmd->args[1], "show") == 0) {
+        display_learning_dashboard();
+    } else if (strcmp(cmd->args[1], "top") == 0) {
+        if (!display_command_costs(cmd->arg_count > 2 ? cmd->args[2] : "cpu")) {
+            print_builtin_usage("analytics");
+            return 1;
+        }
+    } else if (strcmp(cmd->args[1], "query") == 0) {
+        if (!analytics_query(cmd->args + 2, cmd->arg_count - 2)) return 1;
+    } else if (strcmp(cmd->args[1], "export") == 0) {
+        if (!analytics_export(cmd)) return 1;
+    } else if (strcmp(cmd->args[1], "builtins") == 0) {
+        display_builtin_stats();
+    } else if (strcmp(cmd->args[1], "on") == 0) {
+        state->analytics_enabled = true;
+        printf("Learning analytics enabled\n");
+    } else if (strcmp(cmd->args[1], "off") == 0) {
+        state->analytics_enabled = false;
+        printf("Learning analytics disabled\n");
+    }
+    return 0;
+}
+
+// Bytes with an optional K, M or G suffix; 0 if malformed
+static long long parse_size(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    long long unit = 1;
+    if (*end == 'K' || *end == 'k') unit = 1LL << 10;
+    else if (*end == 'M' || *end == 'm') unit = 1LL << 20;
+    else if (*end == 'G' || *end == 'g') unit = 1LL << 30;
+    if (unit > 1) end++;
+    if (end == text || *end || value <= 0) return 0;
+    return (long long)(value * unit);
+}
+
+static int builtin_log(Command *cmd, ShellState *state) {
+    (void)state;
+    if (cmd->arg_count < 2 || strcmp(cmd->args[1], "status") == 0) {
+        display_log_status();
+        return 0;
+    }
+
+    if (strcmp(cmd->args[1], "fsync") == 0 && cmd->arg_count == 3) {
+        const char *policy = cmd->args[2];
+        double seconds = atof(policy);
+        if (strcmp(policy, "never") == 0) {
+            logger_set_fsync(LOG_FSYNC_NEVER, 0);
+        } else if (strcmp(policy, "batch") == 0) {
+            logger_set_fsync(LOG_FSYNC_BATCH, 0);
+        } else if (seconds > 0) {
+            logger_set_fsync(LOG_FSYNC_INTERVAL, seconds);
+        } else {
+            print_builtin_usage("log");
+            return 1;
+        }
+    } else if (strcmp(cmd->args[1], "rotate") == 0 && (cmd->arg_count == 3 || cmd->arg_count == 4)) {
+        long long bytes = parse_size(cmd->args[2]);
+        int keep = cmd->arg_count == 4 ? atoi(cmd->args[3]) : LOG_KEEP_DEFAULT;
+        if (bytes < 4096 || keep < 0 || keep > 99) {
+            printf("Rotation size must be at least 4K and segments kept between 0 and 99\n");
+            return 1;
+        }
+        logger_set_rotation(bytes, keep);
+    } else {
+        print_builtin_usage("log");
+        return 1;
+    }
+    display_log_status();
+    return 0;
+}
+
+static int builtin_tutorial(Command *cmd, ShellState *state) {
+    (void)cmd;
+    start_tutorial(state);
+    return 0;
+}
+
+static int builtin_help(Command *cmd, ShellState *state) {
+    (void)cmd;
+    (void)state;
+    printf("EduShell - Available Commands:\n\n");
+    printf("Built-in commands:\n");
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        printf("  %-34s - %s\n", BUILTINS[i].usage, BUILTINS[i].summary);
+    }
+    printf("\nAny other command (ls, echo, grep, ...) is looked up in PATH.\n");
+    return 0;
+}
+
+static int builtin_exit(Command *cmd, ShellState *state) {
+    (void)cmd;
+    // run_builtin never gets to log this one; the writer still runs here
+    log_command("exit", LOG_BUILTIN, 0, 0);
+    cleanup_shell(state);
+    exit(0);
+}
@@ -0,0 +1,217 @@
+#include "edushell.h"
+#include <sys/stat.h>
+
+#define CMDHASH_BUCKETS 64
+
+// One remembered command -> path resolution (like bash's `hash`)
+typedef struct HashEntry {
+    char *name;
+    char *path;
+    int dir_index;       // PATH directory the command was found in
+    int hits;
+    struct HashEntry *next;
+} HashEntry;
+
+// Snapshot of PATH the table was built against
+typedef struct {
+    char *path_env;
+    char **dirs;
+    struct timespec *mtimes;
+    int dir_count;
+} PathSnapshot;
+
+static HashEntry *buckets[CMDHASH_BUCKETS];
+static PathSnapshot snapshot;
+static int entry_count = 0;
+
+static unsigned int hash_name(const char *name) {
+    unsigned int h = 2166136261u;  // FNV-1a
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h % CMDHASH_BUCKETS;
+}
+
+static void free_entries(void) {
+    for (int i = 0; i < CMDHASH_BUCKETS; i++) {
+        HashEntry *e = buckets[i];
+        while (e) {
+            HashEntry *next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+        buckets[i] = NULL;
+    }
+    entry_count = 0;
+}
+
+static void free_snapshot(void) {
+    for (int i = 0; i < snapshot.dir_count; i++) {
+        free(snapshot.dirs[i]);
+    }
+    free(snapshot.dirs);
+    free(snapshot.mtimes);
+    free(snapshot.path_env);
+    memset(&snapshot, 0, sizeof(snapshot));
+}
+
+static void stat_mtime(const char *dir, struct timespec *mtime) {
+    struct stat st;
+    if (stat(dir, &st) == 0) {
+        *mtime = st.st_mtim;
+    } else {
+        mtime->tv_sec = 0;
+        mtime->tv_nsec = 0;
+    }
+}
+
+// Split PATH once and remember each directory's mtime. `path_env` may be
+// the old snapshot's own copy, so it's duplicated before that is freed.
+static void take_snapshot(const char *path_env) {
+    char *copy = strdup(path_env);
+    free_snapshot();
+    snapshot.path_env = copy;
+
+    int count = 1;
+    for (const char *p = copy ? copy : ""; *p; p++) {
+        if (*p == ':') count++;
+    }
+    snapshot.dirs = calloc(count, sizeof(char *));
+    snapshot.mtimes = calloc(count, sizeof(struct timespec));
+    if (!snapshot.path_env || !snapshot.dirs || !snapshot.mtimes) {
+        free_snapshot();
+        return;
+    }
+
+    const char *start = snapshot.path_env;
+    while (1) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        // An empty PATH element means the current directory
+        char *dir = len ? strndup(start, len) : strdup(".");
+        if (!dir) break;
+        stat_mtime(dir, &snapshot.mtimes[snapshot.dir_count]);
+        snapshot.dirs[snapshot.dir_count++] = dir;
+        if (!end) break;
+        start = end + 1;
+    }
+}
+
+// Flush the table if PATH itself changed since it was built
+static void check_path_env(void) {
+    const char *path_env = getenv("PATH");
+    if (!path_env) path_env = "";
+
+    if (!snapshot.path_env || strcmp(snapshot.path_env, path_env) != 0) {
+        free_entries();
+        take_snapshot(path_env);
+    }
+}
+
+// A hit in directory i is stale if that directory lost the file or an
+// earlier directory gained one that now shadows it; both bump an mtime.
+static bool dirs_unchanged(int up_to) {
+    for (int i = 0; i <= up_to && i < snapshot.dir_count; i++) {
+        struct timespec now;
+        stat_mtime(snapshot.dirs[i], &now);
+        if (now.tv_sec != snapshot.mtimes[i].tv_sec ||
+            now.tv_nsec != snapshot.mtimes[i].tv_nsec) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static HashEntry *find_entry(const char *name) {
+    for (HashEntry *e = buckets[hash_name(name)]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0) return e;
+    }
+    return NULL;
+}
+
+static void add_entry(const char *name, const char *path, int dir_index) {
+    HashEntry *e = malloc(sizeof(HashEntry));
+    if (!e) return;
+    e->name = strdup(name);
+    e->path = strdup(path);
+    if (!e->name || !e->path) {
+        free(e->name);
+        free(e->path);
+        free(e);
+        return;
+    }
+    e->dir_index = dir_index;
+    e->hits = 0;
+
+    unsigned int b = hash_name(name);
+    e->next = buckets[b];
+    buckets[b] = e;
+    entry_count++;
+}
+
+// Resolve a command name to an executable path, consulting the hash table
+// first and only walking PATH on a miss.
+bool find_command_path(const char *cmd, char *path_buf, size_t buf_size) {
+    if (!cmd || !*cmd) return false;
+
+    // Names with a slash are never looked up in PATH
+    if (strchr(cmd, '/')) {
+        if (access(cmd, X_OK) != 0) return false;
+        snprintf(path_buf, buf_size, "%s", cmd);
+        return true;
+    }
+
+    check_path_env();
+
+    HashEntry *e = find_entry(cmd);
+    if (e) {
+        if (dirs_unchanged(e->dir_index)) {
+            e->hits++;
+            snprintf(path_buf, buf_size, "%s", e->path);
+            return true;
+        }
+        // Some PATH directory changed; forget everything and rescan
+        free_entries();
+        take_snapshot(snapshot.path_env ? snapshot.path_env : "");
+    }
+
+    for (int i = 0; i < snapshot.dir_count; i++) {
+        int len = snprintf(path_buf, buf_size, "%s/%s", snapshot.dirs[i], cmd);
+        if (len < 0 || (size_t)len >= buf_size) continue;
+
+        struct stat st;
+        if (access(path_buf, X_OK) == 0 && stat(path_buf, &st) == 0 &&
+            S_ISREG(st.st_mode)) {
+            // Relative PATH entries depend on the cwd, so don't remember them
+            if (snapshot.dirs[i][0] == '/') {
+                add_entry(cmd, path_buf, i);
+                HashEntry *added = find_entry(cmd);
+                if (added) added->hits++;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void hash_reset(void) {
+    free_entries();
+    free_snapshot();
+}
+
+void hash_list(void) {
+    if (entry_count == 0) {
+        printf("hash: hash table empty\n");
+        return;
+    }
+
+    printf("%-6s %-20s %s\n", "hits", "command", "path");
+    for (int i = 0; i < CMDHASH_BUCKETS; i++) {
+        for (HashEntry *e = buckets[i]; e; e = e->next) {
+            printf("%-6d %-20s %s\n", e->hits, e->name, e->path);
+        }
+    }
+}
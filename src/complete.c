@@ -0,0 +1,427 @@
+#include "edushell.h"
+#include <dirent.h>
+#include <limits.h>
+
+#define TRIE_PRESENT 1   // a name ends here and was in the latest listing
+#define TRIE_DIR 2       // ...and it is a directory (per d_type)
+#define TRIE_CHECK 4     // ...or may be one: d_type couldn't tell (symlink, unknown)
+
+// Byte-wise prefix trie in one array. Siblings are kept in byte order so
+// walks come out sorted, and every node counts the names below it, so the
+// number of completions of a prefix is a single lookup.
+typedef struct {
+    int32_t first_child;
+    int32_t next_sibling;
+    uint32_t count;        // present names in this subtree
+    uint32_t generation;   // listing pass that last saw the name ending here
+    unsigned char byte;
+    uint8_t flags;
+} TrieNode;
+
+typedef struct {
+    TrieNode *nodes;
+    int count;
+    int capacity;
+} Trie;
+
+// A directory's names as of its mtime. A changed mtime relists it into
+// the same trie: names seen again keep their nodes, new ones are added and
+// ones not seen in the new pass are swept out, so nothing is rebuilt.
+typedef struct {
+    char *path;
+    bool executables;      // only regular files the user may run (PATH)
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    uint32_t generation;
+    unsigned long last_used;
+    bool pinned;           // in use by the completion being built; not evicted
+    Trie trie;
+} DirListing;
+
+static DirListing listings[COMPLETION_CACHE_SIZE];
+static unsigned long use_clock;
+static Trie builtin_trie;
+
+static int trie_node(Trie *trie, unsigned char byte) {
+    if (trie->count == trie->capacity) {
+        int capacity = trie->capacity ? trie->capacity * 2 : 1024;
+        TrieNode *nodes = realloc(trie->nodes, capacity * sizeof(TrieNode));
+        if (!nodes) return -1;
+        trie->nodes = nodes;
+        trie->capacity = capacity;
+    }
+    TrieNode *node = &trie->nodes[trie->count];
+    memset(node, 0, sizeof(*node));
+    node->first_child = node->next_sibling = -1;
+    node->byte = byte;
+    return trie->count++;
+}
+
+// Child of `parent` for `byte`, created in byte order when `create`
+static int trie_child(Trie *trie, int parent, unsigned char byte, bool create) {
+    int previous = -1;
+    int child = trie->nodes[parent].first_child;
+    while (child >= 0 && trie->nodes[child].byte < byte) {
+        previous = child;
+        child = trie->nodes[child].next_sibling;
+    }
+    if (child >= 0 && trie->nodes[child].byte == byte) return child;
+    if (!create) return -1;
+
+    int added = trie_node(trie, byte);
+    if (added < 0) return -1;
+    trie->nodes[added].next_sibling = child;
+    if (previous >= 0) trie->nodes[previous].next_sibling = added;
+    else trie->nodes[parent].first_child = added;
+    return added;
+}
+
+static bool trie_insert(Trie *trie, const char *name, uint32_t generation, uint8_t type) {
+    if (trie->count == 0 && trie_node(trie, 0) < 0) return false;
+
+    int path[NAME_MAX + 2];
+    int depth = 0, node = 0;
+    path[depth++] = 0;
+    for (const char *p = name; *p && depth <= NAME_MAX; p++) {
+        node = trie_child(trie, node, (unsigned char)*p, true);
+        if (node < 0) return false;
+        path[depth++] = node;
+    }
+
+    TrieNode *leaf = &trie->nodes[node];
+    bool added = !(leaf->flags & TRIE_PRESENT);
+    leaf->flags = TRIE_PRESENT | type;
+    leaf->generation = generation;
+    if (added) {
+        for (int i = 0; i < depth; i++) trie->nodes[path[i]].count++;
+    }
+    return true;
+}
+
+// Drop names the latest pass didn't see, recounting on the way back up
+static uint32_t trie_sweep(Trie *trie, int node, uint32_t generation) {
+    TrieNode *n = &trie->nodes[node];
+    if ((n->flags & TRIE_PRESENT) && n->generation != generation) n->flags = 0;
+
+    uint32_t count = (n->flags & TRIE_PRESENT) ? 1 : 0;
+    for (int child = n->first_child; child >= 0; child = trie->nodes[child].next_sibling) {
+        count += trie_sweep(trie, child, generation);
+    }
+    trie->nodes[node].count = count;
+    return count;
+}
+
+static int trie_find(const Trie *trie, const char *prefix) {
+    if (trie->count == 0) return -1;
+    int node = 0;
+    for (const char *p = prefix; *p && node >= 0; p++) {
+        node = trie_child((Trie *)trie, node, (unsigned char)*p, false);
+    }
+    return node;
+}
+
+// Hidden names only complete once the prefix starts with a dot
+static bool skipped(const Trie *trie, int node, int depth, bool hidden) {
+    return trie->nodes[node].count == 0 || (depth == 0 && !hidden && trie->nodes[node].byte == '.');
+}
+
+// Names under `node` (at `depth` bytes into the word): how many, and the
+// bytes all of them share past the prefix, appended to `common`
+static int trie_matches(const Trie *trie, int node, int depth, bool hidden, char *common, size_t size) {
+    int count = trie->nodes[node].count;
+    if (depth == 0 && !hidden) {
+        int dot = trie_child((Trie *)trie, 0, '.', false);
+        if (dot >= 0) count -= trie->nodes[dot].count;
+    }
+    if (count <= 0) return 0;
+
+    // Follow single paths until a name ends or the names branch
+    size_t length = strlen(common);
+    while (!(trie->nodes[node].flags & TRIE_PRESENT) && length + 1 < size) {
+        int only = -1, live = 0;
+        for (int c = trie->nodes[node].first_child; c >= 0; c = trie->nodes[c].next_sibling) {
+            if (skipped(trie, c, depth, hidden)) continue;
+            only = c;
+            live++;
+        }
+        if (live != 1) break;
+        node = only;
+        depth++;
+        common[length++] = trie->nodes[node].byte;
+    }
+    common[length] = '\0';
+    return count;
+}
+
+// Append the names under `node` to `out`, in order, up to `max` of them
+static void trie_collect(const Trie *trie, int node, int depth, bool hidden, char *name, int length,
+                         char **out, bool *dirs, int *found, int max) {
+    const TrieNode *n = &trie->nodes[node];
+    if ((n->flags & TRIE_PRESENT) && *found < max) {
+        name[length] = '\0';
+        out[*found] = strdup(name);
+        if (dirs) dirs[*found] = n->flags & TRIE_DIR;
+        if (out[*found]) (*found)++;
+    }
+    if (length >= NAME_MAX) return;
+    for (int c = n->first_child; c >= 0 && *found < max; c = trie->nodes[c].next_sibling) {
+        if (skipped(trie, c, depth, hidden)) continue;
+        name[length] = trie->nodes[c].byte;
+        trie_collect(trie, c, depth + 1, hidden, name, length + 1, out, dirs, found, max);
+    }
+}
+
+static void free_listing(DirListing *listing) {
+    free(listing->path);
+    free(listing->trie.nodes);
+    memset(listing, 0, sizeof(*listing));
+}
+
+static uint8_t entry_type(DIR *dir, const struct dirent *entry, bool executables, bool *keep) {
+    *keep = true;
+    if (!executables) {
+        if (entry->d_type == DT_DIR) return TRIE_DIR;
+        return entry->d_type == DT_REG ? 0 : TRIE_CHECK;
+    }
+
+    // PATH: regular files only, and only ones the user can run
+    struct stat st;
+    if (entry->d_type == DT_DIR ||
+        (entry->d_type != DT_REG &&
+         (fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))) ||
+        faccessat(dirfd(dir), entry->d_name, X_OK, 0) != 0) {
+        *keep = false;
+    }
+    return 0;
+}
+
+static void relist(DirListing *listing) {
+    DIR *dir = opendir(listing->path);
+    listing->generation++;
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            bool keep;
+            uint8_t type = entry_type(dir, entry, listing->executables, &keep);
+            if (keep && !trie_insert(&listing->trie, entry->d_name, listing->generation, type)) break;
+        }
+        closedir(dir);
+    }
+    if (listing->trie.count > 0) trie_sweep(&listing->trie, 0, listing->generation);
+}
+
+// The cached listing of `path`, relisted first if the directory changed.
+// A directory that can't be read lists as empty. NULL when every slot is
+// pinned.
+static DirListing *get_listing(const char *path, bool executables, const struct stat *st) {
+    DirListing *listing = NULL, *oldest = NULL;
+    for (int i = 0; i < COMPLETION_CACHE_SIZE; i++) {
+        DirListing *l = &listings[i];
+        if (l->path && l->executables == executables && strcmp(l->path, path) == 0) {
+            listing = l;
+            break;
+        }
+        if (l->pinned) continue;
+        if (!oldest || !l->path || (oldest->path && l->last_used < oldest->last_used)) oldest = l;
+    }
+
+    if (!listing) {
+        if (!oldest) return NULL;
+        listing = oldest;
+        free_listing(listing);
+        listing->path = strdup(path);
+        if (!listing->path) return NULL;
+        listing->executables = executables;
+        listing->mtime.tv_sec = -1;
+    }
+    listing->last_used = ++use_clock;
+
+    // A different directory now at the path starts over
+    if (st->st_dev != listing->dev || st->st_ino != listing->ino) {
+        free(listing->trie.nodes);
+        memset(&listing->trie, 0, sizeof(listing->trie));
+        listing->dev = st->st_dev;
+        listing->ino = st->st_ino;
+        listing->mtime.tv_sec = -1;
+    }
+    if (st->st_mtim.tv_sec != listing->mtime.tv_sec || st->st_mtim.tv_nsec != listing->mtime.tv_nsec) {
+        listing->mtime = st->st_mtim;
+        relist(listing);
+    }
+    return listing;
+}
+
+typedef struct {
+    const Trie *trie;
+    int node;
+} Source;
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Combine the matches of `prefix` from several tries into `out`. Names
+// are listed, sorted and deduplicated only when there are few enough to
+// show; the count is exact then, and an upper bound otherwise.
+static void merge_sources(const Source *sources, int source_count, const char *prefix, bool hidden,
+                          Completions *out) {
+    memset(out, 0, sizeof(*out));
+    char common[NAME_MAX + 1] = "", shared[NAME_MAX + 1];
+    bool first = true;
+    int total = 0;
+
+    for (int i = 0; i < source_count; i++) {
+        snprintf(shared, sizeof(shared), "%s", prefix);
+        int count = trie_matches(sources[i].trie, sources[i].node, strlen(prefix), hidden,
+                                 shared, sizeof(shared));
+        if (count == 0) continue;
+        total += count;
+        if (first) {
+            strcpy(common, shared);
+            first = false;
+        } else {
+            size_t n = 0;
+            while (common[n] && common[n] == shared[n]) n++;
+            common[n] = '\0';
+        }
+    }
+    out->count = total;
+    out->common = strdup(total ? common : prefix);
+    if (total == 0 || total > COMPLETION_LIST_MAX) return;
+
+    out->matches = malloc(total * sizeof(char *));
+    out->directories = calloc(total, sizeof(bool));
+    if (!out->matches || !out->directories) return;
+    char name[NAME_MAX + 1];
+    int found = 0;
+    for (int i = 0; i < source_count; i++) {
+        int length = snprintf(name, sizeof(name), "%s", prefix);
+        trie_collect(sources[i].trie, sources[i].node, length, hidden, name, length,
+                     out->matches, out->directories, &found, total);
+    }
+
+    if (source_count > 1) {
+        qsort(out->matches, found, sizeof(char *), compare_names);
+        int distinct = 0;
+        for (int i = 0; i < found; i++) {
+            if (distinct > 0 && strcmp(out->matches[i], out->matches[distinct - 1]) == 0) {
+                free(out->matches[i]);
+                continue;
+            }
+            out->matches[distinct++] = out->matches[i];
+        }
+        found = distinct;
+    }
+    out->count = found;
+}
+
+// Commands starting with `prefix`: builtins and everything runnable on PATH
+void complete_command(const char *prefix, Completions *out) {
+    if (builtin_trie.count == 0) {
+        for (int i = 0; i < builtin_count(); i++) {
+            trie_insert(&builtin_trie, builtin_at(i)->name, 1, 0);
+        }
+    }
+
+    Source sources[COMPLETION_CACHE_SIZE];
+    int source_count = 0;
+    int node = trie_find(&builtin_trie, prefix);
+    if (node >= 0) sources[source_count++] = (Source){&builtin_trie, node};
+
+    // The same directory twice (/bin -> /usr/bin) is listed once. PATH
+    // gets at most half the cache, and its listings are pinned until the
+    // merge so looking up a later directory can't evict an earlier one.
+    struct stat seen[COMPLETION_CACHE_SIZE / 2];
+    DirListing *used[COMPLETION_CACHE_SIZE / 2];
+    int seen_count = 0, used_count = 0;
+    char *path_env = strdup(getenv("PATH") ? getenv("PATH") : "");
+    char *save = NULL;
+    for (char *dir = path_env ? strtok_r(path_env, ":", &save) : NULL;
+         dir && seen_count < COMPLETION_CACHE_SIZE / 2; dir = strtok_r(NULL, ":", &save)) {
+        struct stat st;
+        if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+        bool duplicate = false;
+        for (int i = 0; i < seen_count; i++) {
+            if (seen[i].st_dev == st.st_dev && seen[i].st_ino == st.st_ino) duplicate = true;
+        }
+        if (duplicate) continue;
+        seen[seen_count++] = st;
+
+        DirListing *listing = get_listing(dir, true, &st);
+        if (!listing) continue;
+        listing->pinned = true;
+        used[used_count++] = listing;
+        node = trie_find(&listing->trie, prefix);
+        if (node >= 0) sources[source_count++] = (Source){&listing->trie, node};
+    }
+    free(path_env);
+
+    merge_sources(sources, source_count, prefix, true, out);
+    for (int i = 0; i < used_count; i++) used[i]->pinned = false;
+}
+
+// Files starting with `word`, which may name a directory to look in
+// ("src/ana", "~/Doc", "/etc/pa"). `common` and the directory flag cover
+// the whole word; `matches` hold just the names, as a listing shows them.
+void complete_path(const char *word, Completions *out) {
+    const char *slash = strrchr(word, '/');
+    const char *base = slash ? slash + 1 : word;
+    // Listings are cached by absolute path, so `cd` doesn't make "."
+    // a different directory under the same name
+    char dir[2 * PATH_MAX], cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) snprintf(cwd, sizeof(cwd), ".");
+    if (!slash) {
+        snprintf(dir, sizeof(dir), "%s", cwd);
+    } else if (word[0] == '~' && (word + 1 == slash || word[1] == '/')) {
+        snprintf(dir, sizeof(dir), "%s%.*s", getenv("HOME") ? getenv("HOME") : "",
+                 (int)(slash - word - 1), word + 1);
+    } else if (word[0] == '/') {
+        snprintf(dir, sizeof(dir), "%.*s", slash == word ? 1 : (int)(slash - word), word);
+    } else {
+        snprintf(dir, sizeof(dir), "%s/%.*s", cwd, (int)(slash - word), word);
+    }
+
+    struct stat st;
+    DirListing *listing = stat(dir, &st) == 0 && S_ISDIR(st.st_mode) ? get_listing(dir, false, &st) : NULL;
+    int node = listing ? trie_find(&listing->trie, base) : -1;
+    if (node < 0) {
+        memset(out, 0, sizeof(*out));
+        out->common = strdup(word);
+        return;
+    }
+
+    Source source = {&listing->trie, node};
+    merge_sources(&source, 1, base, base[0] == '.', out);
+
+    // Put the directory part back in front of the shared prefix
+    size_t dir_length = base - word;
+    char *common = malloc(dir_length + strlen(out->common) + 1);
+    if (common) {
+        memcpy(common, word, dir_length);
+        strcpy(common + dir_length, out->common);
+    }
+    free(out->common);
+    out->common = common;
+
+    // A lone match: is it a directory? d_type can't say for symlinks
+    int leaf = out->count == 1 && common ? trie_find(&listing->trie, common + dir_length) : -1;
+    if (leaf >= 0) {
+        uint8_t flags = listing->trie.nodes[leaf].flags;
+        char full[sizeof(dir) + NAME_MAX + 2];
+        snprintf(full, sizeof(full), "%s/%s", dir, common + dir_length);
+        out->directory = (flags & TRIE_DIR) ||
+                         ((flags & TRIE_CHECK) && stat(full, &st) == 0 && S_ISDIR(st.st_mode));
+    }
+}
+
+void completions_free(Completions *completions) {
+    if (completions->matches) {
+        for (int i = 0; i < completions->count; i++) free(completions->matches[i]);
+    }
+    free(completions->matches);
+    free(completions->directories);
+    free(completions->common);
+    memset(completions, 0, sizeof(*completions));
+}
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include "analytics.h"
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#define MAX_EVENTS 16
+#define MAX_WATCHED_PIDFDS 64
+
+// Everything the interactive prompt waits on: the terminal, the sampler
+// thread's "new samples" eventfd, SIGCHLD/SIGINT and the pidfds of
+// background jobs. With the monitor and the exporter off nothing but input
+// or a child can wake the shell.
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static sigset_t loop_signals;
+
+static bool watch(int fd) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0 || errno == EEXIST;
+}
+
+bool events_init(void) {
+    if (epoll_fd >= 0) return true;
+
+    sigemptyset(&loop_signals);
+    sigaddset(&loop_signals, SIGCHLD);
+    sigaddset(&loop_signals, SIGINT);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    signal_fd = signalfd(-1, &loop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd < 0 || signal_fd < 0 || !watch(STDIN_FILENO) || !watch(signal_fd)) {
+        events_cleanup();
+        return false;
+    }
+
+    // Delivered through signal_fd from now on; children get them back
+    // through reset_child_signals
+    sigprocmask(SIG_BLOCK, &loop_signals, NULL);
+    return true;
+}
+
+void events_cleanup(void) {
+    if (epoll_fd >= 0) {
+        sigprocmask(SIG_UNBLOCK, &loop_signals, NULL);
+    }
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (signal_fd >= 0) close(signal_fd);
+    epoll_fd = signal_fd = -1;
+}
+
+// The signal mask survives fork and exec; programs the shell starts must
+// not inherit the signals the event loop blocks
+void reset_child_signals(void) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
+// Throw away signals that arrived while a command ran in the foreground;
+// its own SIGINT already reached it
+static void drain_signals(void) {
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {}
+}
+
+static void redraw_monitor(int fd) {
+    uint64_t published;
+    if (read(fd, &published, sizeof(published)) != sizeof(published)) return;
+
+    // The frame saves and restores the cursor itself, so typing goes on
+    update_resource_usage();
+    display_resource_graphs();
+}
+
+static void print_prompt(void) {
+    printf(COLOR_GREEN SHELL_PROMPT COLOR_RESET);
+    fflush(stdout);
+}
+
+// Show the prompt and wait, handling events, until a line has been
+// edited and entered. NULL with *eof set when input ends.
+char *events_read_line(ShellState *state, bool *eof) {
+    *eof = false;
+    drain_signals();
+    print_prompt();
+    line_editor_start();
+
+    // Redraw whenever the sampler thread publishes; its eventfd leaves the
+    // epoll set by itself when the monitor is turned off and it is closed
+    int sample_fd = state->monitor_mode ? sampler_thread_fd() : -1;
+    if (sample_fd >= 0) watch(sample_fd);
+
+    // Watch the current background processes; closed pidfds drop out of
+    // the epoll set by themselves
+    int pidfds[MAX_WATCHED_PIDFDS];
+    int pidfd_count = jobs_pidfds(pidfds, MAX_WATCHED_PIDFDS);
+    for (int i = 0; i < pidfd_count; i++) {
+        watch(pidfds[i]);
+    }
+
+    for (;;) {
+        // A pasted chunk may still hold lines after the one just returned.
+        // A running exporter wakes the loop to keep its gauges current.
+        bool buffered = line_editor_buffered();
+        int timeout = exporter_mode() != EXPORTER_OFF ? EXPORT_REFRESH_INTERVAL * 1000 : -1;
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, buffered ? 0 : timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            handle_error("Event loop failed");
+            line_editor_stop();
+            return read_line(eof);
+        }
+
+        bool input = buffered, jobs_changed = false, interrupted = false;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == STDIN_FILENO) {
+                input = true;
+            } else if (fd == sample_fd) {
+                redraw_monitor(fd);
+            } else if (fd == signal_fd) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGINT) interrupted = true;
+                    else jobs_changed = true;
+                }
+            } else {
+                // A background process exited; its pidfd closes once reaped
+                jobs_changed = true;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            }
+        }
+
+        if (interrupted) {
+            // Ctrl-C at the prompt abandons the line, not the shell
+            line_editor_cancel();
+            printf("\n");
+            print_prompt();
+        }
+        if (jobs_changed && jobs_reap(state) > 0) {
+            printf("\n");
+            jobs_notify(state);
+            line_editor_refresh();
+        }
+        exporter_refresh();
+        if (input) {
+            char *line = line_editor_feed(eof);
+            if (line || *eof) line_editor_stop();
+            if (*eof) {
+                printf("\n");
+                return NULL;
+            }
+            if (line) return line;
+        }
+    }
+}
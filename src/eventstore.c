@@ -0,0 +1,326 @@
+#include "analytics.h"
+#include "edushell.h"
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define EVENT_LOG_MAGIC 0x31564545u  // "EEV1"
+#define EVENT_LOG_VERSION 2
+// Shells stamp events just before taking the log's lock, so records can be
+// slightly out of time order; time searches back off by this much
+#define EVENT_CLOCK_SLACK 300
+
+// The header fills one record so every record sits at a multiple of
+// EVENT_RECORD_SIZE
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    int64_t created;
+    uint64_t first_event;   // number of the first record; earlier ones were compacted away
+    uint8_t padding[EVENT_RECORD_SIZE - 32];
+} EventLogHeader;
+
+_Static_assert(sizeof(StoredEvent) == EVENT_RECORD_SIZE, "event records must be fixed-size");
+_Static_assert(sizeof(EventLogHeader) == EVENT_RECORD_SIZE, "the log header must fill a record");
+
+// FNV-1a taking 8 bytes per step: a scan of the log is bound by this, and
+// a bytewise hash costs eight times the multiplies
+uint32_t event_checksum(const void *data, size_t size) {
+    const unsigned char *p = data;
+    uint64_t h = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        h ^= word;
+        h *= 1099511628211ull;
+    }
+    for (; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static uint32_t record_checksum(const StoredEvent *event) {
+    return event_checksum((const char *)event + sizeof(event->checksum),
+                          EVENT_RECORD_SIZE - sizeof(event->checksum));
+}
+
+static bool record_valid(const StoredEvent *event) {
+    return event->type >= 1 && event->type <= EVENT_TYPE_MAX &&
+           event->checksum == record_checksum(event);
+}
+
+// Version 1 logs sealed records with a bytewise FNV-1a
+static uint32_t v1_checksum(const StoredEvent *event) {
+    const unsigned char *p = (const unsigned char *)event + sizeof(event->checksum);
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < EVENT_RECORD_SIZE - sizeof(event->checksum); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Reseal a version 1 log's records with the current checksum, in place,
+// then stamp the header. A record an interrupted upgrade already resealed
+// is left as it is, so the upgrade can simply run again.
+static bool upgrade_v1(int fd, EventLogHeader *header, off_t size) {
+    uint64_t count = (size - sizeof(*header)) / EVENT_RECORD_SIZE;
+    if (count > 0) {
+        size_t length = sizeof(*header) + count * EVENT_RECORD_SIZE;
+        char *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) return false;
+        StoredEvent *events = (StoredEvent *)(map + sizeof(*header));
+        for (uint64_t i = 0; i < count; i++) {
+            StoredEvent *event = &events[i];
+            if (!record_valid(event) && event->checksum == v1_checksum(event)) {
+                event->checksum = record_checksum(event);
+            }
+        }
+        bool synced = msync(map, length, MS_SYNC) == 0;
+        munmap(map, length);
+        if (!synced) return false;
+    }
+    header->version = EVENT_LOG_VERSION;
+    header->first_event = 0;
+    return pwrite(fd, header, sizeof(*header), 0) == sizeof(*header);
+}
+
+// Records are numbered from the start of the history, across compactions:
+// record `index` sits at its offset less the ones compacted away
+static uint64_t records_in(const EventStore *store, off_t size) {
+    if (size < (off_t)sizeof(EventLogHeader)) return store->first_event;
+    return store->first_event + (size - sizeof(EventLogHeader)) / EVENT_RECORD_SIZE;
+}
+
+static off_t record_offset(const EventStore *store, uint64_t index) {
+    return sizeof(EventLogHeader) + (off_t)(index - store->first_event) * EVENT_RECORD_SIZE;
+}
+
+// Switch to the file now at the log's path: the same log, but perhaps
+// compacted since this descriptor was opened
+static bool reopen_log(EventStore *store) {
+    int fd = open(store->path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    EventLogHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != EVENT_LOG_MAGIC || header.created != store->created) {
+        close(fd);
+        return false;
+    }
+    close(store->fd);
+    store->fd = fd;
+    store->owner = getpid();
+    store->first_event = header.first_event;
+    return true;
+}
+
+// flock() locks belong to the open file description, which a fork shares;
+// a child (a script worker, say) needs its own to lock against the parent
+static bool own_descriptor(EventStore *store) {
+    return store->owner == getpid() || reopen_log(store);
+}
+
+// Lock the log, following it if a compaction replaced the file while this
+// shell held the old one. Holds the lock on success.
+static bool lock_log(EventStore *store, int operation) {
+    for (;;) {
+        flock(store->fd, operation);
+        struct stat st;
+        if (fstat(store->fd, &st) != 0) {
+            flock(store->fd, LOCK_UN);
+            return false;
+        }
+        if (st.st_nlink > 0) return true;
+        flock(store->fd, LOCK_UN);
+        if (!reopen_log(store)) return false;
+    }
+}
+
+// Open or create the log. A torn header makes a fresh log; a partial record
+// left by a crash mid-append is cut off. A version 1 log is upgraded.
+bool event_store_open(EventStore *store, const char *path) {
+    memset(store, 0, sizeof(*store));
+    store->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (store->fd < 0) return false;
+    store->path = strdup(path);
+    store->owner = getpid();
+    flock(store->fd, LOCK_EX);
+
+    EventLogHeader header;
+    struct stat st;
+    bool ok = fstat(store->fd, &st) == 0;
+    if (ok && st.st_size < (off_t)sizeof(header)) {
+        memset(&header, 0, sizeof(header));
+        header.magic = EVENT_LOG_MAGIC;
+        header.version = EVENT_LOG_VERSION;
+        header.record_size = EVENT_RECORD_SIZE;
+        header.created = time(NULL);
+        header.first_event = 0;
+        ok = ftruncate(store->fd, 0) == 0 &&
+             pwrite(store->fd, &header, sizeof(header), 0) == sizeof(header);
+        st.st_size = sizeof(header);
+    } else if (ok) {
+        ok = pread(store->fd, &header, sizeof(header), 0) == sizeof(header) &&
+             header.magic == EVENT_LOG_MAGIC && header.record_size == EVENT_RECORD_SIZE;
+        if (ok && header.version == 1) ok = upgrade_v1(store->fd, &header, st.st_size);
+        ok = ok && header.version == EVENT_LOG_VERSION;
+    }
+
+    if (ok) {
+        store->created = header.created;
+        store->first_event = header.first_event;
+        store->event_count = records_in(store, st.st_size);
+        if (st.st_size != record_offset(store, store->event_count)) {
+            ok = ftruncate(store->fd, record_offset(store, store->event_count)) == 0;
+        }
+    }
+
+    flock(store->fd, LOCK_UN);
+    if (!ok) event_store_close(store);
+    return ok;
+}
+
+// Append one record, sealing it with its checksum. Appends from several
+// shells serialize on the lock; each lands on a record boundary even if a
+// crashed writer left half a record behind.
+bool event_store_append(EventStore *store, StoredEvent *event) {
+    if (store->fd < 0 || !own_descriptor(store)) return false;
+    event->checksum = record_checksum(event);
+
+    if (!lock_log(store, LOCK_EX)) return false;
+    struct stat st;
+    bool ok = fstat(store->fd, &st) == 0;
+    if (ok) {
+        off_t end = record_offset(store, records_in(store, st.st_size));
+        ok = pwrite(store->fd, event, EVENT_RECORD_SIZE, end) == EVENT_RECORD_SIZE;
+    }
+    flock(store->fd, LOCK_UN);
+    return ok;
+}
+
+// Pass every intact record with an index in [from, to) to the handler,
+// reading through a mapping of just that range. Returns the index the
+// range actually ended at: `to`, or the end of the log if that is sooner.
+// Records already compacted away are skipped.
+uint64_t event_store_replay_range(EventStore *store, uint64_t from, uint64_t to,
+                                  EventHandler handler, void *context) {
+    if (store->fd < 0 || !own_descriptor(store)) return from;
+
+    // Appenders hold the lock exclusively, so nothing read is half-written
+    if (!lock_log(store, LOCK_SH)) return from;
+    if (from < store->first_event) from = store->first_event;
+    struct stat st;
+    uint64_t count = fstat(store->fd, &st) == 0 ? records_in(store, st.st_size) : from;
+    if (count > to) count = to;
+    if (count <= from) {
+        flock(store->fd, LOCK_UN);
+        return count < from ? from : count;
+    }
+
+    off_t start = record_offset(store, from);
+    off_t map_start = start & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+    size_t length = record_offset(store, count) - map_start;
+    char *map = mmap(NULL, length, PROT_READ, MAP_SHARED, store->fd, map_start);
+    flock(store->fd, LOCK_UN);
+    if (map == MAP_FAILED) return from;
+    if (count - from > 1024) madvise(map, length, MADV_SEQUENTIAL);
+
+    const StoredEvent *events = (const StoredEvent *)(map + (start - map_start));
+    for (uint64_t i = 0; i < count - from; i++) {
+        // A record torn by a crash is skipped; the ones after it are fine
+        if (record_valid(&events[i])) handler(&events[i], context);
+    }
+
+    munmap(map, length);
+    if (count > store->event_count) store->event_count = count;
+    return count;
+}
+
+// Replay everything from `from` on; the result is where the next replay
+// should start
+uint64_t event_store_replay(EventStore *store, uint64_t from, EventHandler handler, void *context) {
+    return event_store_replay_range(store, from, UINT64_MAX, handler, context);
+}
+
+// Read record `index` whole; false past the end or for a torn record
+bool event_store_read(EventStore *store, uint64_t index, StoredEvent *event) {
+    if (store->fd < 0 || index < store->first_event) return false;
+    return pread(store->fd, event, EVENT_RECORD_SIZE, record_offset(store, index)) == EVENT_RECORD_SIZE &&
+           record_valid(event);
+}
+
+// First record that can be stamped `since` or later. Records are appended
+// in (nearly) time order, so a time window starts here instead of at the
+// beginning of the history.
+uint64_t event_store_find_time(EventStore *store, int64_t since) {
+    uint64_t low = store->first_event, high = store->event_count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        StoredEvent event;
+        // A torn record says nothing about time; treat it as old
+        if (!event_store_read(store, mid, &event) || event.timestamp < since - EVENT_CLOCK_SLACK) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Drop the records before `keep_from`, which a checkpoint must already
+// cover. The rest is copied to a new file that is renamed over the log;
+// other shells notice the old file was unlinked the next time they lock
+// it, and follow. Record numbers don't change.
+bool event_store_compact(EventStore *store, uint64_t keep_from) {
+    if (store->fd < 0 || !own_descriptor(store) || !lock_log(store, LOCK_EX)) return false;
+
+    struct stat st;
+    uint64_t count = fstat(store->fd, &st) == 0 ? records_in(store, st.st_size) : 0;
+    if (keep_from <= store->first_event || keep_from > count) {
+        flock(store->fd, LOCK_UN);
+        return keep_from <= store->first_event;
+    }
+
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.compact.%d", store->path, (int)getpid());
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    EventLogHeader header;
+    bool ok = fd >= 0 && pread(store->fd, &header, sizeof(header), 0) == sizeof(header);
+    if (ok) {
+        header.first_event = keep_from;
+        ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+             lseek(store->fd, record_offset(store, keep_from), SEEK_SET) >= 0 &&
+             copy_fd(store->fd, fd) && fsync(fd) == 0 && rename(tmp_path, store->path) == 0;
+    }
+    if (!ok) {
+        if (fd >= 0) close(fd);
+        unlink(tmp_path);
+        flock(store->fd, LOCK_UN);
+        return false;
+    }
+
+    // Shells waiting on the old file's lock find it unlinked once this closes
+    close(store->fd);
+    store->fd = fd;
+    store->first_event = keep_from;
+    return true;
+}
+
+// Make everything appended so far durable, before a checkpoint claims it
+bool event_store_sync(EventStore *store) {
+    return store->fd >= 0 && fdatasync(store->fd) == 0;
+}
+
+void event_store_close(EventStore *store) {
+    if (store->fd >= 0) close(store->fd);
+    free(store->path);
+    store->fd = -1;
+    store->path = NULL;
+}
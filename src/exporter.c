@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+#include "analytics.h"
+#include "edushell.h"
+#include <pthread.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Upper bounds of the exported latency buckets, in seconds
+static const double LATENCY_BOUNDS[] = {
+    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300
+};
+#define LATENCY_BOUND_COUNT (int)(sizeof(LATENCY_BOUNDS) / sizeof(LATENCY_BOUNDS[0]))
+
+static const struct {
+    const char *name;
+    int seconds;
+} WINDOWS[] = {{"1m", 60}, {"1h", 3600}, {"1d", 86400}};
+
+static const struct {
+    const char *name;
+    ResourceMetric metric;
+    double scale;   // to the base unit OpenMetrics asks for
+} GAUGES[] = {
+    {"edushell_cpu_usage_percent", METRIC_CPU, 1},
+    {"edushell_cpu_steal_percent", METRIC_STEAL, 1},
+    {"edushell_cpu_guest_percent", METRIC_GUEST, 1},
+    {"edushell_memory_usage_percent", METRIC_MEMORY, 1},
+    {"edushell_disk_io_bytes_per_second", METRIC_DISK_IO, 1e6},
+    {"edushell_disk_iops", METRIC_DISK_IOPS, 1},
+};
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} MetricsText;
+
+// The exposition is rendered on the shell's thread, which owns the stats,
+// and published here; a scrape only copies it, so serving one costs the
+// same however busy the shell is
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static MetricsText snapshot;
+
+static ExporterMode mode = EXPORTER_OFF;
+static char export_path[PATH_MAX];
+static struct timespec last_refresh;
+static pthread_t thread;
+static int listen_fd = -1;
+static int stop_fd = -1;
+
+// The serving thread takes snapshot_lock, so a fork waits until it is
+// free; the child then has no thread to stop and no socket of its own
+static void before_fork(void) {
+    pthread_mutex_lock(&snapshot_lock);
+}
+
+static void in_parent(void) {
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+static void in_child(void) {
+    pthread_mutex_unlock(&snapshot_lock);
+    if (listen_fd >= 0) close(listen_fd);
+    if (stop_fd >= 0) close(stop_fd);
+    listen_fd = stop_fd = -1;
+    mode = EXPORTER_OFF;
+}
+
+static void text_append(MetricsText *text, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void text_append(MetricsText *text, const char *format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        size_t room = text->capacity - text->length;
+        int n = vsnprintf(text->data ? text->data + text->length : NULL, room, format, args);
+        va_end(args);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            text->length += n;
+            return;
+        }
+
+        size_t capacity = text->capacity ? text->capacity * 2 : 16384;
+        while (capacity - text->length <= (size_t)n) capacity *= 2;
+        char *data = realloc(text->data, capacity);
+        if (!data) return;
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
+
+// A command name as a label value: backslash, quote and newline escaped
+static const char *label_value(const char *value, char *buf, size_t size) {
+    size_t n = 0;
+    for (; *value && n + 3 < size; value++) {
+        if (*value == '\\' || *value == '"') buf[n++] = '\\';
+        if (*value == '\n') {
+            buf[n++] = '\\';
+            buf[n++] = 'n';
+            continue;
+        }
+        buf[n++] = *value;
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+static const LearningStats *rank_stats;
+
+static int compare_usage(const void *a, const void *b) {
+    int ua = rank_stats->commands[*(const int *)a].usage_count;
+    int ub = rank_stats->commands[*(const int *)b].usage_count;
+    if (ua != ub) return ua < ub ? 1 : -1;
+    return *(const int *)a - *(const int *)b;
+}
+
+// Per-command families for the EXPORT_MAX_COMMANDS most used commands, so
+// the size of a scrape doesn't grow with the history
+static void render_commands(MetricsText *text, const LearningStats *stats) {
+    int *indices = malloc((stats->command_count + 1) * sizeof(int));
+    if (!indices) return;
+    int count = 0;
+    for (int i = 0; i < stats->command_count; i++) {
+        if (stats->commands[i].usage_count > 0) indices[count++] = i;
+    }
+    if (count > EXPORT_MAX_COMMANDS) {
+        rank_stats = stats;
+        qsort(indices, count, sizeof(int), compare_usage);
+        count = EXPORT_MAX_COMMANDS;
+    }
+
+    char name[sizeof(stats->commands[0].command) * 2 + 1];
+    text_append(text, "# TYPE edushell_command_runs counter\n"
+                      "# HELP edushell_command_runs Runs of a command typed at the prompt.\n");
+    for (int i = 0; i < count; i++) {
+        const CommandStats *command = &stats->commands[indices[i]];
+        text_append(text, "edushell_command_runs_total{command=\"%s\"} %d\n",
+                    label_value(command->command, name, sizeof(name)), command->usage_count);
+    }
+
+    text_append(text, "# TYPE edushell_command_errors counter\n"
+                      "# HELP edushell_command_errors Runs of a command that failed.\n");
+    for (int i = 0; i < count; i++) {
+        const CommandStats *command = &stats->commands[indices[i]];
+        text_append(text, "edushell_command_errors_total{command=\"%s\"} %d\n",
+                    label_value(command->command, name, sizeof(name)), command->error_count);
+    }
+
+    text_append(text, "# TYPE edushell_command_duration_seconds histogram\n"
+                      "# UNIT edushell_command_duration_seconds seconds\n"
+                      "# HELP edushell_command_duration_seconds Wall time of a command.\n");
+    for (int i = 0; i < count; i++) {
+        const CommandStats *command = &stats->commands[indices[i]];
+        label_value(command->command, name, sizeof(name));
+        for (int b = 0; b < LATENCY_BOUND_COUNT; b++) {
+            text_append(text, "edushell_command_duration_seconds_bucket{command=\"%s\",le=\"%g\"} %llu\n",
+                        name, LATENCY_BOUNDS[b],
+                        histogram_count_at_most(&command->latency, LATENCY_BOUNDS[b]));
+        }
+        text_append(text, "edushell_command_duration_seconds_bucket{command=\"%s\",le=\"+Inf\"} %llu\n"
+                          "edushell_command_duration_seconds_count{command=\"%s\"} %llu\n"
+                          "edushell_command_duration_seconds_sum{command=\"%s\"} %.6f\n",
+                    name, command->latency.total, name, command->latency.total,
+                    name, command->avg_execution_time * command->usage_count);
+    }
+    free(indices);
+}
+
+static void render_resources(MetricsText *text) {
+    const ResourceSample *latest = analytics_latest_sample();
+    const ResourceHistory *history = analytics_resource_history();
+    time_t now = time(NULL);
+
+    for (size_t g = 0; g < sizeof(GAUGES) / sizeof(GAUGES[0]); g++) {
+        text_append(text, "# TYPE %s gauge\n", GAUGES[g].name);
+        if (latest) {
+            double values[RESOURCE_METRIC_COUNT] = {
+                [METRIC_CPU] = latest->point.cpu_usage,
+                [METRIC_STEAL] = latest->point.cpu_steal,
+                [METRIC_GUEST] = latest->point.cpu_guest,
+                [METRIC_MEMORY] = latest->point.memory_usage,
+                [METRIC_DISK_IO] = latest->point.disk_io,
+                [METRIC_DISK_IOPS] = latest->point.disk_iops,
+            };
+            text_append(text, "%s %g\n", GAUGES[g].name, values[GAUGES[g].metric] * GAUGES[g].scale);
+        }
+
+        // Summaries from the history rings, labelled with their window
+        text_append(text, "# TYPE %s_window gauge\n", GAUGES[g].name);
+        for (size_t w = 0; w < sizeof(WINDOWS) / sizeof(WINDOWS[0]); w++) {
+            MetricSummary summary;
+            if (!resource_history_window(history, now, WINDOWS[w].seconds, GAUGES[g].metric, &summary)) {
+                continue;
+            }
+            text_append(text, "%s_window{window=\"%s\",stat=\"min\"} %g\n"
+                              "%s_window{window=\"%s\",stat=\"mean\"} %g\n"
+                              "%s_window{window=\"%s\",stat=\"max\"} %g\n",
+                        GAUGES[g].name, WINDOWS[w].name, summary.min * GAUGES[g].scale,
+                        GAUGES[g].name, WINDOWS[w].name, summary.mean * GAUGES[g].scale,
+                        GAUGES[g].name, WINDOWS[w].name, summary.max * GAUGES[g].scale);
+        }
+    }
+}
+
+static void render(MetricsText *text) {
+    const LearningStats *stats = analytics_stats();
+    text->length = 0;
+
+    text_append(text, "# TYPE edushell_commands counter\n"
+                      "edushell_commands_total %d\n"
+                      "# TYPE edushell_errors counter\n"
+                      "edushell_errors_total %d\n"
+                      "# TYPE edushell_forks_avoided counter\n"
+                      "edushell_forks_avoided_total %d\n"
+                      "# TYPE edushell_sampler_dropped_samples counter\n"
+                      "edushell_sampler_dropped_samples_total %lu\n",
+                stats->total_commands_executed, stats->total_errors, stats->forks_avoided,
+                sampler_thread_dropped());
+    render_commands(text, stats);
+    render_resources(text);
+    text_append(text, "# TYPE edushell_exporter_snapshot_timestamp_seconds gauge\n"
+                      "edushell_exporter_snapshot_timestamp_seconds %lld\n"
+                      "# EOF\n", (long long)time(NULL));
+}
+
+// Replace the file in one rename, so a collector never reads half of it
+static bool write_textfile(const MetricsText *text) {
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", export_path, (int)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    bool ok = write(fd, text->data, text->length) == (ssize_t)text->length;
+    close(fd);
+    if (ok) ok = rename(tmp_path, export_path) == 0;
+    if (!ok) unlink(tmp_path);
+    return ok;
+}
+
+static void send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        length -= n;
+    }
+}
+
+// Answer one scraper. An HTTP GET gets an HTTP response; anything else,
+// including a client that sends nothing, gets the bare exposition.
+static void serve(int client, MetricsText *copy) {
+    struct timeval timeout = {.tv_sec = EXPORT_CLIENT_TIMEOUT};
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[1024];
+    ssize_t n = 0;
+    struct pollfd pfd = {.fd = client, .events = POLLIN};
+    if (poll(&pfd, 1, EXPORT_REQUEST_WAIT_MS) > 0) {
+        n = recv(client, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+    bool http = n >= 4 && memcmp(request, "GET ", 4) == 0;
+
+    pthread_mutex_lock(&snapshot_lock);
+    copy->length = 0;
+    if (snapshot.length > 0) text_append(copy, "%.*s", (int)snapshot.length, snapshot.data);
+    pthread_mutex_unlock(&snapshot_lock);
+
+    if (http) {
+        char header[256];
+        int length = snprintf(header, sizeof(header),
+                              "HTTP/1.0 200 OK\r\n"
+                              "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                              "Content-Length: %zu\r\n\r\n", copy->length);
+        send_all(client, header, length);
+    }
+    send_all(client, copy->data, copy->length);
+}
+
+// One scraper at a time, each bounded by the timeouts above
+static void *exporter_main(void *arg) {
+    (void)arg;
+    MetricsText copy = {0};
+    struct pollfd fds[2] = {{.fd = listen_fd, .events = POLLIN}, {.fd = stop_fd, .events = POLLIN}};
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if (fds[1].revents) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        serve(client, &copy);
+        close(client);
+    }
+    free(copy.data);
+    return NULL;
+}
+
+static bool listen_on(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket left by a shell that died can go; any other file stays
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return false;
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 8) < 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Serve metrics on a UNIX socket (EXPORTER_SOCKET) or keep them in a
+// textfile (EXPORTER_TEXTFILE) at `path`, replacing any exporter running
+bool exporter_start(ExporterMode new_mode, const char *path) {
+    static bool registered = false;
+    if (!registered) {
+        pthread_atfork(before_fork, in_parent, in_child);
+        registered = true;
+    }
+
+    exporter_stop();
+    if (strlen(path) >= sizeof(export_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(export_path, path);
+    mode = new_mode;
+
+    if (mode == EXPORTER_SOCKET) {
+        stop_fd = eventfd(0, EFD_CLOEXEC);
+        if (stop_fd < 0 || !listen_on(path)) {
+            exporter_stop();
+            return false;
+        }
+
+        // Signals stay with the main thread, where the event loop reads them
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        bool started = pthread_create(&thread, NULL, exporter_main, NULL) == 0;
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        if (!started) {
+            close(listen_fd);
+            listen_fd = -1;
+            exporter_stop();
+            return false;
+        }
+    }
+
+    last_refresh.tv_sec = 0;
+    return exporter_refresh() || mode == EXPORTER_SOCKET;
+}
+
+void exporter_stop(void) {
+    if (listen_fd >= 0) {
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) < 0) {}
+        pthread_join(thread, NULL);
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(export_path);
+    }
+    if (stop_fd >= 0) close(stop_fd);
+    stop_fd = -1;
+    mode = EXPORTER_OFF;
+
+    pthread_mutex_lock(&snapshot_lock);
+    free(snapshot.data);
+    memset(&snapshot, 0, sizeof(snapshot));
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+// Re-render the metrics, at most once per EXPORT_REFRESH_INTERVAL. Called
+// before each prompt and from the event loop while it waits, so what is
+// served is as of the last time the shell was idle. False when the
+// textfile could not be written.
+bool exporter_refresh(void) {
+    if (mode == EXPORTER_OFF) return true;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (last_refresh.tv_sec != 0 && now.tv_sec - last_refresh.tv_sec < EXPORT_REFRESH_INTERVAL) {
+        return true;
+    }
+    last_refresh = now;
+
+    // Render outside the lock; only the swap makes a scraper wait
+    static MetricsText next;
+    render(&next);
+    if (mode == EXPORTER_TEXTFILE) return write_textfile(&next);
+
+    pthread_mutex_lock(&snapshot_lock);
+    MetricsText old = snapshot;
+    snapshot = next;
+    next = old;
+    pthread_mutex_unlock(&snapshot_lock);
+    return true;
+}
+
+ExporterMode exporter_mode(void) {
+    return mode;
+}
+
+const char *exporter_path(void) {
+    return export_path;
+}
@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include <limits.h>
+
+#define COPY_CHUNK (1024 * 1024)
+
+// Last resort when neither side supports an in-kernel copy (terminals)
+static bool copy_read_write(int in_fd, int out_fd) {
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(in_fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out_fd, buf + off, n - off);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            off += w;
+        }
+    }
+    return true;
+}
+
+// Errors that mean "this copy primitive can't handle these fds", as
+// opposed to a real I/O failure
+static bool unsupported(int err) {
+    return err == EINVAL || err == EXDEV || err == ENOSYS ||
+           err == EOPNOTSUPP || err == EBADF;
+}
+
+static int copy_splice(int in_fd, int out_fd) {
+    ssize_t n;
+    while ((n = splice(in_fd, NULL, out_fd, NULL, COPY_CHUNK, SPLICE_F_MOVE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+    }
+    return 0;
+}
+
+// All of these advance the file offsets, so a fallback picks up exactly
+// where the previous primitive stopped.
+static int copy_sendfile(int in_fd, int out_fd) {
+    ssize_t n;
+    while ((n = sendfile(out_fd, in_fd, NULL, COPY_CHUNK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+    }
+    return 0;
+}
+
+static int copy_range(int in_fd, int out_fd) {
+    ssize_t n;
+    while ((n = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK, 0)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+    }
+    return 0;
+}
+
+// Copy in_fd to out_fd until EOF without bouncing data through user space
+// where the kernel allows it: copy_file_range between regular files,
+// sendfile from a regular file to anything, splice when a pipe is involved.
+bool copy_fd(int in_fd, int out_fd) {
+    struct stat in_st, out_st;
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0) return false;
+
+    int err = EINVAL;
+    if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) {
+        err = copy_range(in_fd, out_fd);
+    }
+    if (unsupported(err) && S_ISREG(in_st.st_mode)) {
+        err = copy_sendfile(in_fd, out_fd);
+    }
+    if (unsupported(err) && (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode))) {
+        err = copy_splice(in_fd, out_fd);
+    }
+    if (unsupported(err)) {
+        return copy_read_write(in_fd, out_fd);
+    }
+    if (err != 0) errno = err;
+    return err == 0;
+}
+
+// Share the source's extents (reflink) on filesystems that support it
+bool clone_fd(int in_fd, int out_fd) {
+    return ioctl(out_fd, FICLONE, in_fd) == 0;
+}
+
+static bool same_file(int a, int b) {
+    struct stat sa, sb;
+    return fstat(a, &sa) == 0 && fstat(b, &sb) == 0 &&
+           S_ISREG(sa.st_mode) && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// The builtins only cover the plain forms; anything with options is left
+// to the real coreutils binaries.
+bool fileops_supported(const Command *cmd) {
+    for (int i = 1; i < cmd->arg_count; i++) {
+        const char *arg = cmd->args[i];
+        if (arg[0] != '-' || strcmp(arg, "-") == 0) continue;
+        if (strcmp(cmd->args[0], "cp") == 0 && strcmp(arg, "-v") == 0) continue;
+        return false;
+    }
+    return true;
+}
+
+static int open_output(const Command *cmd) {
+    if (!cmd->output_file) return STDOUT_FILENO;
+
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    flags |= cmd->append_output ? O_APPEND : O_TRUNC;
+    int fd = open(cmd->output_file, flags, 0644);
+    if (fd < 0) handle_error("Could not open output file");
+    return fd;
+}
+
+// Where `-` reads from: the < file when there is one, as for the output
+static int open_input(const Command *cmd) {
+    if (!cmd->input_file) return STDIN_FILENO;
+
+    int fd = open(cmd->input_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) handle_error("Could not open input file");
+    return fd;
+}
+
+static bool cat_one(const char *name, int in_fd, int out_fd) {
+    if (same_file(in_fd, out_fd)) {
+        fprintf(stderr, COLOR_RED "cat: %s: input file is output file\n" COLOR_RESET, name);
+        return false;
+    }
+    if (!copy_fd(in_fd, out_fd)) {
+        fprintf(stderr, COLOR_RED "cat: %s: %s\n" COLOR_RESET, name, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// cat [FILE|-]... - honours < for `-` or when no files are given, and > / >>
+int builtin_cat(Command *cmd, ShellState *state) {
+    (void)state;
+    fflush(stdout);
+    int out_fd = open_output(cmd);
+    if (out_fd < 0) return 1;
+    int stdin_fd = open_input(cmd);
+    if (stdin_fd < 0) {
+        if (out_fd != STDOUT_FILENO) close(out_fd);
+        return 1;
+    }
+    const char *stdin_name = cmd->input_file ? cmd->input_file : "-";
+
+    bool ok = true;
+    if (cmd->arg_count < 2) ok = cat_one(stdin_name, stdin_fd, out_fd);
+
+    for (int i = 1; i < cmd->arg_count; i++) {
+        if (strcmp(cmd->args[i], "-") == 0) {
+            ok &= cat_one(stdin_name, stdin_fd, out_fd);
+            continue;
+        }
+        int in_fd = open(cmd->args[i], O_RDONLY | O_CLOEXEC);
+        if (in_fd < 0) {
+            fprintf(stderr, COLOR_RED "cat: %s: %s\n" COLOR_RESET, cmd->args[i], strerror(errno));
+            ok = false;
+            continue;
+        }
+        ok &= cat_one(cmd->args[i], in_fd, out_fd);
+        close(in_fd);
+    }
+
+    if (stdin_fd != STDIN_FILENO) close(stdin_fd);
+    if (out_fd != STDOUT_FILENO) close(out_fd);
+    return ok ? 0 : 1;
+}
+
+static bool cp_one(const char *src, const char *dst, bool verbose, int msg_fd) {
+    int in_fd = open(src, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        fprintf(stderr, COLOR_RED "cp: cannot open '%s': %s\n" COLOR_RESET, src, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(in_fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+        fprintf(stderr, COLOR_RED "cp: -r not specified; omitting directory '%s'\n" COLOR_RESET, src);
+        close(in_fd);
+        return false;
+    }
+
+    int out_fd = open(dst, O_WRONLY | O_CREAT | O_CLOEXEC, st.st_mode & 07777);
+    if (out_fd < 0) {
+        fprintf(stderr, COLOR_RED "cp: cannot create '%s': %s\n" COLOR_RESET, dst, strerror(errno));
+        close(in_fd);
+        return false;
+    }
+    if (same_file(in_fd, out_fd)) {
+        fprintf(stderr, COLOR_RED "cp: '%s' and '%s' are the same file\n" COLOR_RESET, src, dst);
+        close(in_fd);
+        close(out_fd);
+        return false;
+    }
+
+    bool ok = ftruncate(out_fd, 0) == 0;
+    if (ok && !clone_fd(in_fd, out_fd)) {
+        ok = copy_fd(in_fd, out_fd);
+    }
+    if (!ok) {
+        fprintf(stderr, COLOR_RED "cp: error copying '%s': %s\n" COLOR_RESET, src, strerror(errno));
+    } else if (verbose) {
+        dprintf(msg_fd, "'%s' -> '%s'\n", src, dst);
+    }
+
+    close(in_fd);
+    close(out_fd);
+    return ok;
+}
+
+// cp [-v] SOURCE DEST | cp [-v] SOURCE... DIRECTORY
+int builtin_cp(Command *cmd, ShellState *state) {
+    (void)state;
+    const char *files[MAX_ARGS];
+    int file_count = 0;
+    bool verbose = false;
+
+    for (int i = 1; i < cmd->arg_count; i++) {
+        if (strcmp(cmd->args[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            files[file_count++] = cmd->args[i];
+        }
+    }
+
+    if (file_count < 2) {
+        print_builtin_usage("cp");
+        return 1;
+    }
+
+    fflush(stdout);
+    int msg_fd = open_output(cmd);
+    if (msg_fd < 0) return 1;
+
+    const char *dest = files[file_count - 1];
+    struct stat st;
+    bool dest_is_dir = stat(dest, &st) == 0 && S_ISDIR(st.st_mode);
+
+    bool ok = true;
+    if (file_count > 2 && !dest_is_dir) {
+        fprintf(stderr, COLOR_RED "cp: target '%s' is not a directory\n" COLOR_RESET, dest);
+        ok = false;
+    } else {
+        for (int i = 0; i < file_count - 1; i++) {
+            char target[PATH_MAX];
+            int length;
+            if (dest_is_dir) {
+                const char *base = strrchr(files[i], '/');
+                base = base ? base + 1 : files[i];
+                length = snprintf(target, sizeof(target), "%s/%s", dest, base);
+            } else {
+                length = snprintf(target, sizeof(target), "%s", dest);
+            }
+            // A cut-short name would copy to some other path
+            if (length >= (int)sizeof(target)) {
+                fprintf(stderr, COLOR_RED "cp: target for '%s': %s\n" COLOR_RESET, files[i],
+                        strerror(ENAMETOOLONG));
+                ok = false;
+                continue;
+            }
+            ok &= cp_one(files[i], target, verbose, msg_fd);
+        }
+    }
+
+    if (msg_fd != STDOUT_FILENO) close(msg_fd);
+    return ok ? 0 : 1;
+}
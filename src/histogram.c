@@ -0,0 +1,81 @@
+#include "analytics.h"
+#include "edushell.h"
+
+// Bucket for a latency in microseconds. Values below SUB_BUCKETS get a
+// bucket each; above that, the position of the top bit picks a power of
+// two and the next SUB_BITS bits pick one of its linear sub-buckets.
+static int bucket_index(unsigned long long us) {
+    if (us < HISTOGRAM_SUB_BUCKETS) return (int)us;
+
+    int exponent = 63 - __builtin_clzll(us);
+    if (exponent >= HISTOGRAM_MAX_EXPONENT) return HISTOGRAM_BUCKETS - 1;
+    int sub = (us >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// First latency a bucket holds and how many microseconds it spans
+static void bucket_range(int index, unsigned long long *lower, unsigned long long *width) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        *lower = index;
+        *width = 1;
+        return;
+    }
+
+    int exponent = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    int sub = index % HISTOGRAM_SUB_BUCKETS;
+    *width = 1ULL << (exponent - HISTOGRAM_SUB_BITS);
+    *lower = (unsigned long long)(HISTOGRAM_SUB_BUCKETS + sub) * *width;
+}
+
+// Midpoint of a bucket's range, in microseconds
+static double bucket_value(int index) {
+    unsigned long long lower, width;
+    bucket_range(index, &lower, &width);
+    return lower + (width - 1) / 2.0;
+}
+
+void histogram_record(LatencyHistogram *histogram, double seconds) {
+    unsigned long long us = seconds > 0 ? (unsigned long long)(seconds * 1e6) : 0;
+    histogram->counts[bucket_index(us)]++;
+    histogram->total++;
+    if (us > histogram->max_us) histogram->max_us = us;
+}
+
+// Latency at the given percentile (0-100) in seconds, 0 when empty
+double histogram_percentile(const LatencyHistogram *histogram, double percentile) {
+    if (histogram->total == 0) return 0.0;
+
+    // Smallest bucket with at least ceil(p * total) runs at or below it
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * histogram->total + 0.999999);
+    if (rank == 0) rank = 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            // A bucket midpoint can overshoot the largest value seen
+            double us = bucket_value(i);
+            if (us > histogram->max_us) us = histogram->max_us;
+            return us / 1e6;
+        }
+    }
+    return histogram->max_us / 1e6;
+}
+
+// Runs that took at most `seconds`. The bucket holding the bound counts in
+// proportion to the part of its range at or below it, as if its runs were
+// spread evenly through it, rather than whole.
+unsigned long long histogram_count_at_most(const LatencyHistogram *histogram, double seconds) {
+    unsigned long long us = seconds > 0 ? (unsigned long long)(seconds * 1e6) : 0;
+    int last = bucket_index(us);
+    unsigned long long count = 0;
+    for (int i = 0; i < last; i++) {
+        count += histogram->counts[i];
+    }
+
+    unsigned long long lower, width;
+    bucket_range(last, &lower, &width);
+    if (last == HISTOGRAM_BUCKETS - 1 || us - lower + 1 >= width) {
+        return count + histogram->counts[last];
+    }
+    return count + (unsigned long long)((double)histogram->counts[last] * (us - lower + 1) / width + 0.5);
+}
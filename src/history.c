@@ -0,0 +1,331 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define HISTORY_MAGIC 0x31494845u  // "EHI1"
+#define HISTORY_VERSION 1
+#define HISTORY_MAX_LINE 65536
+#define HISTORY_MIN_MAP (1 << 20)
+#define TRIGRAM_BITS 17
+#define TRIGRAM_BUCKETS (1 << TRIGRAM_BITS)
+#define TRIGRAM_FILTERS 4          // posting lists intersected per search
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int64_t created;
+} HistoryHeader;
+
+// Each line is stored as this header, the text, a NUL and padding to a
+// multiple of 8, so the text can be used in place through the mapping
+typedef struct {
+    uint32_t length;
+    uint32_t checksum;     // over the timestamp and the text
+    int64_t timestamp;
+} HistoryRecord;
+
+// Entry numbers containing one trigram (more precisely, one of the
+// trigrams that share a bucket), ascending and delta-coded as varints
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t last;
+} Posting;
+
+// Every line ever entered, in ~/.edushell/history. Shells append under an
+// exclusive lock and read through a shared mapping; the offsets of the
+// records are indexed at open and as the file grows. The trigram index is
+// only built once something is searched for.
+static struct {
+    int fd;
+    char *map;
+    size_t map_size;
+    off_t end;             // bytes of the file indexed so far
+    uint64_t *offsets;
+    uint64_t count;
+    uint64_t capacity;
+    Posting *postings;
+    uint64_t trigram_count;  // entries in the trigram index
+} history = {.fd = -1};
+
+static size_t record_size(uint32_t length) {
+    return (sizeof(HistoryRecord) + length + 1 + 7) & ~(size_t)7;
+}
+
+static const HistoryRecord *record_at(off_t offset) {
+    return (const HistoryRecord *)(history.map + offset);
+}
+
+// Map at least `size` bytes of the file. The mapping runs past the end of
+// the file so appends rarely need a new one; nothing past the end is read.
+static bool map_file(off_t size) {
+    if (history.map && (size_t)size <= history.map_size) return true;
+
+    size_t map_size = history.map_size ? history.map_size : HISTORY_MIN_MAP;
+    while (map_size < (size_t)size) map_size *= 2;
+    char *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, history.fd, 0);
+    if (map == MAP_FAILED) return false;
+    if (history.map) munmap(history.map, history.map_size);
+    history.map = map;
+    history.map_size = map_size;
+    return true;
+}
+
+// A whole record at `offset` within the first `size` bytes, checksum intact
+static bool record_valid_at(off_t offset, off_t size) {
+    if (offset + (off_t)sizeof(HistoryRecord) > size) return false;
+    const HistoryRecord *record = record_at(offset);
+    return record->length <= HISTORY_MAX_LINE && offset + (off_t)record_size(record->length) <= size &&
+           record->checksum == event_checksum(&record->timestamp, sizeof(record->timestamp) + record->length);
+}
+
+// Index the records between what was indexed and `size`. Past a record
+// torn by a crash or otherwise garbled, the scan resyncs at the next valid
+// one (records start at multiples of 8), since a length read from garbage
+// can't be trusted to skip it. With none after it, the bad bytes are a
+// torn tail and the scan stops there.
+static void index_records(off_t size) {
+    while (history.end + (off_t)sizeof(HistoryRecord) <= size) {
+        if (!record_valid_at(history.end, size)) {
+            off_t next = history.end + 8;
+            while (next + (off_t)sizeof(HistoryRecord) <= size && !record_valid_at(next, size)) next += 8;
+            if (next + (off_t)sizeof(HistoryRecord) > size) return;
+            history.end = next;
+        }
+
+        if (history.count == history.capacity) {
+            uint64_t capacity = history.capacity ? history.capacity * 2 : 1024;
+            uint64_t *offsets = realloc(history.offsets, capacity * sizeof(uint64_t));
+            if (!offsets) return;
+            history.offsets = offsets;
+            history.capacity = capacity;
+        }
+        history.offsets[history.count++] = history.end;
+        history.end += record_size(record_at(history.end)->length);
+    }
+}
+
+// Open or create the history file and index it. A torn tail left by a
+// crash mid-append is cut off; records after a garbled one are kept.
+bool history_open(const char *path) {
+    history_close();
+    history.fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (history.fd < 0) return false;
+    flock(history.fd, LOCK_EX);
+
+    HistoryHeader header;
+    struct stat st;
+    bool ok = fstat(history.fd, &st) == 0;
+    if (ok && st.st_size < (off_t)sizeof(header)) {
+        memset(&header, 0, sizeof(header));
+        header.magic = HISTORY_MAGIC;
+        header.version = HISTORY_VERSION;
+        header.created = time(NULL);
+        ok = ftruncate(history.fd, 0) == 0 &&
+             pwrite(history.fd, &header, sizeof(header), 0) == sizeof(header);
+        st.st_size = sizeof(header);
+    } else if (ok) {
+        ok = pread(history.fd, &header, sizeof(header), 0) == sizeof(header) &&
+             header.magic == HISTORY_MAGIC && header.version == HISTORY_VERSION;
+    }
+
+    if (ok && (ok = map_file(st.st_size))) {
+        history.end = sizeof(header);
+        index_records(st.st_size);
+        if (history.end != st.st_size) ok = ftruncate(history.fd, history.end) == 0;
+    }
+
+    flock(history.fd, LOCK_UN);
+    if (!ok) history_close();
+    return ok;
+}
+
+void history_close(void) {
+    if (history.map) munmap(history.map, history.map_size);
+    if (history.fd >= 0) close(history.fd);
+    if (history.postings) {
+        for (int i = 0; i < TRIGRAM_BUCKETS; i++) free(history.postings[i].data);
+    }
+    free(history.postings);
+    free(history.offsets);
+    memset(&history, 0, sizeof(history));
+    history.fd = -1;
+}
+
+// Pick up lines other shells appended since the last look
+void history_refresh(void) {
+    if (history.fd < 0) return;
+
+    // Appends hold the lock exclusively, so nothing below the size is half-written
+    struct stat st;
+    flock(history.fd, LOCK_SH);
+    bool ok = fstat(history.fd, &st) == 0;
+    flock(history.fd, LOCK_UN);
+    if (ok && st.st_size > history.end && map_file(st.st_size)) index_records(st.st_size);
+}
+
+uint64_t history_count(void) {
+    return history.count;
+}
+
+// Entry `index` (0 is the oldest). The text stays valid until the next
+// history_add or history_refresh.
+const char *history_entry(uint64_t index) {
+    if (index >= history.count) return NULL;
+    return (const char *)(record_at(history.offsets[index]) + 1);
+}
+
+// Record a line. Blank lines, lines starting with a space and repeats of
+// the line before aren't kept.
+bool history_add(const char *line) {
+    size_t length = strlen(line);
+    if (history.fd < 0 || length == 0 || length > HISTORY_MAX_LINE || line[0] == ' ' ||
+        strspn(line, " \t") == length) {
+        return false;
+    }
+    history_refresh();
+    if (history.count > 0 && strcmp(history_entry(history.count - 1), line) == 0) return false;
+
+    size_t size = record_size(length);
+    char *buffer = calloc(1, size);
+    if (!buffer) return false;
+    HistoryRecord *record = (HistoryRecord *)buffer;
+    record->length = length;
+    record->timestamp = time(NULL);
+    memcpy(record + 1, line, length);
+    record->checksum = event_checksum(&record->timestamp, sizeof(record->timestamp) + length);
+
+    // Each record lands on a multiple of 8 even after a torn write left
+    // the file a ragged size, so index_records can resync to it
+    flock(history.fd, LOCK_EX);
+    struct stat st;
+    bool ok = fstat(history.fd, &st) == 0 &&
+              pwrite(history.fd, buffer, size, (st.st_size + 7) & ~(off_t)7) == (ssize_t)size;
+    flock(history.fd, LOCK_UN);
+    free(buffer);
+
+    if (ok) history_refresh();
+    return ok;
+}
+
+static uint32_t trigram_bucket(const char *p) {
+    uint32_t key = (unsigned char)p[0] << 16 | (unsigned char)p[1] << 8 | (unsigned char)p[2];
+    return (key * 2654435761u) >> (32 - TRIGRAM_BITS);
+}
+
+static bool posting_add(Posting *posting, uint32_t entry) {
+    if (posting->count > 0 && posting->last == entry) return true;  // trigram seen earlier in this line
+    if (posting->size + 5 > posting->capacity) {
+        uint32_t capacity = posting->capacity ? posting->capacity * 2 : 16;
+        uint8_t *data = realloc(posting->data, capacity);
+        if (!data) return false;
+        posting->data = data;
+        posting->capacity = capacity;
+    }
+    uint32_t delta = entry - posting->last;
+    while (delta >= 0x80) {
+        posting->data[posting->size++] = (delta & 0x7F) | 0x80;
+        delta >>= 7;
+    }
+    posting->data[posting->size++] = delta;
+    posting->last = entry;
+    posting->count++;
+    return true;
+}
+
+// Bring the trigram index up to every indexed entry
+static bool index_trigrams(void) {
+    if (!history.postings) {
+        history.postings = calloc(TRIGRAM_BUCKETS, sizeof(Posting));
+        if (!history.postings) return false;
+    }
+    for (; history.trigram_count < history.count; history.trigram_count++) {
+        const char *text = history_entry(history.trigram_count);
+        for (const char *p = text; p[0] && p[1] && p[2]; p++) {
+            if (!posting_add(&history.postings[trigram_bucket(p)], history.trigram_count)) return false;
+        }
+    }
+    return true;
+}
+
+// Decode a posting list, keeping only entries already in `keep` (all when
+// `keep` is NULL). Both are ascending, so this is one merge pass.
+static uint32_t decode_posting(const Posting *posting, const uint32_t *keep, uint32_t keep_count,
+                               uint32_t *out) {
+    uint32_t entry = 0, found = 0, k = 0;
+    const uint8_t *p = posting->data;
+    for (uint32_t i = 0; i < posting->count; i++) {
+        uint32_t delta = 0;
+        int shift = 0;
+        do {
+            delta |= (uint32_t)(*p & 0x7F) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        entry += delta;
+
+        if (!keep) {
+            out[found++] = entry;
+            continue;
+        }
+        while (k < keep_count && keep[k] < entry) k++;
+        if (k == keep_count) break;
+        if (keep[k] == entry) out[found++] = entry;
+    }
+    return found;
+}
+
+static bool matches(const char *entry, const char *text, size_t length, bool prefix) {
+    return prefix ? strncmp(entry, text, length) == 0 : strstr(entry, text) != NULL;
+}
+
+static int compare_postings(const void *a, const void *b) {
+    uint32_t x = (*(Posting *const *)a)->count, y = (*(Posting *const *)b)->count;
+    return x < y ? -1 : x > y;
+}
+
+// The newest entry before `before` that contains `text` (or starts with
+// it, for `prefix`), or -1. Text of three bytes or more is looked up in
+// the trigram index: the entries in the rarest few of its trigrams' lists
+// are the only candidates, and they are checked newest first.
+int64_t history_find(const char *text, int64_t before, bool prefix) {
+    size_t length = strlen(text);
+    if (before > (int64_t)history.count) before = history.count;
+
+    if (length < 3 || !index_trigrams()) {
+        for (int64_t i = before - 1; i >= 0; i--) {
+            if (matches(history_entry(i), text, length, prefix)) return i;
+        }
+        return -1;
+    }
+
+    // The query's distinct buckets, rarest first
+    Posting *lists[MAX_COMMAND_LENGTH];
+    int list_count = 0;
+    for (size_t i = 0; i + 2 < length && list_count < MAX_COMMAND_LENGTH; i++) {
+        Posting *posting = &history.postings[trigram_bucket(text + i)];
+        if (posting->count == 0) return -1;
+        bool seen = false;
+        for (int j = 0; j < list_count && !seen; j++) seen = lists[j] == posting;
+        if (!seen) lists[list_count++] = posting;
+    }
+    qsort(lists, list_count, sizeof(Posting *), compare_postings);
+
+    uint32_t *candidates = malloc(lists[0]->count * sizeof(uint32_t));
+    if (!candidates) return -1;
+    uint32_t count = decode_posting(lists[0], NULL, 0, candidates);
+    for (int i = 1; i < list_count && i < TRIGRAM_FILTERS && count > 0; i++) {
+        count = decode_posting(lists[i], candidates, count, candidates);
+    }
+
+    int64_t found = -1;
+    for (int64_t i = (int64_t)count - 1; i >= 0 && found < 0; i--) {
+        if (candidates[i] < before && matches(history_entry(candidates[i]), text, length, prefix)) {
+            found = candidates[i];
+        }
+    }
+    free(candidates);
+    return found;
+}
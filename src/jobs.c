@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include "analytics.h"
+#include <signal.h>
+#include <sys/syscall.h>
+
+#define MAX_JOBS 32
+
+typedef enum {
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_DONE
+} JobState;
+
+// One process of a background job. The pidfd lets it be reaped without
+// waiting on pids the shell doesn't own, and can be watched for exit.
+typedef struct {
+    pid_t pid;
+    int pidfd;
+    char name[64];
+    bool exited;
+    bool lost;          // reaped by someone else, so its status is unknown
+    int status;
+} JobProcess;
+
+typedef struct {
+    bool used;
+    JobState state;
+    JobProcess procs[MAX_PIPELINE_STAGES];
+    int proc_count;
+    char command[MAX_COMMAND_LENGTH];
+    struct timespec start_time;
+    bool notified;      // state change already reported
+} Job;
+
+// Slot i holds job number i + 1
+static Job jobs[MAX_JOBS];
+static int current_job = -1;   // most recently started or resumed, for %+
+
+static int pidfd_open(pid_t pid) {
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+
+static const char *job_state_name(const Job *job) {
+    switch (job->state) {
+        case JOB_RUNNING: return "Running";
+        case JOB_STOPPED: return "Stopped";
+        case JOB_DONE:    return "Done";
+    }
+    return "";
+}
+
+// Exit status of the job's last process, as the shell reports it. One
+// whose status was lost counts as a failure.
+static int job_status(const Job *job) {
+    const JobProcess *last = &job->procs[job->proc_count - 1];
+    int status = last->status;
+    if (last->lost) return 1;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+static void print_job(const Job *job, char mark) {
+    if (job->state == JOB_DONE && job->procs[job->proc_count - 1].lost) {
+        printf("[%d]%c  %-12s %s\n", (int)(job - jobs) + 1, mark, "Unknown", job->command);
+    } else if (job->state == JOB_DONE && job_status(job) != 0) {
+        printf("[%d]%c  Exit %-7d %s\n", (int)(job - jobs) + 1, mark, job_status(job), job->command);
+    } else {
+        printf("[%d]%c  %-12s %s\n", (int)(job - jobs) + 1, mark, job_state_name(job), job->command);
+    }
+}
+
+// Register the processes of a background command or pipeline. Returns the
+// job number, or -1 if the table is full (the processes still run, they
+// just can't be managed).
+int jobs_add(Command *const *stages, const pid_t *pids, int count) {
+    int slot = 0;
+    while (slot < MAX_JOBS && jobs[slot].used) slot++;
+    if (slot == MAX_JOBS) {
+        printf("Job table full; not tracking this job\n");
+        return -1;
+    }
+
+    Job *job = &jobs[slot];
+    memset(job, 0, sizeof(*job));
+    job->used = true;
+    job->state = JOB_RUNNING;
+    clock_gettime(CLOCK_MONOTONIC, &job->start_time);
+
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        const Command *cmd = stages[i];
+        for (int j = 0; j < cmd->arg_count; j++) {
+            len += snprintf(job->command + len, sizeof(job->command) - len, "%s%s",
+                            j || i ? " " : "", cmd->args[j]);
+            if (len >= sizeof(job->command)) len = sizeof(job->command) - 1;
+        }
+        if (i < count - 1) {
+            len += snprintf(job->command + len, sizeof(job->command) - len, " |");
+            if (len >= sizeof(job->command)) len = sizeof(job->command) - 1;
+        }
+
+        // Stages that failed to start have no process to track
+        if (pids[i] <= 0) continue;
+        JobProcess *proc = &job->procs[job->proc_count++];
+        proc->pid = pids[i];
+        proc->pidfd = pidfd_open(pids[i]);
+        snprintf(proc->name, sizeof(proc->name), "%s", cmd->args[0]);
+    }
+    snprintf(job->command + len, sizeof(job->command) - len, " &");
+
+    if (job->proc_count == 0) {
+        job->used = false;
+        return -1;
+    }
+
+    current_job = slot;
+    printf("[%d] %d\n", slot + 1, job->procs[job->proc_count - 1].pid);
+    return slot + 1;
+}
+
+// The raw waitid syscall takes a rusage pointer that glibc's wrapper hides
+static int wait_process(JobProcess *proc, siginfo_t *info, int options, struct rusage *ru) {
+    info->si_pid = 0;
+    return proc->pidfd >= 0 ? syscall(SYS_waitid, P_PIDFD, proc->pidfd, info, options, ru)
+                            : syscall(SYS_waitid, P_PID, proc->pid, info, options, ru);
+}
+
+// Collect a state change of one process without blocking
+static bool update_process(Job *job, JobProcess *proc, ShellState *state) {
+    siginfo_t info;
+
+    // Peek first: an exited process must stay a zombie until its
+    // /proc/<pid>/io has been read. Stops and continues are consumed.
+    int result = wait_process(proc, &info, WEXITED | WSTOPPED | WCONTINUED | WNOWAIT | WNOHANG, NULL);
+    if (result == 0 && info.si_pid != 0 && info.si_code != CLD_EXITED &&
+        info.si_code != CLD_KILLED && info.si_code != CLD_DUMPED) {
+        wait_process(proc, &info, WSTOPPED | WCONTINUED | WNOHANG, NULL);
+    }
+    if (result != 0) {
+        if (errno != ECHILD) return false;
+        // Already reaped elsewhere; nothing more will come of it, and
+        // whatever it exited with is gone
+        proc->lost = true;
+        info.si_code = CLD_EXITED;
+        info.si_status = 1;
+    } else if (info.si_pid == 0) {
+        return false;
+    }
+
+    switch (info.si_code) {
+        case CLD_STOPPED:
+        case CLD_TRAPPED:
+            job->state = JOB_STOPPED;
+            job->notified = false;
+            return true;
+        case CLD_CONTINUED:
+            job->state = JOB_RUNNING;
+            return true;
+    }
+
+    CommandUsage usage = {0};
+    if (result == 0) {
+        struct rusage ru;
+        read_process_io(proc->pid, &usage);
+        if (wait_process(proc, &info, WEXITED, &ru) == 0) {
+            usage_from_rusage(&usage, &ru);
+        }
+    }
+
+    // Exited or killed: rebuild a wait status so it reads like waitpid's
+    proc->exited = true;
+    proc->status = info.si_code == CLD_EXITED ? (info.si_status & 0xff) << 8
+                                              : (info.si_status & 0x7f);
+    if (proc->pidfd >= 0) {
+        close(proc->pidfd);
+        proc->pidfd = -1;
+    }
+
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double execution_time =
+        (end_time.tv_sec - job->start_time.tv_sec) +
+        (end_time.tv_nsec - job->start_time.tv_nsec) / 1e9;
+    log_command(proc->name, LOG_JOB, proc->status, execution_time);
+    if (state->analytics_enabled) {
+        bool failed = proc->lost || !WIFEXITED(proc->status) || WEXITSTATUS(proc->status) != 0;
+        track_command_execution(proc->name, execution_time, failed);
+        track_command_usage(proc->name, &usage);
+    }
+
+    bool all_exited = true;
+    for (int i = 0; i < job->proc_count; i++) {
+        all_exited = all_exited && job->procs[i].exited;
+    }
+    if (all_exited) {
+        job->state = JOB_DONE;
+        job->notified = false;
+    }
+    return true;
+}
+
+// Drain every pending change of the job's processes. With wait, block
+// until the job finishes or any of its processes stops: every stage's exit
+// or stop raises SIGCHLD, which is held blocked while waiting so none can
+// slip in between draining and sleeping.
+static void update_job(Job *job, bool wait, ShellState *state) {
+    sigset_t chld, old;
+    if (wait) {
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, &old);
+    }
+
+    while (1) {
+        for (int i = 0; i < job->proc_count; i++) {
+            while (!job->procs[i].exited && update_process(job, &job->procs[i], state)) {}
+        }
+        if (!wait || job->state != JOB_RUNNING) break;
+        sigwaitinfo(&chld, NULL);
+    }
+
+    if (wait) sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+static void remove_job(Job *job) {
+    for (int i = 0; i < job->proc_count; i++) {
+        if (job->procs[i].pidfd >= 0) close(job->procs[i].pidfd);
+    }
+    job->used = false;
+    if (current_job == job - jobs) {
+        current_job = -1;
+    }
+}
+
+// Reap whatever background processes have changed state, without
+// blocking. Returns how many jobs have a change jobs_notify would report.
+int jobs_reap(ShellState *state) {
+    int pending = 0;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        Job *job = &jobs[i];
+        if (!job->used) continue;
+        if (job->state != JOB_DONE) update_job(job, false, state);
+        if (!job->notified && job->state != JOB_RUNNING) pending++;
+    }
+    return pending;
+}
+
+// Report finished and stopped jobs once, then forget the finished ones
+void jobs_notify(ShellState *state) {
+    jobs_reap(state);
+    for (int i = 0; i < MAX_JOBS; i++) {
+        Job *job = &jobs[i];
+        if (!job->used || job->notified || job->state == JOB_RUNNING) continue;
+
+        print_job(job, i == current_job ? '+' : ' ');
+        job->notified = true;
+        if (job->state == JOB_DONE) remove_job(job);
+    }
+}
+
+// Watchable descriptors of running background processes; each becomes
+// readable when its process exits
+int jobs_pidfds(int *fds, int max) {
+    int count = 0;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (!jobs[i].used) continue;
+        for (int j = 0; j < jobs[i].proc_count && count < max; j++) {
+            if (jobs[i].procs[j].pidfd >= 0) fds[count++] = jobs[i].procs[j].pidfd;
+        }
+    }
+    return count;
+}
+
+void jobs_cleanup(void) {
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (jobs[i].used) remove_job(&jobs[i]);
+    }
+}
+
+// Resolve "%n", "n" or nothing (the current job)
+static Job *find_job(const char *spec) {
+    if (!spec) {
+        return current_job >= 0 && jobs[current_job].used ? &jobs[current_job] : NULL;
+    }
+    if (spec[0] == '%') spec++;
+
+    char *end;
+    long n = strtol(spec, &end, 10);
+    if (*spec == '\0' || *end != '\0' || n < 1 || n > MAX_JOBS || !jobs[n - 1].used) {
+        return NULL;
+    }
+    return &jobs[n - 1];
+}
+
+static Job *find_job_arg(Command *cmd, const char *builtin) {
+    Job *job = find_job(cmd->arg_count > 1 ? cmd->args[1] : NULL);
+    if (!job) {
+        printf("%s: %s: no such job\n", builtin, cmd->arg_count > 1 ? cmd->args[1] : "current");
+    }
+    return job;
+}
+
+int builtin_jobs(Command *cmd, ShellState *state) {
+    (void)cmd;
+    jobs_reap(state);
+    for (int i = 0; i < MAX_JOBS; i++) {
+        Job *job = &jobs[i];
+        if (!job->used) continue;
+
+        print_job(job, i == current_job ? '+' : ' ');
+        job->notified = true;
+        if (job->state == JOB_DONE) remove_job(job);
+    }
+    return 0;
+}
+
+// Wait for one job, or for every job when no job is named
+int builtin_wait(Command *cmd, ShellState *state) {
+    if (cmd->arg_count > 1) {
+        Job *job = find_job_arg(cmd, "wait");
+        if (!job) return 127;
+
+        update_job(job, true, state);
+        int status = job->state == JOB_DONE ? job_status(job) : 128 + SIGSTOP;
+        if (job->state == JOB_DONE) remove_job(job);
+        return status;
+    }
+
+    int status = 0;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (!jobs[i].used || jobs[i].state == JOB_STOPPED) continue;
+        update_job(&jobs[i], true, state);
+        if (jobs[i].state == JOB_DONE) {
+            status = job_status(&jobs[i]);
+            remove_job(&jobs[i]);
+        }
+    }
+    return status;
+}
+
+// Without process groups there is no terminal to hand over: fg resumes
+// the job if needed and waits for it in the foreground
+int builtin_fg(Command *cmd, ShellState *state) {
+    Job *job = find_job_arg(cmd, "fg");
+    if (!job) return 1;
+
+    // Drop the trailing " &" when echoing it as a foreground command
+    printf("%.*s\n", (int)strlen(job->command) - 2, job->command);
+    if (job->state == JOB_STOPPED) {
+        for (int i = 0; i < job->proc_count; i++) {
+            if (!job->procs[i].exited) kill(job->procs[i].pid, SIGCONT);
+        }
+        job->state = JOB_RUNNING;
+    }
+
+    update_job(job, true, state);
+    if (job->state == JOB_STOPPED) {
+        print_job(job, '+');
+        job->notified = true;
+        current_job = job - jobs;
+        return 128 + SIGSTOP;
+    }
+
+    int status = job_status(job);
+    remove_job(job);
+    return status;
+}
+
+int builtin_bg(Command *cmd, ShellState *state) {
+    jobs_reap(state);
+    Job *job = find_job_arg(cmd, "bg");
+    if (!job) return 1;
+
+    if (job->state != JOB_STOPPED) {
+        printf("bg: job %d already in background\n", (int)(job - jobs) + 1);
+        return 0;
+    }
+
+    for (int i = 0; i < job->proc_count; i++) {
+        if (!job->procs[i].exited) kill(job->procs[i].pid, SIGCONT);
+    }
+    job->state = JOB_RUNNING;
+    current_job = job - jobs;
+    printf("[%d]+ %s\n", (int)(job - jobs) + 1, job->command);
+    return 0;
+}
@@ -0,0 +1,536 @@
+#include "edushell.h"
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#define INPUT_CHUNK 256
+#define MAX_SEQUENCE 16
+#define PROMPT_COLUMNS ((int)sizeof(SHELL_PROMPT) - 1)
+#define MAX_QUERY 256
+#define SEARCH_PROMPT "(reverse-i-search)`"
+#define FAILED_SEARCH_PROMPT "(failed reverse-i-search)`"
+
+// The line being edited at the prompt. The terminal is in raw mode only
+// while the editor runs; commands get it back cooked. ISIG stays on so
+// Ctrl-C still reaches the event loop's signalfd.
+static struct {
+    char buffer[MAX_COMMAND_LENGTH];
+    int length;
+    int cursor;
+    int offset;                     // first byte shown, when the line is wider than the terminal
+    char input[INPUT_CHUNK];        // bytes read but not yet handled (a paste can hold several lines)
+    int input_start, input_end;
+    char sequence[MAX_SEQUENCE];    // escape sequence read so far
+    int sequence_length;
+    bool last_was_tab;
+    uint64_t history_index;         // entry Up/Down shows; the history's length for the line being typed
+    char *draft;                    // the line being typed, while Up/Down shows older ones
+    bool searching;                 // in Ctrl-R search
+    char query[MAX_QUERY];
+    int query_length;
+    int64_t match;                  // entry the search shows, or -1
+    bool failed;
+    char *original;                 // the line before the search, for Ctrl-G
+    bool raw;
+    struct termios saved;
+} editor;
+
+void line_editor_start(void) {
+    editor.length = editor.cursor = editor.offset = 0;
+    editor.buffer[0] = '\0';
+    editor.sequence_length = 0;
+    editor.last_was_tab = false;
+    editor.searching = false;
+    history_refresh();
+    editor.history_index = history_count();
+    free(editor.draft);
+    editor.draft = NULL;
+
+    if (editor.raw || tcgetattr(STDIN_FILENO, &editor.saved) != 0) return;
+    struct termios raw = editor.saved;
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    editor.raw = tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == 0;
+}
+
+void line_editor_stop(void) {
+    if (!editor.raw) return;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &editor.saved);
+    editor.raw = false;
+}
+
+// Input left over from a read that already produced a line
+bool line_editor_buffered(void) {
+    return editor.input_start < editor.input_end;
+}
+
+static int terminal_columns(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) return ws.ws_col;
+    return 80;
+}
+
+static bool continuation(char c) {
+    return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+// Terminal columns taken by buffer[from, to), one per UTF-8 character
+static int columns(int from, int to) {
+    int count = 0;
+    for (int i = from; i < to; i++) {
+        if (!continuation(editor.buffer[i])) count++;
+    }
+    return count;
+}
+
+static int previous_char(int pos) {
+    if (pos > 0) pos--;
+    while (pos > 0 && continuation(editor.buffer[pos])) pos--;
+    return pos;
+}
+
+static int next_char(int pos) {
+    if (pos < editor.length) pos++;
+    while (pos < editor.length && continuation(editor.buffer[pos])) pos++;
+    return pos;
+}
+
+static bool blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static int previous_word(int pos) {
+    while (pos > 0 && blank(editor.buffer[pos - 1])) pos--;
+    while (pos > 0 && !blank(editor.buffer[pos - 1])) pos--;
+    return pos;
+}
+
+static int next_word(int pos) {
+    while (pos < editor.length && blank(editor.buffer[pos])) pos++;
+    while (pos < editor.length && !blank(editor.buffer[pos])) pos++;
+    return pos;
+}
+
+static void bell(void) {
+    write(STDOUT_FILENO, "\a", 1);
+}
+
+// The search prompt, the query and the matching line, with the cursor on
+// the match. What doesn't fit the terminal is cut off.
+static void refresh_search(void) {
+    const char *prompt = editor.failed ? FAILED_SEARCH_PROMPT : SEARCH_PROMPT;
+    char out[MAX_COMMAND_LENGTH + MAX_QUERY + 64];
+    int n = snprintf(out, sizeof(out), "\r%s%.*s': ", prompt, editor.query_length, editor.query);
+    int column = strlen(prompt) + 3;
+    for (int i = 0; i < editor.query_length; i++) {
+        if (!continuation(editor.query[i])) column++;
+    }
+    int room = terminal_columns() - column - 1;
+    if (room < 0) room = 0;
+
+    int shown = 0;
+    while (shown < editor.length && columns(0, next_char(shown)) <= room) shown = next_char(shown);
+    n += snprintf(out + n, sizeof(out) - n, "%.*s\033[K\r", shown, editor.buffer);
+    column += columns(0, editor.cursor < shown ? editor.cursor : shown);
+    if (column > 0) n += snprintf(out + n, sizeof(out) - n, "\033[%dC", column);
+
+    fflush(stdout);
+    write(STDOUT_FILENO, out, n);
+}
+
+// Redraw the prompt and the line in one write. A line too wide for the
+// terminal scrolls sideways to keep the cursor in view.
+void line_editor_refresh(void) {
+    if (editor.searching) {
+        refresh_search();
+        return;
+    }
+    int width = terminal_columns() - PROMPT_COLUMNS - 1;
+    if (width < 1) width = 1;
+    if (editor.cursor < editor.offset) editor.offset = editor.cursor;
+    while (columns(editor.offset, editor.cursor) > width) editor.offset = next_char(editor.offset);
+    if (editor.offset > 0 && columns(0, editor.length) <= width) editor.offset = 0;
+
+    int end = editor.offset;
+    while (end < editor.length && columns(editor.offset, next_char(end)) <= width) end = next_char(end);
+
+    char out[MAX_COMMAND_LENGTH + 64];
+    int n = snprintf(out, sizeof(out), "\r" COLOR_GREEN SHELL_PROMPT COLOR_RESET "%.*s\033[K\r",
+                     end - editor.offset, editor.buffer + editor.offset);
+    int column = PROMPT_COLUMNS + columns(editor.offset, editor.cursor);
+    if (column > 0) n += snprintf(out + n, sizeof(out) - n, "\033[%dC", column);
+
+    fflush(stdout);
+    write(STDOUT_FILENO, out, n);
+}
+
+static void insert(const char *text, int length) {
+    if (editor.length + length >= MAX_COMMAND_LENGTH) {
+        bell();
+        return;
+    }
+    memmove(editor.buffer + editor.cursor + length, editor.buffer + editor.cursor,
+            editor.length - editor.cursor + 1);
+    memcpy(editor.buffer + editor.cursor, text, length);
+    editor.length += length;
+    editor.cursor += length;
+}
+
+static void erase(int from, int to) {
+    memmove(editor.buffer + from, editor.buffer + to, editor.length - to + 1);
+    editor.length -= to - from;
+    editor.cursor = from;
+}
+
+// Ctrl-C: drop the line; the caller starts a fresh prompt
+void line_editor_cancel(void) {
+    editor.length = editor.cursor = editor.offset = 0;
+    editor.buffer[0] = '\0';
+    editor.sequence_length = 0;
+    editor.last_was_tab = false;
+    editor.searching = false;
+    editor.history_index = history_count();
+}
+
+static void set_line(const char *text) {
+    snprintf(editor.buffer, sizeof(editor.buffer), "%s", text ? text : "");
+    editor.length = editor.cursor = strlen(editor.buffer);
+    editor.offset = 0;
+}
+
+// Up and Down: step through the history, keeping the line being typed
+static void history_step(int direction) {
+    uint64_t count = history_count();
+    if (editor.history_index > count) editor.history_index = count;
+    if ((direction < 0 && editor.history_index == 0) || (direction > 0 && editor.history_index == count)) {
+        bell();
+        return;
+    }
+    if (editor.history_index == count) {
+        free(editor.draft);
+        editor.draft = strdup(editor.buffer);
+    }
+    editor.history_index += direction;
+    set_line(editor.history_index == count ? editor.draft : history_entry(editor.history_index));
+}
+
+// Show the newest entry before `before` containing the query. Ctrl-R
+// passes `skip_same` to step over repeats of the line already shown.
+static void search_from(int64_t before, bool skip_same) {
+    editor.query[editor.query_length] = '\0';
+    int64_t at = before;
+    do {
+        at = history_find(editor.query, at, false);
+    } while (at >= 0 && skip_same && strcmp(history_entry(at), editor.buffer) == 0);
+
+    editor.failed = at < 0;
+    if (at < 0) return;
+    editor.match = at;
+    set_line(history_entry(at));
+    // An entry longer than the buffer is shown cut short, perhaps without the match
+    const char *found = strstr(editor.buffer, editor.query);
+    editor.cursor = found ? (int)(found - editor.buffer) : editor.length;
+}
+
+// A key during Ctrl-R search. Returns false for keys that end the search
+// and then do their usual job.
+static bool search_key(char c) {
+    int64_t newest = history_count();
+    switch (c) {
+    case 18:  // Ctrl-R: the next older match
+        search_from(editor.match >= 0 ? editor.match : newest, true);
+        break;
+    case 7:   // Ctrl-G: give up, back to the line as it was
+        set_line(editor.original);
+        editor.searching = false;
+        break;
+    case 127:
+    case 8:
+        if (editor.query_length > 0) {
+            while (editor.query_length > 0 && continuation(editor.query[--editor.query_length])) {}
+            search_from(newest, false);
+        }
+        break;
+    default:
+        if ((unsigned char)c < 32) {
+            editor.searching = false;
+            return false;
+        }
+        // The shown line may still match with the longer query
+        if (editor.query_length < MAX_QUERY - 1) {
+            editor.query[editor.query_length++] = c;
+            search_from(editor.match >= 0 && !editor.failed ? editor.match + 1 : newest, false);
+        }
+        break;
+    }
+    line_editor_refresh();
+    return true;
+}
+
+static void start_search(void) {
+    free(editor.original);
+    editor.original = strdup(editor.buffer);
+    editor.searching = true;
+    editor.query_length = 0;
+    editor.match = -1;
+    editor.failed = false;
+}
+
+// Characters the parser would split or unquote; inserted with a backslash
+static bool needs_escape(char c) {
+    return strchr(" \t|<>&'\"\\", c) != NULL;
+}
+
+static void list_completions(const Completions *completions) {
+    int cols = terminal_columns();
+    printf("\n");
+    if (!completions->matches) {
+        printf("%d possibilities; type more to narrow them down\n", completions->count);
+    } else {
+        int widest = 0;
+        for (int i = 0; i < completions->count; i++) {
+            int length = strlen(completions->matches[i]) + completions->directories[i];
+            if (length > widest) widest = length;
+        }
+        int per_row = cols / (widest + 2);
+        if (per_row < 1) per_row = 1;
+        int rows = (completions->count + per_row - 1) / per_row;
+
+        // Down the columns, as ls does
+        for (int row = 0; row < rows; row++) {
+            for (int i = row; i < completions->count; i += rows) {
+                int length = printf("%s%s", completions->matches[i], completions->directories[i] ? "/" : "");
+                if (i + rows < completions->count) printf("%*s", widest + 2 - length, "");
+            }
+            printf("\n");
+        }
+    }
+    fflush(stdout);
+}
+
+// Complete the word before the cursor: a command name at the start of a
+// pipeline stage, a file name anywhere else
+static void complete(void) {
+    char word[MAX_COMMAND_LENGTH];
+    int word_length = 0;
+    bool started = false, command = true;
+    char quote = 0;
+
+    // Walk the line as the parser would, keeping the word in progress unquoted
+    for (int i = 0; i < editor.cursor; i++) {
+        char c = editor.buffer[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            } else if (quote == '"' && c == '\\' && i + 1 < editor.cursor && editor.buffer[i + 1] == '"') {
+                word[word_length++] = editor.buffer[++i];
+            } else {
+                word[word_length++] = c;
+            }
+        } else if (c == '\\' && i + 1 < editor.cursor) {
+            word[word_length++] = editor.buffer[++i];
+            started = true;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            started = true;
+        } else if (blank(c) || c == '<' || c == '>' || c == '|' || c == '&') {
+            if (c == '|' || c == '&') command = true;
+            else if (started || c == '<' || c == '>') command = false;
+            word_length = 0;
+            started = false;
+        } else {
+            word[word_length++] = c;
+            started = true;
+        }
+    }
+    word[word_length] = '\0';
+
+    Completions completions;
+    bool as_command = command && !strchr(word, '/');
+    if (as_command) complete_command(word, &completions);
+    else complete_path(word, &completions);
+
+    if (completions.count == 0 || !completions.common) {
+        bell();
+        completions_free(&completions);
+        editor.last_was_tab = false;
+        return;
+    }
+
+    // Add what every match shares, escaped unless inside quotes
+    char text[2 * MAX_COMMAND_LENGTH];
+    int text_length = 0;
+    for (const char *p = completions.common + word_length; *p && text_length < (int)sizeof(text) - 3; p++) {
+        if (!quote && needs_escape(*p)) text[text_length++] = '\\';
+        text[text_length++] = *p;
+    }
+    if (completions.count == 1) {
+        if (!as_command && completions.directory) text[text_length++] = '/';
+        else if (!quote) text[text_length++] = ' ';
+    }
+
+    // Still ambiguous after extending: the next Tab lists the matches
+    if (text_length > 0) {
+        insert(text, text_length);
+        editor.last_was_tab = completions.count > 1;
+        if (editor.last_was_tab) bell();
+    } else if (editor.last_was_tab) {
+        // Second Tab with nothing left to add: show the choices
+        list_completions(&completions);
+        editor.last_was_tab = false;
+    } else {
+        bell();
+        editor.last_was_tab = true;
+    }
+    completions_free(&completions);
+    line_editor_refresh();
+}
+
+// Handle one finished escape sequence (arrow keys and friends)
+static void escape_sequence(const char *seq, int length) {
+    char final = seq[length - 1];
+    if (length == 2) {
+        // Alt-b / Alt-f
+        if (final == 'b') editor.cursor = previous_word(editor.cursor);
+        else if (final == 'f') editor.cursor = next_word(editor.cursor);
+        return;
+    }
+    if (final == 'A' || final == 'B') {
+        history_step(final == 'A' ? -1 : 1);
+        return;
+    }
+    bool modified = memchr(seq, ';', length) != NULL;  // Ctrl or Alt held: ESC[1;5D
+    switch (final) {
+    case 'D':
+        editor.cursor = modified ? previous_word(editor.cursor) : previous_char(editor.cursor);
+        break;
+    case 'C':
+        editor.cursor = modified ? next_word(editor.cursor) : next_char(editor.cursor);
+        break;
+    case 'H':
+        editor.cursor = 0;
+        break;
+    case 'F':
+        editor.cursor = editor.length;
+        break;
+    case '~': {
+        int code = atoi(seq + 2);
+        if (code == 1 || code == 7) editor.cursor = 0;
+        else if (code == 4 || code == 8) editor.cursor = editor.length;
+        else if (code == 3 && editor.cursor < editor.length) erase(editor.cursor, next_char(editor.cursor));
+        break;
+    }
+    }
+}
+
+// Handle one input byte. Returns true once the line is complete.
+static bool key(char c, bool *eof) {
+    if (editor.sequence_length > 0) {
+        editor.sequence[editor.sequence_length++] = c;
+        const char *seq = editor.sequence;
+        int length = editor.sequence_length;
+        bool done = (length == 2 && seq[1] != '[' && seq[1] != 'O') ||
+                    (length == 3 && seq[1] == 'O') ||
+                    (length >= 3 && seq[1] == '[' && c >= 0x40 && c <= 0x7E);
+        if (done) {
+            if (seq[1] == 'O') editor.sequence[1] = '[';
+            editor.sequence[length] = '\0';
+            escape_sequence(editor.sequence, length);
+            editor.sequence_length = 0;
+            line_editor_refresh();
+        } else if (length == MAX_SEQUENCE - 1) {
+            editor.sequence_length = 0;
+        }
+        return false;
+    }
+
+    if (editor.searching && search_key(c)) return false;
+
+    if (c != '\t') editor.last_was_tab = false;
+    switch (c) {
+    case '\r':
+    case '\n':
+        editor.cursor = editor.length;
+        line_editor_refresh();
+        write(STDOUT_FILENO, "\n", 1);
+        return true;
+    case '\t':
+        complete();
+        return false;
+    case 27:  // ESC
+        editor.sequence[0] = c;
+        editor.sequence_length = 1;
+        return false;
+    case 4:   // Ctrl-D: end of input on an empty line, delete otherwise
+        if (editor.length == 0) {
+            *eof = true;
+            return true;
+        }
+        if (editor.cursor < editor.length) erase(editor.cursor, next_char(editor.cursor));
+        break;
+    case 127:
+    case 8:   // Backspace, Ctrl-H
+        if (editor.cursor > 0) erase(previous_char(editor.cursor), editor.cursor);
+        break;
+    case 1:   // Ctrl-A
+        editor.cursor = 0;
+        break;
+    case 5:   // Ctrl-E
+        editor.cursor = editor.length;
+        break;
+    case 2:   // Ctrl-B
+        editor.cursor = previous_char(editor.cursor);
+        break;
+    case 6:   // Ctrl-F
+        editor.cursor = next_char(editor.cursor);
+        break;
+    case 11:  // Ctrl-K
+        erase(editor.cursor, editor.length);
+        break;
+    case 21:  // Ctrl-U
+        erase(0, editor.cursor);
+        break;
+    case 23:  // Ctrl-W
+        erase(previous_word(editor.cursor), editor.cursor);
+        break;
+    case 16:  // Ctrl-P
+    case 14:  // Ctrl-N
+        history_step(c == 16 ? -1 : 1);
+        break;
+    case 18:  // Ctrl-R
+        start_search();
+        break;
+    default:
+        if ((unsigned char)c < 32) return false;
+        insert(&c, 1);
+        break;
+    }
+    line_editor_refresh();
+    return false;
+}
+
+// Read what the terminal has and edit with it. Returns the line once
+// Enter is pressed, or NULL with *eof set on Ctrl-D or end of input.
+char *line_editor_feed(bool *eof) {
+    *eof = false;
+    if (!line_editor_buffered()) {
+        ssize_t n = read(STDIN_FILENO, editor.input, sizeof(editor.input));
+        if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+            *eof = true;
+            return NULL;
+        }
+        editor.input_start = 0;
+        editor.input_end = n > 0 ? n : 0;
+    }
+
+    while (editor.input_start < editor.input_end) {
+        if (key(editor.input[editor.input_start++], eof)) {
+            if (*eof) return NULL;
+            char *line = strdup(editor.buffer);
+            line_editor_cancel();
+            return line;
+        }
+    }
+    return NULL;
+}
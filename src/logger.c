@@ -0,0 +1,422 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <zlib.h>
+
+#define LOG_COMMAND_MAX 96
+
+// What log_command hands to the writer thread: fixed-size and binary, so
+// recording a command is a copy into the ring
+typedef struct {
+    int64_t time_ns;       // CLOCK_REALTIME when the command finished
+    double seconds;        // wall time, or < 0 if unknown
+    int32_t status;        // wait status
+    int32_t pid;           // the shell that ran it
+    uint8_t kind;
+    char command[LOG_COMMAND_MAX];
+} LogEntry;
+
+// Single producer (the shell's main thread), single consumer (the writer),
+// as in the sampler's ring: head and tail each have one writer, no locks
+typedef struct {
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    _Alignas(64) LogEntry slots[LOG_RING_SIZE];
+} LogRing;
+
+static LogRing ring;
+static pthread_t thread;
+static bool running = false;
+static bool forked = false;        // in a child of the shell, which has no writer thread
+static int32_t shell_pid;
+static char *log_path;
+static int log_fd = -1;
+static int wake_fd = -1;           // the prompt wakes a parked writer
+static int stop_fd = -1;
+static _Atomic bool parked;
+
+static _Atomic int fsync_mode = LOG_FSYNC_INTERVAL;
+static _Atomic long fsync_interval_ms = LOG_FSYNC_INTERVAL_DEFAULT * 1000L;
+static _Atomic long long max_size = LOG_MAX_SIZE_DEFAULT;
+static _Atomic int keep_segments = LOG_KEEP_DEFAULT;
+
+static _Atomic unsigned long written, dropped, batches, syncs, rotations;
+
+static const char *KIND_NAMES[] = {"command", "pipeline", "builtin", "job"};
+
+static void in_child(void) {
+    forked = true;
+    running = false;
+    shell_pid = getpid();
+}
+
+// One JSON object per line: time, shell pid, kind, command, exit code or
+// signal, wall time
+static int format_entry(const LogEntry *entry, char *out, size_t size) {
+    time_t seconds = entry->time_ns / 1000000000LL;
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    char command[LOG_COMMAND_MAX * 6 + 1];
+    size_t n = 0;
+    for (const unsigned char *p = (const unsigned char *)entry->command; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            command[n++] = '\\';
+            command[n++] = *p;
+        } else if (*p < 0x20) {
+            n += snprintf(command + n, sizeof(command) - n, "\\u%04x", *p);
+        } else {
+            command[n++] = *p;
+        }
+    }
+    command[n] = '\0';
+
+    int length = snprintf(out, size, "{\"time\":\"%s.%03dZ\",\"shell\":%d,\"kind\":\"%s\",\"command\":\"%s\",",
+                          stamp, (int)(entry->time_ns / 1000000 % 1000), entry->pid,
+                          KIND_NAMES[entry->kind], command);
+    if (WIFSIGNALED(entry->status)) {
+        length += snprintf(out + length, size - length, "\"signal\":%d", WTERMSIG(entry->status));
+    } else {
+        length += snprintf(out + length, size - length, "\"exit\":%d", WEXITSTATUS(entry->status));
+    }
+    if (entry->seconds >= 0) {
+        length += snprintf(out + length, size - length, ",\"wall_ms\":%.3f", entry->seconds * 1e3);
+    }
+    length += snprintf(out + length, size - length, "}\n");
+    return length;
+}
+
+// Record a finished command. On the shell's side this is a clock read
+// (vDSO, no syscall) and a copy into the ring; a full ring drops the entry
+// and counts it rather than wait.
+void log_command(const char *command, LogKind kind, int status, double seconds) {
+    if (log_fd < 0) return;
+
+    LogEntry entry;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    entry.time_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    entry.seconds = seconds;
+    entry.status = status;
+    entry.pid = shell_pid;
+    entry.kind = kind;
+    snprintf(entry.command, sizeof(entry.command), "%s", command);
+
+    // A forked child (a script worker, a builtin pipeline stage) has no
+    // writer thread: write the line itself
+    if (forked) {
+        char line[LOG_COMMAND_MAX * 6 + 256];
+        int length = format_entry(&entry, line, sizeof(line));
+        if (write(log_fd, line, length) < 0) {}
+        return;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    if (head - tail == LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+    ring.slots[head & (LOG_RING_SIZE - 1)] = entry;
+    atomic_store(&ring.head, head + 1);
+}
+
+// The log's descriptor, which forked children keep to log by themselves;
+// -1 when not logging
+int logger_fd(void) {
+    return log_fd;
+}
+
+// Called between commands (before the prompt, between script lines): wake
+// the writer if it went to sleep with nothing to do and there is now
+void logger_poll(void) {
+    if (!running || !atomic_load(&parked)) return;
+    if (atomic_load(&ring.head) == atomic_load_explicit(&ring.tail, memory_order_relaxed)) return;
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {}
+}
+
+static bool same_file(void) {
+    struct stat open_st, path_st;
+    return fstat(log_fd, &open_st) == 0 && stat(log_path, &path_st) == 0 &&
+           open_st.st_dev == path_st.st_dev && open_st.st_ino == path_st.st_ino;
+}
+
+static void reopen(void) {
+    int fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    dup3(fd, log_fd, O_CLOEXEC);
+    close(fd);
+}
+
+// gzip `from` into `to` (through a temporary name) and remove `from`
+static void compress_segment(const char *from, const char *to) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", to);
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    int out_fd = in >= 0 ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600) : -1;
+    gzFile out = out_fd >= 0 ? gzdopen(out_fd, "wb6") : NULL;
+    if (out_fd >= 0 && !out) close(out_fd);
+    bool ok = out != NULL;
+
+    char buffer[65536];
+    ssize_t n;
+    while (ok && (n = read(in, buffer, sizeof(buffer))) > 0) {
+        ok = gzwrite(out, buffer, n) == n;
+    }
+    if (out) ok = gzclose(out) == Z_OK && ok;
+    if (in >= 0) close(in);
+
+    if (ok) rename(tmp, to);
+    else unlink(tmp);
+    unlink(from);
+}
+
+// Move the full log aside and start a new one. Segments shift up
+// (log.1.gz becomes log.2.gz, ...) and the oldest past the limit is
+// removed. Other shells writing the same log hold it shared while they
+// write, so none of them writes into a segment being compressed; they
+// notice the new file and reopen it.
+static void rotate(size_t incoming) {
+    flock(log_fd, LOCK_EX);
+    struct stat st;
+    if (!same_file() || fstat(log_fd, &st) != 0 ||
+        st.st_size + (long long)incoming <= atomic_load(&max_size)) {
+        // Another shell got here first
+        flock(log_fd, LOCK_UN);
+        return;
+    }
+
+    int keep = atomic_load(&keep_segments);
+    char from[PATH_MAX], to[PATH_MAX], raw[PATH_MAX];
+    snprintf(to, sizeof(to), "%s.%d.gz", log_path, keep);
+    unlink(to);
+    for (int i = keep - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d.gz", log_path, i);
+        snprintf(to, sizeof(to), "%s.%d.gz", log_path, i + 1);
+        rename(from, to);
+    }
+    snprintf(raw, sizeof(raw), "%s.%d.rotating", log_path, (int)shell_pid);
+    bool moved = rename(log_path, raw) == 0;
+    flock(log_fd, LOCK_UN);
+    reopen();
+    if (!moved) return;
+
+    atomic_fetch_add(&rotations, 1);
+    if (keep > 0) {
+        snprintf(to, sizeof(to), "%s.1.gz", log_path);
+        compress_segment(raw, to);
+    } else {
+        unlink(raw);
+    }
+}
+
+static bool dirty;
+static struct timespec last_sync;
+static long long log_size;         // of the log as of the last write
+
+static long ms_since(const struct timespec *then) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - then->tv_sec) * 1000 + (now.tv_nsec - then->tv_nsec) / 1000000;
+}
+
+static void sync_log(void) {
+    fdatasync(log_fd);
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
+    dirty = false;
+    atomic_fetch_add(&syncs, 1);
+}
+
+// Append one batch, rotating first if it would take the log past its size
+static void write_batch(const char *data, size_t length) {
+    // Settle on the current log, holding it shared: reopen it if another
+    // shell rotated it, rotate it if this batch would overfill it
+    struct stat st;
+    for (int attempt = 0;; attempt++) {
+        flock(log_fd, LOCK_SH);
+        if (attempt == 3) break;
+        if (!same_file()) {
+            flock(log_fd, LOCK_UN);
+            reopen();
+        } else if (fstat(log_fd, &st) == 0 && st.st_size > 0 &&
+                   st.st_size + (long long)length > atomic_load(&max_size)) {
+            flock(log_fd, LOCK_UN);
+            rotate(length);
+        } else {
+            break;
+        }
+    }
+
+    if (write(log_fd, data, length) == (ssize_t)length) dirty = true;
+    if (fstat(log_fd, &st) == 0) log_size = st.st_size;
+    flock(log_fd, LOCK_UN);
+    atomic_fetch_add(&batches, 1);
+
+    int mode = atomic_load(&fsync_mode);
+    if (mode == LOG_FSYNC_BATCH ||
+        (mode == LOG_FSYNC_INTERVAL && ms_since(&last_sync) >= atomic_load(&fsync_interval_ms))) {
+        sync_log();
+    }
+}
+
+// Format everything in the ring and write it out, a buffer at a time.
+// Returns the number of entries taken.
+static int drain(void) {
+    static char batch[LOG_BATCH_BYTES];
+    size_t used = 0;
+    int taken = 0;
+
+    for (;;) {
+        uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+        if (tail == head) break;
+
+        char line[LOG_COMMAND_MAX * 6 + 256];
+        int length = format_entry(&ring.slots[tail & (LOG_RING_SIZE - 1)], line, sizeof(line));
+        atomic_store_explicit(&ring.tail, tail + 1, memory_order_release);
+        taken++;
+
+        // A batch ends where the log would reach its rotation size, so
+        // segments stay close to it
+        if (used > 0 && (used + length > sizeof(batch) ||
+                         log_size + (long long)(used + length) > atomic_load(&max_size))) {
+            write_batch(batch, used);
+            used = 0;
+        }
+        memcpy(batch + used, line, length);
+        used += length;
+    }
+    if (used > 0) write_batch(batch, used);
+    atomic_fetch_add(&written, taken);
+    return taken;
+}
+
+// While commands are logging, collect them for LOG_FLUSH_MS and write
+// them as one batch; with nothing coming in, sleep until the prompt wakes
+// us (or a pending interval fsync is due)
+static void *writer_main(void *arg) {
+    (void)arg;
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
+    int timeout = LOG_FLUSH_MS;
+
+    for (;;) {
+        struct pollfd fds[2] = {{.fd = stop_fd, .events = POLLIN}, {.fd = wake_fd, .events = POLLIN}};
+        if (poll(fds, 2, timeout) > 0) {
+            if (fds[0].revents) break;
+            uint64_t count;
+            if (read(wake_fd, &count, sizeof(count)) < 0) {}
+        }
+        atomic_store(&parked, false);
+
+        if (drain() > 0) {
+            timeout = LOG_FLUSH_MS;
+            continue;
+        }
+
+        // Nothing new: sleep until woken, or until a pending fsync is due
+        timeout = -1;
+        if (dirty && atomic_load(&fsync_mode) == LOG_FSYNC_INTERVAL) {
+            long wait = atomic_load(&fsync_interval_ms) - ms_since(&last_sync);
+            if (wait <= 0) sync_log();
+            else timeout = wait;
+        }
+
+        // Unless something arrived while deciding to
+        atomic_store(&parked, true);
+        if (atomic_load(&ring.head) != atomic_load(&ring.tail)) timeout = 0;
+    }
+
+    drain();
+    if (dirty && atomic_load(&fsync_mode) != LOG_FSYNC_NEVER) sync_log();
+    return NULL;
+}
+
+// Open the log and start the writer. Without it, commands go unlogged.
+bool logger_start(const char *path) {
+    if (running) return true;
+    log_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    log_path = strdup(path);
+    shell_pid = getpid();
+    if (log_fd < 0 || wake_fd < 0 || stop_fd < 0 || !log_path) {
+        logger_stop();
+        return false;
+    }
+    struct stat st;
+    log_size = fstat(log_fd, &st) == 0 ? st.st_size : 0;
+
+    // Children keep logging on their own; an exit without cleanup_shell
+    // (end of input) still writes out the queue
+    static bool registered = false;
+    if (!registered) {
+        pthread_atfork(NULL, NULL, in_child);
+        atexit(logger_stop);
+        registered = true;
+    }
+
+    // Signals stay with the main thread, where the event loop reads them
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    running = pthread_create(&thread, NULL, writer_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (!running) logger_stop();
+    return running;
+}
+
+// Write out what is queued and stop the writer
+void logger_stop(void) {
+    if (running) {
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) < 0) {}
+        pthread_join(thread, NULL);
+        running = false;
+    }
+    if (forked) return;
+    if (log_fd >= 0) close(log_fd);
+    if (wake_fd >= 0) close(wake_fd);
+    if (stop_fd >= 0) close(stop_fd);
+    log_fd = wake_fd = stop_fd = -1;
+    free(log_path);
+    log_path = NULL;
+}
+
+void logger_set_fsync(LogFsync mode, double interval) {
+    atomic_store(&fsync_mode, mode);
+    if (mode == LOG_FSYNC_INTERVAL) atomic_store(&fsync_interval_ms, (long)(interval * 1000));
+}
+
+void logger_set_rotation(long long bytes, int keep) {
+    atomic_store(&max_size, bytes);
+    atomic_store(&keep_segments, keep);
+}
+
+void display_log_status(void) {
+    if (!log_path) {
+        printf("Command log is not open\n");
+        return;
+    }
+
+    struct stat st;
+    int mode = atomic_load(&fsync_mode);
+    printf("Command log: %s (%lld bytes)\n", log_path, stat(log_path, &st) == 0 ? (long long)st.st_size : 0LL);
+    printf("  records written: %lu in %lu batches, %lu dropped (ring full)\n",
+           atomic_load(&written), atomic_load(&batches), atomic_load(&dropped));
+    if (mode == LOG_FSYNC_INTERVAL) {
+        printf("  fsync: every %.1f s (%lu so far)\n", atomic_load(&fsync_interval_ms) / 1000.0, atomic_load(&syncs));
+    } else {
+        printf("  fsync: %s (%lu so far)\n", mode == LOG_FSYNC_BATCH ? "after every batch" : "never", atomic_load(&syncs));
+    }
+    printf("  rotation: at %lld bytes, keeping %d gzip'ed segments (%lu rotations)\n",
+           atomic_load(&max_size), atomic_load(&keep_segments), atomic_load(&rotations));
+}
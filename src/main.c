@@ -4,11 +4,23 @@ int main(int argc, char *argv[]) {
     ShellState state;
     initialize_shell(&state);
 
-    if (argc > 1) {
+    // -j N runs independent script lines N at a time
+    int arg = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        state.script_jobs = atoi(argv[2]);
+        if (state.script_jobs < 1) {
+            printf("Usage: edushell [-j jobs] script.esh\n");
+            cleanup_shell(&state);
+            return 1;
+        }
+        arg = 3;
+    }
+
+    if (argc > arg) {
         // Check if file ends with .esh
-        const char *ext = strrchr(argv[1], '.');
+        const char *ext = strrchr(argv[arg], '.');
         if (ext && strcmp(ext, ".esh") == 0) {
-            execute_script(argv[1], &state);
+            execute_script(argv[arg], &state);
         } else {
             printf("Error: Script file must have .esh extension\n");
         }
@@ -0,0 +1,251 @@
+#include "edushell.h"
+
+// Every Command of a line fits in one fixed block that is reused per line
+#define PARSE_ARENA_SIZE (sizeof(Pipeline) + MAX_PIPELINE_STAGES * sizeof(Command) + 64)
+
+typedef enum {
+    TOK_WORD,
+    TOK_PIPE,
+    TOK_INPUT,
+    TOK_OUTPUT,
+    TOK_APPEND,
+    TOK_BACKGROUND,
+    TOK_END,
+    TOK_ERROR
+} TokenType;
+
+// Reentrant cursor over a line that is unquoted in place. Unquoting never
+// makes a word longer, so the output always trails the input; the one char
+// a terminating NUL may overwrite (an operator right after a word) is kept
+// in `saved`.
+typedef struct {
+    char *pos;
+    char saved;
+    bool quiet;     // don't report syntax errors
+} Tokenizer;
+
+void arena_init(Arena *arena, size_t size) {
+    arena->base = malloc(size);
+    arena->size = arena->base ? size : 0;
+    arena->used = 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (arena->used + size > arena->size) return NULL;
+
+    void *p = arena->base + arena->used;
+    arena->used += size;
+    return p;
+}
+
+void arena_reset(Arena *arena) {
+    arena->used = 0;
+}
+
+void arena_free(Arena *arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = arena->used = 0;
+}
+
+void parse_arena_init(Arena *arena) {
+    arena_init(arena, PARSE_ARENA_SIZE);
+}
+
+static char peek(const Tokenizer *t) {
+    return t->saved ? t->saved : *t->pos;
+}
+
+static void advance(Tokenizer *t) {
+    t->saved = 0;
+    t->pos++;
+}
+
+// Characters that end an unquoted word
+static const unsigned char WORD_END[256] = {
+    ['\0'] = 1, [' '] = 1, ['\t'] = 1,
+    ['|'] = 1, ['<'] = 1, ['>'] = 1, ['&'] = 1
+};
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static bool is_operator(char c) {
+    return c == '|' || c == '<' || c == '>' || c == '&';
+}
+
+static TokenType next_token(Tokenizer *t, char **word) {
+    while (is_blank(peek(t))) advance(t);
+
+    char c = peek(t);
+    switch (c) {
+        case '\0': return TOK_END;
+        case '|': advance(t); return TOK_PIPE;
+        case '<': advance(t); return TOK_INPUT;
+        case '&': advance(t); return TOK_BACKGROUND;
+        case '>':
+            advance(t);
+            if (peek(t) == '>') {
+                advance(t);
+                return TOK_APPEND;
+            }
+            return TOK_OUTPUT;
+    }
+
+    // A word never starts right after a saved operator, so the scan can
+    // run on a plain pointer
+    char *src = t->pos;
+    char *dst = src;
+    *word = dst;
+
+    while (!WORD_END[(unsigned char)(c = *src)]) {
+        if (c == '\'') {
+            // Single quotes: everything literal up to the closing quote
+            for (src++; *src != '\''; src++) {
+                if (*src == '\0') return TOK_ERROR;
+                *dst++ = *src;
+            }
+            src++;
+        } else if (c == '"') {
+            // Double quotes: only \" \\ \$ and \` are escapes
+            for (src++; *src != '"'; src++) {
+                if (*src == '\0') return TOK_ERROR;
+                if (*src == '\\' && src[1] != '\0' && strchr("\"\\$`", src[1])) src++;
+                *dst++ = *src;
+            }
+            src++;
+        } else if (c == '\\' && src[1] != '\0') {
+            *dst++ = src[1];
+            src += 2;
+        } else {
+            *dst++ = *src++;
+        }
+    }
+
+    t->pos = src;
+    if (dst == src && c != '\0') {
+        // The terminator is about to be overwritten; remember operators
+        if (is_operator(c)) t->saved = c;
+        else t->pos++;
+    }
+    *dst = '\0';
+    return TOK_WORD;
+}
+
+static void init_command(Command *cmd) {
+    cmd->arg_count = 0;
+    cmd->is_background = false;
+    cmd->input_file = NULL;
+    cmd->output_file = NULL;
+    cmd->append_output = false;
+}
+
+// Fill cmd from the tokenizer up to the next '|' or the end of the line.
+// Returns the token that stopped it, or TOK_ERROR after reporting why.
+static TokenType parse_stage(Tokenizer *t, Command *cmd) {
+    init_command(cmd);
+
+    TokenType type;
+    char *word = NULL;
+    while ((type = next_token(t, &word)) != TOK_END && type != TOK_PIPE) {
+        if (type == TOK_ERROR) {
+            if (!t->quiet) printf("Syntax error: unterminated quote\n");
+            break;
+        }
+
+        if (type == TOK_INPUT || type == TOK_OUTPUT || type == TOK_APPEND) {
+            if (next_token(t, &word) != TOK_WORD) {
+                if (!t->quiet) printf("Syntax error: missing file name after '%s'\n",
+                       type == TOK_INPUT ? "<" : type == TOK_OUTPUT ? ">" : ">>");
+                type = TOK_ERROR;
+                break;
+            }
+            if (type == TOK_INPUT) {
+                cmd->input_file = word;
+            } else {
+                cmd->output_file = word;
+                cmd->append_output = type == TOK_APPEND;
+            }
+        } else if (type == TOK_BACKGROUND) {
+            // '&' ends the command, as it always has: anything after it up
+            // to the next '|' is dropped
+            cmd->is_background = true;
+            while ((type = next_token(t, &word)) != TOK_END && type != TOK_PIPE &&
+                   type != TOK_ERROR) {}
+            if (type == TOK_ERROR && !t->quiet) printf("Syntax error: unterminated quote\n");
+            break;
+        } else if (cmd->arg_count < MAX_ARGS - 1) {
+            cmd->args[cmd->arg_count++] = word;
+        }
+    }
+    cmd->args[cmd->arg_count] = NULL;
+    return type;
+}
+
+// Parse a single command. Tokens point into line, so the returned Command
+// is the only allocation; release it with free_command.
+Command *parse_command(char *line) {
+    Command *cmd = malloc(sizeof(Command));
+    if (!cmd) {
+        handle_error("Memory allocation error");
+        return NULL;
+    }
+
+    Tokenizer t = {line, 0, false};
+    TokenType type = parse_stage(&t, cmd);
+    if (type == TOK_PIPE) {
+        printf("Pipelines are not supported here\n");
+    }
+    if (type != TOK_END) {
+        free(cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+static Pipeline *parse_line(char *line, Arena *arena, bool quiet) {
+    arena_reset(arena);
+    Pipeline *pipeline = arena_alloc(arena, sizeof(Pipeline));
+    if (!pipeline) {
+        handle_error("Memory allocation error");
+        return NULL;
+    }
+    pipeline->stage_count = 0;
+
+    Tokenizer t = {line, 0, quiet};
+    TokenType type = TOK_PIPE;
+    while (type == TOK_PIPE) {
+        if (pipeline->stage_count == MAX_PIPELINE_STAGES) {
+            if (!quiet) printf("Too many pipeline stages (max %d)\n", MAX_PIPELINE_STAGES);
+            return NULL;
+        }
+
+        Command *cmd = arena_alloc(arena, sizeof(Command));
+        if (!cmd) return NULL;
+        pipeline->stages[pipeline->stage_count++] = cmd;
+
+        type = parse_stage(&t, cmd);
+        if (type == TOK_ERROR) return NULL;
+
+        if (cmd->arg_count == 0 && (type == TOK_PIPE || pipeline->stage_count > 1)) {
+            if (!quiet) printf("Syntax error near '|'\n");
+            return NULL;
+        }
+    }
+
+    pipeline->is_background = pipeline->stages[pipeline->stage_count - 1]->is_background;
+    return pipeline;
+}
+
+// Parse a whole line into a Pipeline allocated from arena. The arena is
+// reset first; tokens point into line, which must outlive the result.
+Pipeline *parse_pipeline(char *line, Arena *arena) {
+    return parse_line(line, arena, false);
+}
+
+// Same, but returns NULL on a syntax error without reporting it
+Pipeline *parse_pipeline_quiet(char *line, Arena *arena) {
+    return parse_line(line, arena, true);
+}
@@ -0,0 +1,258 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include <signal.h>
+
+#define PUMP_CHUNK (64 * 1024)
+
+static bool is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+// `tee FILE` and `tee -a FILE` are run by the shell itself so the data can
+// be duplicated with tee(2) and drained with splice(2) without ever being
+// copied into user space.
+static bool is_tee_stage(const Command *cmd) {
+    if (strcmp(cmd->args[0], "tee") != 0) return false;
+    if (cmd->arg_count == 2) return strcmp(cmd->args[1], "-a") != 0;
+    return cmd->arg_count == 3 && strcmp(cmd->args[1], "-a") == 0;
+}
+
+static bool runs_in_shell(const Command *cmd) {
+    return is_builtin(cmd) || is_tee_stage(cmd);
+}
+
+// A stage run in the shell process itself mustn't change the shell: `cd`,
+// `exit` or `monitor on` in a pipeline act on a forked copy instead, as
+// they would in a subshell.
+static bool safe_in_shell(const Command *cmd) {
+    if (is_tee_stage(cmd)) return true;
+    const Builtin *builtin = is_builtin(cmd) ? find_builtin(cmd->args[0]) : NULL;
+    return builtin && !(builtin->flags & BUILTIN_SHELL_STATE);
+}
+
+// Move exactly len bytes out of pipe in_fd. splice() can't target every
+// kind of fd (some terminals), so fall back to a bounce buffer there.
+static bool splice_exact(int in_fd, int out_fd, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL) {
+            char buf[PUMP_CHUNK];
+            n = read(in_fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+            if (n <= 0 || write(out_fd, buf, n) != n) return false;
+        } else if (n <= 0) {
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+// Copy everything arriving on in_fd to both out_fd and file_fd
+static bool pump_tee(int in_fd, int out_fd, int file_fd) {
+    if (!is_pipe(in_fd)) {
+        // tee(2) needs a pipe on the input side
+        char buf[PUMP_CHUNK];
+        ssize_t n;
+        while ((n = read(in_fd, buf, sizeof(buf))) > 0) {
+            if (write(out_fd, buf, n) != n || write(file_fd, buf, n) != n) return false;
+        }
+        return n == 0;
+    }
+
+    // tee(2) also needs a pipe on the output side; bridge through one if the
+    // stage writes to the terminal or a regular file.
+    int bridge[2] = {-1, -1};
+    int dup_fd = out_fd;
+    if (!is_pipe(out_fd)) {
+        if (pipe2(bridge, O_CLOEXEC) != 0) return false;
+        dup_fd = bridge[1];
+    }
+
+    bool ok = true;
+    while (ok) {
+        ssize_t n = tee(in_fd, dup_fd, PUMP_CHUNK, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        // The duplicate is queued; now consume the original into the file
+        ok = splice_exact(in_fd, file_fd, n);
+        if (ok && bridge[0] >= 0) {
+            ok = splice_exact(bridge[0], out_fd, n);
+        }
+    }
+
+    if (bridge[0] >= 0) {
+        close(bridge[0]);
+        close(bridge[1]);
+    }
+    return ok;
+}
+
+static int run_tee(const Command *cmd, int in_fd, int out_fd) {
+    bool append = cmd->arg_count == 3;
+    const char *file = cmd->args[cmd->arg_count - 1];
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    int file_fd = open(file, flags, 0644);
+    if (file_fd < 0) {
+        handle_error("Could not open tee output file");
+        return 1;
+    }
+
+    bool ok = pump_tee(in_fd, out_fd, file_fd);
+    close(file_fd);
+    return ok ? 0 : 1;
+}
+
+// Run a builtin or tee stage with the shell's own stdin/stdout temporarily
+// pointed at the stage's pipe ends.
+static int run_stage_in_shell(Command *cmd, int in_fd, int out_fd, ShellState *state) {
+    fflush(stdout);
+
+    // A reader that goes away early must not take the shell down with it
+    void (*old_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+
+    int status = 0;
+    if (is_tee_stage(cmd)) {
+        status = run_tee(cmd, in_fd >= 0 ? in_fd : STDIN_FILENO,
+                         out_fd >= 0 ? out_fd : STDOUT_FILENO);
+    } else {
+        int saved_in = dup(STDIN_FILENO);
+        int saved_out = dup(STDOUT_FILENO);
+        if (in_fd >= 0) dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+
+        run_builtin(cmd, state, &status);
+
+        fflush(stdout);
+        dup2(saved_in, STDIN_FILENO);
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_in);
+        close(saved_out);
+    }
+
+    signal(SIGPIPE, old_pipe);
+    return status;
+}
+
+// Only one in-shell stage can run without risking a deadlock against
+// another one, so any extra builtin stages get a process of their own.
+static pid_t fork_stage(Command *cmd, int in_fd, int out_fd, ShellState *state) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        reset_child_signals();
+
+        // Keep only this stage's pipe ends, or readers never see EOF, and
+        // the command log, so the stage's builtin is still logged
+        if (in_fd >= 0) dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+        int log_fd = logger_fd();
+        if (log_fd > STDERR_FILENO + 1) close_range(STDERR_FILENO + 1, log_fd - 1, 0);
+        close_range(log_fd > STDERR_FILENO ? log_fd + 1 : STDERR_FILENO + 1, ~0U, 0);
+        exit(run_stage_in_shell(cmd, -1, -1, state));
+    } else if (pid < 0) {
+        handle_error("Fork failed");
+    }
+    return pid;
+}
+
+static pid_t launch_external(Command *cmd, int in_fd, int out_fd, ShellState *state) {
+    char path[MAX_PATH_LENGTH];
+    if (!find_command_path(cmd->args[0], path, sizeof(path))) {
+        fprintf(stderr, COLOR_RED "%s: command not found\n" COLOR_RESET, cmd->args[0]);
+        return -1;
+    }
+    return spawn_command(cmd, path, in_fd, out_fd, state);
+}
+
+// Launch every stage concurrently, connected by O_CLOEXEC pipes, and wait on
+// the pipeline as a unit. Returns the exit status of the last stage; when
+// stage_status is non-NULL it receives each stage's own status.
+int execute_pipeline(Pipeline *pipeline, ShellState *state, int *stage_status) {
+    int n = pipeline->stage_count;
+    int pipes[MAX_PIPELINE_STAGES - 1][2];
+    pid_t pids[MAX_PIPELINE_STAGES];
+    int statuses[MAX_PIPELINE_STAGES];
+
+    for (int i = 0; i < n - 1; i++) {
+        if (pipe2(pipes[i], O_CLOEXEC) != 0) {
+            handle_error("Could not create pipe");
+            for (int j = 0; j < i; j++) {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            return 1;
+        }
+    }
+
+    // At most one in-shell stage that leaves the shell's state alone runs
+    // in the shell itself, and never for a background pipeline
+    int shell_stage = -1;
+    for (int i = 0; i < n && !pipeline->is_background; i++) {
+        if (safe_in_shell(pipeline->stages[i])) {
+            shell_stage = i;
+            break;
+        }
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < n; i++) {
+        Command *cmd = pipeline->stages[i];
+        int in_fd = i > 0 ? pipes[i - 1][0] : -1;
+        int out_fd = i < n - 1 ? pipes[i][1] : -1;
+
+        pids[i] = -1;
+        statuses[i] = 1;
+        if (i == shell_stage) continue;
+
+        if (runs_in_shell(cmd)) {
+            pids[i] = fork_stage(cmd, in_fd, out_fd, state);
+        } else {
+            pids[i] = launch_external(cmd, in_fd, out_fd, state);
+        }
+        if (pids[i] < 0) statuses[i] = 127;
+    }
+
+    // Drop the shell's copies so every reader sees EOF once its writer exits
+    for (int i = 0; i < n - 1; i++) {
+        if (i != shell_stage - 1) close(pipes[i][0]);
+        if (i != shell_stage) close(pipes[i][1]);
+    }
+
+    if (shell_stage >= 0) {
+        int in_fd = shell_stage > 0 ? pipes[shell_stage - 1][0] : -1;
+        int out_fd = shell_stage < n - 1 ? pipes[shell_stage][1] : -1;
+        statuses[shell_stage] = run_stage_in_shell(pipeline->stages[shell_stage],
+                                                   in_fd, out_fd, state);
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+    }
+
+    if (pipeline->is_background) {
+        jobs_add(pipeline->stages, pids, n);
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (pids[i] <= 0) continue;
+        CommandUsage usage;
+        int status = wait_for_command(pids[i], &usage);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        log_command(pipeline->stages[i]->args[0], LOG_PIPELINE, status,
+                    (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+        if (state->analytics_enabled) {
+            track_command_usage(pipeline->stages[i]->args[0], &usage);
+        }
+        statuses[i] = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+
+    if (stage_status) {
+        memcpy(stage_status, statuses, n * sizeof(int));
+    }
+    return statuses[n - 1];
+}
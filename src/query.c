@@ -0,0 +1,464 @@
+#include "analytics.h"
+#include "edushell.h"
+
+#define QUERY_DEFAULT_LIMIT 20
+#define QUERY_INITIAL_SLOTS 64
+
+typedef enum { GROUP_NONE, GROUP_COMMAND, GROUP_HOUR, GROUP_DAY } QueryGrouping;
+
+typedef enum {
+    SORT_DEFAULT, SORT_TIME, SORT_COUNT, SORT_ERRORS, SORT_P50, SORT_P90, SORT_P99,
+    SORT_MAX, SORT_CPU
+} QuerySort;
+
+typedef struct {
+    const char *command;        // exact command name, or NULL for all
+    int64_t since, until;       // window of event timestamps, inclusive
+    int status;                 // -1 any, 0 only successes, 1 only errors
+    QueryGrouping group;
+    QuerySort sort;
+    int limit;
+} QuerySpec;
+
+// One row of a grouped query
+typedef struct {
+    char name[64];              // command, when grouping by command
+    int64_t bucket;             // start of the hour or day otherwise
+    unsigned int hash;
+    uint64_t runs;
+    uint64_t errors;
+    uint64_t measured_runs;
+    double cpu_time;
+    LatencyHistogram latency;
+} QueryGroup;
+
+typedef struct {
+    double key;
+    int slot;
+} HeapEntry;
+
+// Keeps the `limit` largest keys seen: a min-heap whose root is the entry
+// to evict, so selecting the top K of N rows costs O(N log K)
+typedef struct {
+    HeapEntry *entries;
+    int count;
+    int limit;
+} TopK;
+
+typedef struct {
+    const QuerySpec *spec;
+    QueryGroup *groups;
+    int group_count;
+    int group_capacity;
+    int *slots;
+    int slot_count;
+    long utc_offset;            // local time zone, for hour and day buckets
+    StoredEvent *rows;          // kept executions, for ungrouped queries
+    TopK top;
+    uint64_t matched;
+} QueryRun;
+
+static void heap_sift_down(TopK *top, int i) {
+    for (;;) {
+        int smallest = i, left = 2 * i + 1, right = left + 1;
+        if (left < top->count && top->entries[left].key < top->entries[smallest].key) smallest = left;
+        if (right < top->count && top->entries[right].key < top->entries[smallest].key) smallest = right;
+        if (smallest == i) return;
+        HeapEntry tmp = top->entries[i];
+        top->entries[i] = top->entries[smallest];
+        top->entries[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void heap_sift_up(TopK *top, int i) {
+    while (i > 0 && top->entries[(i - 1) / 2].key > top->entries[i].key) {
+        HeapEntry tmp = top->entries[i];
+        top->entries[i] = top->entries[(i - 1) / 2];
+        top->entries[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+// Offer a row; false when it doesn't beat the K kept so far. Once full,
+// an accepted row evicts the smallest one.
+static bool topk_offer(TopK *top, double key, int slot) {
+    if (top->count < top->limit) {
+        top->entries[top->count] = (HeapEntry){key, slot};
+        heap_sift_up(top, top->count++);
+        return true;
+    }
+    if (top->limit == 0 || key <= top->entries[0].key) return false;
+
+    top->entries[0] = (HeapEntry){key, slot};
+    heap_sift_down(top, 0);
+    return true;
+}
+
+// Empty the heap into descending key order
+static int topk_drain(TopK *top) {
+    int count = top->count;
+    while (top->count > 1) {
+        HeapEntry tmp = top->entries[0];
+        top->entries[0] = top->entries[--top->count];
+        top->entries[top->count] = tmp;
+        heap_sift_down(top, 0);
+    }
+    top->count = 0;
+    return count;
+}
+
+static unsigned int group_hash(const char *name, int64_t bucket) {
+    unsigned int h = 2166136261u;  // FNV-1a
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    for (int i = 0; i < 8; i++) {
+        h ^= (unsigned char)(bucket >> (8 * i));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool resize_group_slots(QueryRun *run, int slot_count) {
+    int *slots = calloc(slot_count, sizeof(int));
+    if (!slots) return false;
+    for (int i = 0; i < run->group_count; i++) {
+        unsigned int slot = run->groups[i].hash & (slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i + 1;
+    }
+    free(run->slots);
+    run->slots = slots;
+    run->slot_count = slot_count;
+    return true;
+}
+
+// Same open-addressing scheme as the command stats table
+static QueryGroup *find_group(QueryRun *run, const char *name, int64_t bucket) {
+    unsigned int hash = group_hash(name, bucket);
+    int mask = run->slot_count - 1;
+    unsigned int slot = hash & mask;
+    if (run->slot_count > 0) {
+        for (; run->slots[slot]; slot = (slot + 1) & mask) {
+            QueryGroup *group = &run->groups[run->slots[slot] - 1];
+            if (group->hash == hash && group->bucket == bucket && strcmp(group->name, name) == 0) {
+                return group;
+            }
+        }
+    }
+
+    if (run->group_count == run->group_capacity) {
+        int capacity = run->group_capacity ? run->group_capacity * 2 : 32;
+        QueryGroup *groups = realloc(run->groups, capacity * sizeof(QueryGroup));
+        if (!groups) return NULL;
+        run->groups = groups;
+        run->group_capacity = capacity;
+    }
+    if ((run->group_count + 1) * 2 > run->slot_count) {
+        if (!resize_group_slots(run, run->slot_count ? run->slot_count * 2 : QUERY_INITIAL_SLOTS)) {
+            return NULL;
+        }
+        mask = run->slot_count - 1;
+        for (slot = hash & mask; run->slots[slot]; slot = (slot + 1) & mask) {}
+    }
+
+    QueryGroup *group = &run->groups[run->group_count];
+    memset(group, 0, sizeof(*group));
+    strncpy(group->name, name, sizeof(group->name) - 1);
+    group->bucket = bucket;
+    group->hash = hash;
+    run->slots[slot] = ++run->group_count;
+    return group;
+}
+
+static int64_t time_bucket(const QueryRun *run, int64_t timestamp) {
+    int64_t width = run->spec->group == GROUP_DAY ? 86400 : 3600;
+    int64_t local = timestamp + run->utc_offset;
+    return local - (local % width) - run->utc_offset;
+}
+
+static double group_key(const QueryGroup *group, QuerySort sort) {
+    switch (sort) {
+        case SORT_TIME:   return group->bucket;  // keeps the latest, printed oldest first
+        case SORT_ERRORS: return group->runs ? (double)group->errors / group->runs : 0.0;
+        case SORT_P50:    return histogram_percentile(&group->latency, 50);
+        case SORT_P90:    return histogram_percentile(&group->latency, 90);
+        case SORT_P99:    return histogram_percentile(&group->latency, 99);
+        case SORT_MAX:    return group->latency.max_us;
+        case SORT_CPU:    return group->measured_runs ? group->cpu_time / group->measured_runs : 0.0;
+        default:          return group->runs;
+    }
+}
+
+static const char *format_latency(double seconds, char *buf, size_t size) {
+    if (seconds < 1e-3) snprintf(buf, size, "%.0fus", seconds * 1e6);
+    else if (seconds < 1.0) snprintf(buf, size, "%.3gms", seconds * 1e3);
+    else snprintf(buf, size, "%.3gs", seconds);
+    return buf;
+}
+
+static void print_execution(const StoredEvent *event) {
+    char when[32], latency[16];
+    time_t timestamp = event->timestamp;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&timestamp));
+    printf("%-20s %-20s %-8s %-10s\n", when, event->command.name,
+           event->flags & EVENT_FLAG_ERROR ? "error" : "ok",
+           format_latency(event->command.seconds, latency, sizeof(latency)));
+}
+
+static bool event_matches(const QuerySpec *spec, const StoredEvent *event, const char *name) {
+    if (event->timestamp < spec->since || event->timestamp > spec->until) return false;
+    if (spec->command && strncmp(name, spec->command, 63) != 0) return false;
+    return true;
+}
+
+static void query_event(const StoredEvent *event, void *context) {
+    QueryRun *run = context;
+    const QuerySpec *spec = run->spec;
+
+    if (event->type == EVENT_USAGE) {
+        // CPU belongs to the group but can't be split by exit status
+        if (spec->group == GROUP_NONE || spec->status >= 0) return;
+        if (!event_matches(spec, event, event->usage.name)) return;
+        QueryGroup *group = spec->group == GROUP_COMMAND
+                                ? find_group(run, event->usage.name, 0)
+                                : find_group(run, "", time_bucket(run, event->timestamp));
+        if (group) {
+            group->measured_runs++;
+            group->cpu_time += event->usage.user_time + event->usage.sys_time;
+        }
+        return;
+    }
+    if (event->type != EVENT_COMMAND || !event_matches(spec, event, event->command.name)) return;
+
+    bool had_error = event->flags & EVENT_FLAG_ERROR;
+    if (spec->status >= 0 && had_error != (spec->status == 1)) return;
+    run->matched++;
+
+    if (spec->group == GROUP_NONE) {
+        if (spec->sort == SORT_TIME) {
+            // Log order is time order: a ring of the last K holds the newest
+            run->rows[(run->matched - 1) % spec->limit] = *event;
+            return;
+        }
+        // A row that gets in takes over the storage of the one it evicts
+        int slot = run->top.count < run->top.limit ? run->top.count : run->top.entries[0].slot;
+        if (topk_offer(&run->top, event->command.seconds, slot)) run->rows[slot] = *event;
+        return;
+    }
+
+    QueryGroup *group = spec->group == GROUP_COMMAND
+                            ? find_group(run, event->command.name, 0)
+                            : find_group(run, "", time_bucket(run, event->timestamp));
+    if (!group) return;
+    group->runs++;
+    if (had_error) group->errors++;
+    histogram_record(&group->latency, event->command.seconds);
+}
+
+// "90s", "15m", "2h", "7d" -> seconds; false for anything else
+static bool parse_duration(const char *text, int64_t *seconds) {
+    char *end;
+    long long value = strtoll(text, &end, 10);
+    if (end == text || value < 0) return false;
+
+    switch (*end) {
+        case 's': value *= 1; break;
+        case 'm': value *= 60; break;
+        case 'h': value *= 3600; break;
+        case 'd': value *= 86400; break;
+        case 'w': value *= 7 * 86400; break;
+        default:  return false;
+    }
+    if (end[1] != '\0') return false;
+    *seconds = value;
+    return true;
+}
+
+static bool parse_query(char **args, int arg_count, QuerySpec *spec) {
+    static const struct {
+        const char *name;
+        QuerySort sort;
+    } SORTS[] = {
+        {"time", SORT_TIME}, {"count", SORT_COUNT}, {"errors", SORT_ERRORS},
+        {"p50", SORT_P50}, {"p90", SORT_P90}, {"p99", SORT_P99}, {"max", SORT_MAX},
+        {"cpu", SORT_CPU}, {"latency", SORT_MAX},
+    };
+    int64_t now = time(NULL);
+
+    memset(spec, 0, sizeof(*spec));
+    spec->since = INT64_MIN;
+    spec->until = INT64_MAX;
+    spec->status = -1;
+    spec->group = GROUP_COMMAND;
+    spec->limit = QUERY_DEFAULT_LIMIT;
+
+    for (int i = 0; i < arg_count; i++) {
+        char *value = strchr(args[i], '=');
+        if (!value) return false;
+        size_t key_len = value++ - args[i];
+        int64_t seconds;
+
+        if (strncmp(args[i], "command", key_len) == 0 && key_len == 7) {
+            spec->command = value;
+        } else if (strncmp(args[i], "since", key_len) == 0 && key_len == 5) {
+            if (!parse_duration(value, &seconds)) return false;
+            spec->since = now - seconds;
+        } else if (strncmp(args[i], "until", key_len) == 0 && key_len == 5) {
+            if (!parse_duration(value, &seconds)) return false;
+            spec->until = now - seconds;
+        } else if (strncmp(args[i], "status", key_len) == 0 && key_len == 6) {
+            if (strcmp(value, "error") == 0) spec->status = 1;
+            else if (strcmp(value, "ok") == 0) spec->status = 0;
+            else if (strcmp(value, "any") != 0) return false;
+        } else if (strncmp(args[i], "by", key_len) == 0 && key_len == 2) {
+            if (strcmp(value, "command") == 0) spec->group = GROUP_COMMAND;
+            else if (strcmp(value, "hour") == 0) spec->group = GROUP_HOUR;
+            else if (strcmp(value, "day") == 0) spec->group = GROUP_DAY;
+            else if (strcmp(value, "none") == 0) spec->group = GROUP_NONE;
+            else return false;
+        } else if (strncmp(args[i], "sort", key_len) == 0 && key_len == 4) {
+            size_t j;
+            for (j = 0; j < sizeof(SORTS) / sizeof(SORTS[0]); j++) {
+                if (strcmp(value, SORTS[j].name) == 0) break;
+            }
+            if (j == sizeof(SORTS) / sizeof(SORTS[0])) return false;
+            spec->sort = SORTS[j].sort;
+        } else if (strncmp(args[i], "top", key_len) == 0 && key_len == 3) {
+            spec->limit = atoi(value);
+            if (spec->limit <= 0) return false;
+        } else {
+            return false;
+        }
+    }
+
+    if (spec->sort == SORT_DEFAULT) {
+        spec->sort = spec->group == GROUP_COMMAND ? SORT_COUNT : SORT_TIME;
+    }
+    // A single run has no count, error rate or CPU of its own to rank by
+    if (spec->group == GROUP_NONE &&
+        (spec->sort == SORT_COUNT || spec->sort == SORT_ERRORS || spec->sort == SORT_CPU)) {
+        return false;
+    }
+    return true;
+}
+
+static void print_query_usage(void) {
+    printf("Usage: analytics query [command=NAME] [since=DUR] [until=DUR] [status=ok|error]\n"
+           "                       [by=command|hour|day|none] [sort=KEY] [top=N]\n"
+           "  DUR is a time ago like 90s, 15m, 2h, 7d or 2w\n"
+           "  KEY is time, count, errors (rate), p50, p90, p99, max or cpu (per run)\n"
+           "  by=none lists single runs: the latest in time order, or slowest first\n"
+           "  with a latency sort (p50, p90, p99 or max)\n");
+}
+
+static void print_groups(QueryRun *run) {
+    const QuerySpec *spec = run->spec;
+    for (int i = 0; i < run->group_count; i++) {
+        if (run->groups[i].runs == 0) continue;  // only rusage matched
+        topk_offer(&run->top, group_key(&run->groups[i], spec->sort), i);
+    }
+    int count = topk_drain(&run->top);
+
+    printf("%-20s %-8s %-8s %-7s %-9s %-9s %-9s %-9s %-9s\n",
+           spec->group == GROUP_COMMAND ? "Command" : spec->group == GROUP_DAY ? "Day" : "Hour",
+           "Runs", "Errors", "Err%", "p50", "p90", "p99", "Max", "CPU/run");
+    printf("------------------------------------------------------------"
+           "------------------------------------\n");
+    for (int i = 0; i < count; i++) {
+        int rank = spec->sort == SORT_TIME ? count - 1 - i : i;
+        const QueryGroup *group = &run->groups[run->top.entries[rank].slot];
+
+        char label[32], p50[16], p90[16], p99[16], max[16], cpu[16];
+        if (spec->group == GROUP_COMMAND) {
+            snprintf(label, sizeof(label), "%.20s", group->name);
+        } else {
+            time_t bucket = group->bucket;
+            strftime(label, sizeof(label), spec->group == GROUP_DAY ? "%Y-%m-%d" : "%Y-%m-%d %H:00",
+                     localtime(&bucket));
+        }
+        if (group->measured_runs) {
+            format_latency(group->cpu_time / group->measured_runs, cpu, sizeof(cpu));
+        } else {
+            snprintf(cpu, sizeof(cpu), "-");
+        }
+        printf("%-20s %-8llu %-8llu %-7.1f %-9s %-9s %-9s %-9s %-9s\n", label,
+               (unsigned long long)group->runs, (unsigned long long)group->errors,
+               100.0 * group->errors / group->runs,
+               format_latency(histogram_percentile(&group->latency, 50), p50, sizeof(p50)),
+               format_latency(histogram_percentile(&group->latency, 90), p90, sizeof(p90)),
+               format_latency(histogram_percentile(&group->latency, 99), p99, sizeof(p99)),
+               format_latency(group->latency.max_us / 1e6, max, sizeof(max)), cpu);
+    }
+}
+
+// analytics query: filter, group and rank the executions in the event log
+// in one streaming pass over the mapped records
+bool analytics_query(char **args, int arg_count) {
+    QuerySpec spec;
+    if (!parse_query(args, arg_count, &spec)) {
+        print_query_usage();
+        return false;
+    }
+
+    EventStore *store = analytics_event_store();
+    if (!store) {
+        printf("No analytics history: ~/.edushell/analytics could not be opened\n");
+        return true;
+    }
+
+    QueryRun run = {.spec = &spec};
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    run.utc_offset = local.tm_gmtoff;
+
+    // Groups are ranked after the scan, so the heap needs room for K of
+    // them; ungrouped rows compete for K slots as they stream past, or
+    // the last K are kept when listing in time order
+    run.top.limit = spec.limit;
+    run.top.entries = malloc(spec.limit * sizeof(HeapEntry));
+    if (spec.group == GROUP_NONE) run.rows = malloc(spec.limit * sizeof(StoredEvent));
+    if (!run.top.entries || (spec.group == GROUP_NONE && !run.rows)) {
+        handle_error("Out of memory");
+        free(run.top.entries);
+        free(run.rows);
+        return true;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t from = spec.since == INT64_MIN ? store->first_event : event_store_find_time(store, spec.since);
+    uint64_t to = event_store_replay(store, from, query_event, &run);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (spec.group == GROUP_NONE) {
+        printf("%-20s %-20s %-8s %-10s\n", "Time", "Command", "Status", "Latency");
+        printf("------------------------------------------------------------\n");
+    }
+    if (spec.group == GROUP_NONE && spec.sort == SORT_TIME) {
+        // Oldest of the kept runs first
+        uint64_t count = run.matched < (uint64_t)spec.limit ? run.matched : (uint64_t)spec.limit;
+        for (uint64_t i = run.matched - count; i < run.matched; i++) {
+            print_execution(&run.rows[i % spec.limit]);
+        }
+    } else if (spec.group == GROUP_NONE) {
+        // Slowest first; the heap's slots index the kept rows
+        int count = topk_drain(&run.top);
+        for (int i = 0; i < count; i++) print_execution(&run.rows[run.top.entries[i].slot]);
+    } else {
+        print_groups(&run);
+    }
+
+    double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("\n%llu matching runs from %llu events scanned in %.1f ms\n",
+           (unsigned long long)run.matched, (unsigned long long)(to - from), ms);
+
+    free(run.top.entries);
+    free(run.rows);
+    free(run.groups);
+    free(run.slots);
+    return true;
+}
@@ -0,0 +1,183 @@
+#include "analytics.h"
+#include "edushell.h"
+#include <stdarg.h>
+
+static const char *GRAPH_CHARS[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+#define GRAPH_LEVELS 8
+// Unchanged cells worth resending to avoid a cursor move (about 7 bytes)
+#define SHORT_GAP 3
+
+static Cell *cell_at(Frame *frame, int row, int col) {
+    return &frame->cells[row * frame->cols + col];
+}
+
+// Size the frame; a new size means the terminal's copy is unknown
+bool frame_resize(Frame *frame, int rows, int cols) {
+    if (rows == frame->rows && cols == frame->cols && frame->cells) return true;
+
+    size_t count = (size_t)rows * cols;
+    Cell *cells = realloc(frame->cells, count * sizeof(Cell));
+    if (!cells) return false;
+    frame->cells = cells;
+    Cell *shown = realloc(frame->shown, count * sizeof(Cell));
+    if (!shown) return false;
+    frame->shown = shown;
+
+    frame->rows = rows;
+    frame->cols = cols;
+    frame->valid = false;
+    frame_clear(frame);
+    return true;
+}
+
+// Blank the drawing buffer for the next frame
+void frame_clear(Frame *frame) {
+    for (int i = 0; i < frame->rows * frame->cols; i++) {
+        memset(frame->cells[i].glyph, 0, sizeof(frame->cells[i].glyph));
+        frame->cells[i].glyph[0] = ' ';
+    }
+}
+
+// Bytes in the UTF-8 character starting with `lead`
+static int utf8_length(unsigned char lead) {
+    if (lead >= 0xf0) return 4;
+    if (lead >= 0xe0) return 3;
+    if (lead >= 0xc0) return 2;
+    return 1;
+}
+
+static void put_glyph(Frame *frame, int row, int col, const char *glyph, int length) {
+    if (row < 0 || row >= frame->rows || col < 0 || col >= frame->cols) return;
+    Cell *cell = cell_at(frame, row, col);
+    memset(cell->glyph, 0, sizeof(cell->glyph));
+    memcpy(cell->glyph, glyph, length);
+}
+
+// printf into the frame at (row, col), one character per cell, clipped at
+// the right edge. Every character is taken to be one column wide.
+void frame_text(Frame *frame, int row, int col, const char *format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    for (const char *p = text; *p && col < frame->cols; col++) {
+        int length = utf8_length((unsigned char)*p);
+        if ((int)strnlen(p, length) < length) break;   // cut off mid-character
+        put_glyph(frame, row, col, p, length);
+        p += length;
+    }
+}
+
+// Bar graph of `count` values, `height` rows tall with its bottom row at
+// row + height - 1. Each row resolves GRAPH_LEVELS steps, so the graph has
+// height * GRAPH_LEVELS in all; values are scaled so `max` fills it.
+void frame_sparkline(Frame *frame, int row, int col, int height, const float *values, int count,
+                     double max) {
+    int steps = height * GRAPH_LEVELS;
+    for (int i = 0; i < count; i++) {
+        double scaled = max > 0 ? values[i] / max : 0;
+        int level = (int)(scaled * steps + 0.5);
+        if (level > steps) level = steps;
+        // Anything above zero stays visible
+        if (level == 0 && values[i] > 0) level = 1;
+
+        for (int r = 0; r < height; r++) {
+            int fill = level - r * GRAPH_LEVELS;
+            if (fill <= 0) break;
+            const char *glyph = GRAPH_CHARS[(fill > GRAPH_LEVELS ? GRAPH_LEVELS : fill) - 1];
+            put_glyph(frame, row + height - 1 - r, col + i, glyph, strlen(glyph));
+        }
+    }
+}
+
+static bool out_reserve(Frame *frame, size_t used, size_t more) {
+    if (used + more <= frame->out_capacity) return true;
+    size_t capacity = frame->out_capacity ? frame->out_capacity : 4096;
+    while (used + more > capacity) capacity *= 2;
+    char *out = realloc(frame->out, capacity);
+    if (!out) return false;
+    frame->out = out;
+    frame->out_capacity = capacity;
+    return true;
+}
+
+// Send the cells that changed since the last flush, with the frame's top
+// row on the terminal's first line, in a single write. The cursor is saved
+// and restored around the update so typing carries on where it was.
+// `prefix` (may be NULL) goes out first in the same write, for escape
+// sequences that must reach the terminal before the cells.
+bool frame_flush(Frame *frame, int fd, const char *prefix) {
+    static const char BEGIN[] = "\0337\033[?25l";
+    static const char END[] = "\033[?25h\0338";
+    size_t used = 0;
+
+    if (!out_reserve(frame, 0, sizeof(BEGIN) + (prefix ? strlen(prefix) : 0))) return false;
+    used += snprintf(frame->out, frame->out_capacity, "%s%s", BEGIN, prefix ? prefix : "");
+    size_t empty = used;
+
+    int cursor_row = -1, cursor_col = -1;
+    for (int row = 0; row < frame->rows; row++) {
+        for (int col = 0; col < frame->cols; col++) {
+            int i = row * frame->cols + col;
+            if (frame->valid && memcmp(&frame->cells[i], &frame->shown[i], sizeof(Cell)) == 0) {
+                continue;
+            }
+            // A cursor move only where the previous change didn't leave it;
+            // over a short gap, resending the cells between is cheaper
+            if (!out_reserve(frame, used, 32 + SHORT_GAP * sizeof(Cell))) return false;
+            if (row == cursor_row && col > cursor_col && col - cursor_col <= SHORT_GAP) {
+                for (; cursor_col < col; cursor_col++) {
+                    const Cell *between = &frame->cells[row * frame->cols + cursor_col];
+                    size_t length = strnlen(between->glyph, sizeof(between->glyph));
+                    memcpy(frame->out + used, between->glyph, length);
+                    used += length;
+                }
+            } else if (row != cursor_row || col != cursor_col) {
+                used += snprintf(frame->out + used, frame->out_capacity - used, "\033[%d;%dH",
+                                 row + 1, col + 1);
+            }
+            const char *glyph = frame->cells[i].glyph;
+            size_t length = strnlen(glyph, sizeof(frame->cells[i].glyph));
+            memcpy(frame->out + used, glyph, length);
+            used += length;
+            cursor_row = row;
+            cursor_col = col + 1;
+        }
+    }
+
+    if (!prefix && used == empty) return true;   // nothing changed
+    if (!out_reserve(frame, used, sizeof(END))) return false;
+    memcpy(frame->out + used, END, sizeof(END) - 1);
+    used += sizeof(END) - 1;
+
+    // Anything printf'd must land before the frame
+    fflush(stdout);
+    for (size_t sent = 0; sent < used;) {
+        ssize_t n = write(fd, frame->out + sent, used - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            frame->valid = false;
+            return false;
+        }
+        sent += n;
+    }
+
+    memcpy(frame->shown, frame->cells, (size_t)frame->rows * frame->cols * sizeof(Cell));
+    frame->valid = true;
+    return true;
+}
+
+// Forget what the terminal shows (something else drew over it), so the
+// next flush repaints every cell
+void frame_invalidate(Frame *frame) {
+    frame->valid = false;
+}
+
+void frame_free(Frame *frame) {
+    free(frame->cells);
+    free(frame->shown);
+    free(frame->out);
+    memset(frame, 0, sizeof(*frame));
+}
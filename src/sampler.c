@@ -0,0 +1,274 @@
+#include "analytics.h"
+#include "edushell.h"
+#include <stddef.h>
+
+// Read the whole file from offset 0; procfs regenerates it on every read
+// from the start, so the descriptor can stay open between samples
+static ssize_t reread(int fd, char *buf, size_t size) {
+    ssize_t len = pread(fd, buf, size - 1, 0);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+static const char *skip_spaces(const char *p) {
+    while (*p == ' ') p++;
+    return p;
+}
+
+static const char *scan_u64(const char *p, unsigned long long *value) {
+    unsigned long long v = 0;
+    p = skip_spaces(p);
+    while (*p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+    }
+    *value = v;
+    return p;
+}
+
+static const char *next_line(const char *p) {
+    while (*p && *p != '\n') p++;
+    return *p ? p + 1 : p;
+}
+
+// Parse one "cpu..." line after its label. Kernels older than the steal
+// and guest fields simply leave them at zero.
+static const char *scan_cpu_times(const char *p, CpuTimes *t) {
+    unsigned long long *fields[] = {
+        &t->user, &t->nice, &t->system, &t->idle, &t->iowait, &t->irq,
+        &t->softirq, &t->steal, &t->guest, &t->guest_nice
+    };
+    memset(t, 0, sizeof(*t));
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        p = skip_spaces(p);
+        if (*p < '0' || *p > '9') break;
+        p = scan_u64(p, fields[i]);
+    }
+    return next_line(p);
+}
+
+static void compute_usage(const CpuTimes *prev, const CpuTimes *cur, CpuUsage *usage) {
+    // guest and guest_nice are already part of user and nice
+    unsigned long long prev_total = prev->user + prev->nice + prev->system + prev->idle +
+                                    prev->iowait + prev->irq + prev->softirq + prev->steal;
+    unsigned long long cur_total = cur->user + cur->nice + cur->system + cur->idle +
+                                   cur->iowait + cur->irq + cur->softirq + cur->steal;
+    if (cur_total <= prev_total) {
+        memset(usage, 0, sizeof(*usage));
+        return;
+    }
+
+    double total = cur_total - prev_total;
+    double idle = (cur->idle - prev->idle) + (cur->iowait - prev->iowait);
+    usage->busy = 100.0 * (1.0 - idle / total);
+    usage->iowait = 100.0 * (cur->iowait - prev->iowait) / total;
+    usage->steal = 100.0 * (cur->steal - prev->steal) / total;
+    usage->guest = 100.0 * ((cur->guest - prev->guest) +
+                            (cur->guest_nice - prev->guest_nice)) / total;
+}
+
+static bool sample_stat(Sampler *sampler) {
+    if (reread(sampler->stat_fd, sampler->buf, sizeof(sampler->buf)) <= 0) return false;
+
+    // The cpu lines come first; stop at the first line that isn't one
+    const char *p = sampler->buf;
+    int count = 0;
+    while (p[0] == 'c' && p[1] == 'p' && p[2] == 'u' && count <= MAX_SAMPLED_CPUS) {
+        // "cpu " is the aggregate, "cpuN " is core N
+        int index = 0;
+        p += 3;
+        if (*p != ' ') {
+            unsigned long long core;
+            p = scan_u64(p, &core);
+            if (core >= MAX_SAMPLED_CPUS) break;
+            index = core + 1;
+        }
+
+        CpuTimes cur;
+        p = scan_cpu_times(p, &cur);
+        if (sampler->have_prev) {
+            compute_usage(&sampler->prev[index], &cur, &sampler->cpu[index]);
+        }
+        sampler->prev[index] = cur;
+        if (index > 0) count++;
+    }
+
+    sampler->cpu_count = count;
+    sampler->have_prev = true;
+    return true;
+}
+
+static bool sample_meminfo(Sampler *sampler) {
+    char buf[SAMPLER_MEMINFO_BUFFER];
+    if (reread(sampler->meminfo_fd, buf, sizeof(buf)) <= 0) return false;
+
+    static const struct {
+        const char *key;
+        size_t len;
+        size_t offset;
+    } KEYS[] = {
+        {"MemTotal:", 9, offsetof(Sampler, mem_total_kb)},
+        {"MemFree:", 8, offsetof(Sampler, mem_free_kb)},
+        {"MemAvailable:", 13, offsetof(Sampler, mem_available_kb)},
+        {"Buffers:", 8, offsetof(Sampler, mem_buffers_kb)},
+        {"Cached:", 7, offsetof(Sampler, mem_cached_kb)},
+    };
+    const size_t key_count = sizeof(KEYS) / sizeof(KEYS[0]);
+
+    // The wanted keys are all near the top, in this order
+    size_t found = 0;
+    for (const char *p = buf; *p && found < key_count; p = next_line(p)) {
+        for (size_t i = 0; i < key_count; i++) {
+            if (strncmp(p, KEYS[i].key, KEYS[i].len) == 0) {
+                scan_u64(p + KEYS[i].len, (unsigned long long *)((char *)sampler + KEYS[i].offset));
+                found++;
+                break;
+            }
+        }
+    }
+    return found > 0;
+}
+
+// Only whole disks count toward the totals: a partition's I/O also shows
+// on its disk, and loop, ram, md and device-mapper devices sit on top of
+// (or beside) real disks
+static bool is_whole_disk(const char *name) {
+    static const char *VIRTUAL[] = {"loop", "ram", "zram", "dm-", "md"};
+    for (size_t i = 0; i < sizeof(VIRTUAL) / sizeof(VIRTUAL[0]); i++) {
+        if (strncmp(name, VIRTUAL[i], strlen(VIRTUAL[i])) == 0) return false;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/block/%s", name);
+    return access(path, F_OK) == 0;
+}
+
+static DiskStats *find_disk(Sampler *sampler, const char *name, size_t len) {
+    for (int i = 0; i < sampler->disk_count; i++) {
+        if (strncmp(sampler->disks[i].name, name, len) == 0 && sampler->disks[i].name[len] == '\0') {
+            return &sampler->disks[i];
+        }
+    }
+    if (sampler->disk_count == MAX_SAMPLED_DISKS || len >= sizeof(sampler->disks[0].name)) {
+        return NULL;
+    }
+
+    DiskStats *disk = &sampler->disks[sampler->disk_count++];
+    memset(disk, 0, sizeof(*disk));
+    memcpy(disk->name, name, len);
+    disk->whole_disk = is_whole_disk(disk->name);
+    return disk;
+}
+
+static bool sample_diskstats(Sampler *sampler) {
+    if (reread(sampler->diskstats_fd, sampler->buf, sizeof(sampler->buf)) <= 0) return false;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - sampler->disk_time.tv_sec) +
+                     (now.tv_nsec - sampler->disk_time.tv_nsec) / 1e9;
+    bool have_prev = sampler->disk_time.tv_sec != 0 && elapsed > 0;
+    sampler->disk_time = now;
+
+    for (int i = 0; i < sampler->disk_count; i++) {
+        sampler->disks[i].present = false;
+    }
+    sampler->disk_read_bps = sampler->disk_write_bps = sampler->disk_iops = 0;
+
+    // "major minor name reads merged sectors ms writes merged sectors ..."
+    for (const char *p = sampler->buf; *p; p = next_line(p)) {
+        unsigned long long major, minor, fields[7];
+        p = scan_u64(p, &major);
+        p = scan_u64(p, &minor);
+        p = skip_spaces(p);
+        const char *name = p;
+        while (*p && *p != ' ' && *p != '\n') p++;
+        size_t len = p - name;
+        for (int i = 0; i < 7; i++) {
+            p = scan_u64(p, &fields[i]);
+        }
+
+        DiskStats *disk = len > 0 ? find_disk(sampler, name, len) : NULL;
+        if (!disk) continue;
+
+        // Sectors in diskstats are always 512 bytes. Counters that went
+        // backwards belong to a device that was replaced; start over.
+        if (have_prev && disk->sampled && fields[0] >= disk->reads && fields[2] >= disk->sectors_read &&
+            fields[4] >= disk->writes && fields[6] >= disk->sectors_written) {
+            disk->read_bps = (fields[2] - disk->sectors_read) * 512.0 / elapsed;
+            disk->write_bps = (fields[6] - disk->sectors_written) * 512.0 / elapsed;
+            disk->read_iops = (fields[0] - disk->reads) / elapsed;
+            disk->write_iops = (fields[4] - disk->writes) / elapsed;
+        } else {
+            disk->read_bps = disk->write_bps = disk->read_iops = disk->write_iops = 0;
+        }
+        disk->reads = fields[0];
+        disk->sectors_read = fields[2];
+        disk->writes = fields[4];
+        disk->sectors_written = fields[6];
+        disk->present = true;
+        disk->sampled = true;
+
+        if (disk->whole_disk) {
+            sampler->disk_read_bps += disk->read_bps;
+            sampler->disk_write_bps += disk->write_bps;
+            sampler->disk_iops += disk->read_iops + disk->write_iops;
+        }
+    }
+    return true;
+}
+
+// Busiest whole disk of the last interval, or NULL when all were idle
+const DiskStats *sampler_busiest_disk(const Sampler *sampler) {
+    const DiskStats *busiest = NULL;
+    double best = 0;
+    for (int i = 0; i < sampler->disk_count; i++) {
+        const DiskStats *disk = &sampler->disks[i];
+        double bytes = disk->read_bps + disk->write_bps;
+        if (disk->present && disk->whole_disk && bytes > best) {
+            best = bytes;
+            busiest = disk;
+        }
+    }
+    return busiest;
+}
+
+bool sampler_open(Sampler *sampler) {
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    sampler->meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    sampler->diskstats_fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    if (sampler->stat_fd < 0 || sampler->meminfo_fd < 0) {
+        sampler_close(sampler);
+        return false;
+    }
+
+    // Prime the counters so the first real sample has a baseline
+    sample_stat(sampler);
+    if (sampler->diskstats_fd >= 0) sample_diskstats(sampler);
+    return true;
+}
+
+bool sampler_sample(Sampler *sampler) {
+    if (sampler->stat_fd < 0) return false;
+    bool ok = sample_stat(sampler);
+    // Containers may hide /proc/diskstats; CPU and memory still work
+    if (sampler->diskstats_fd >= 0) sample_diskstats(sampler);
+    return sample_meminfo(sampler) && ok;
+}
+
+void sampler_close(Sampler *sampler) {
+    if (sampler->stat_fd >= 0) close(sampler->stat_fd);
+    if (sampler->meminfo_fd >= 0) close(sampler->meminfo_fd);
+    if (sampler->diskstats_fd >= 0) close(sampler->diskstats_fd);
+    sampler->stat_fd = sampler->meminfo_fd = sampler->diskstats_fd = -1;
+}
+
+// Same definition as before: neither buffers nor page cache count as used
+double sampler_memory_usage(const Sampler *sampler) {
+    if (sampler->mem_total_kb == 0) return 0.0;
+    unsigned long long unused = sampler->mem_free_kb + sampler->mem_buffers_kb +
+                                sampler->mem_cached_kb;
+    if (unused > sampler->mem_total_kb) return 0.0;
+    return 100.0 * (sampler->mem_total_kb - unused) / sampler->mem_total_kb;
+}
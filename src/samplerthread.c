@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+#include "analytics.h"
+#include "edushell.h"
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+// The thread owns its Sampler; the shell only ever sees copies of what it
+// produced, through a single-producer/single-consumer ring. The producer
+// only moves `head` and the consumer only moves `tail`, so neither side
+// takes a lock, and a full ring drops new samples rather than wait.
+typedef struct {
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    _Alignas(64) ResourceSample slots[SAMPLE_RING_SIZE];
+} SampleRing;
+
+static SampleRing ring;
+static Sampler thread_sampler;
+static pthread_t thread;
+static bool running = false;
+static int ready_fd = -1;          // counts samples published, for the event loop
+static int stop_fd = -1;           // wakes the thread to exit
+static _Atomic long period_ns = UPDATE_INTERVAL * 1000000000L;
+static _Atomic unsigned long dropped;
+
+// A forked child has no sampler thread, only copies of its descriptors;
+// stopping in the child just closes those
+static void in_child(void) {
+    running = false;
+}
+
+static bool ring_push(const ResourceSample *sample) {
+    uint32_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    if (head - tail == SAMPLE_RING_SIZE) return false;
+
+    ring.slots[head & (SAMPLE_RING_SIZE - 1)] = *sample;
+    // Publishes the slot's contents along with the new head
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+    return true;
+}
+
+// Oldest unread sample, if any. Called only from the shell's main thread.
+bool sampler_thread_pop(ResourceSample *sample) {
+    uint32_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+    if (tail == head) return false;
+
+    *sample = ring.slots[tail & (SAMPLE_RING_SIZE - 1)];
+    // Hands the slot back to the producer only after it was copied out
+    atomic_store_explicit(&ring.tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static void take_sample(ResourceSample *sample) {
+    Sampler *s = &thread_sampler;
+    sampler_sample(s);
+
+    memset(sample, 0, sizeof(*sample));
+    sample->point.timestamp = time(NULL);
+    sample->point.cpu_usage = s->cpu[0].busy;
+    sample->point.cpu_steal = s->cpu[0].steal;
+    sample->point.cpu_guest = s->cpu[0].guest;
+    sample->point.memory_usage = sampler_memory_usage(s);
+    sample->point.disk_io = (s->disk_read_bps + s->disk_write_bps) / 1e6;
+    sample->point.disk_iops = s->disk_iops;
+    sample->disk_read_mbps = s->disk_read_bps / 1e6;
+    sample->disk_write_mbps = s->disk_write_bps / 1e6;
+
+    const DiskStats *busiest = sampler_busiest_disk(s);
+    if (busiest) snprintf(sample->busiest_disk, sizeof(sample->busiest_disk), "%s", busiest->name);
+
+    sample->cpu_count = s->cpu_count;
+    for (int i = 0; i < s->cpu_count && i < MAX_SAMPLED_CPUS; i++) {
+        sample->core_busy[i] = (uint8_t)(s->cpu[i + 1].busy + 0.5);
+    }
+}
+
+// Sample on a fixed schedule until stop_fd is written. Sleeping in poll()
+// on stop_fd lets sampler_thread_stop() end the thread without waiting out
+// a period.
+static void *sampler_main(void *arg) {
+    (void)arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (;;) {
+        long period = atomic_load_explicit(&period_ns, memory_order_relaxed);
+        next.tv_sec += period / 1000000000L;
+        next.tv_nsec += period % 1000000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long wait_ms = (next.tv_sec - now.tv_sec) * 1000 + (next.tv_nsec - now.tv_nsec) / 1000000;
+        if (wait_ms < 0) {
+            // Fell behind (suspended, say): restart the schedule from now
+            next = now;
+            wait_ms = 0;
+        }
+
+        struct pollfd pfd = {.fd = stop_fd, .events = POLLIN};
+        if (poll(&pfd, 1, wait_ms) > 0) break;
+
+        ResourceSample sample;
+        take_sample(&sample);
+        if (ring_push(&sample)) {
+            uint64_t one = 1;
+            if (write(ready_fd, &one, sizeof(one)) < 0) {}
+        } else {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+// Start sampling every `period` seconds, or just change the period of a
+// running thread
+bool sampler_thread_start(double period) {
+    if (period > 0) {
+        atomic_store_explicit(&period_ns, (long)(period * 1e9), memory_order_relaxed);
+    }
+    if (running) return true;
+
+    static bool registered = false;
+    if (!registered) {
+        pthread_atfork(NULL, NULL, in_child);
+        registered = true;
+    }
+
+    if (!sampler_open(&thread_sampler)) return false;
+    ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (ready_fd < 0 || stop_fd < 0) {
+        sampler_thread_stop();
+        return false;
+    }
+
+    // Signals stay with the main thread, where the event loop reads them
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    running = pthread_create(&thread, NULL, sampler_main, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (!running) sampler_thread_stop();
+    return running;
+}
+
+void sampler_thread_stop(void) {
+    if (running) {
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) < 0) {}
+        pthread_join(thread, NULL);
+        running = false;
+    }
+    if (ready_fd >= 0) close(ready_fd);
+    if (stop_fd >= 0) close(stop_fd);
+    ready_fd = stop_fd = -1;
+    sampler_close(&thread_sampler);
+}
+
+double sampler_thread_period(void) {
+    return atomic_load_explicit(&period_ns, memory_order_relaxed) / 1e9;
+}
+
+// Readable while samples wait in the ring; -1 when the thread isn't running
+int sampler_thread_fd(void) {
+    return ready_fd;
+}
+
+unsigned long sampler_thread_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
@@ -1,43 +1,501 @@
+#define _GNU_SOURCE
 #include "edushell.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
-bool execute_script(const char *filename, ShellState *state) {
-    FILE *script = fopen(filename, "r");
-    if (!script) {
-        handle_error("Could not open script file");
+#define JOIN_NODE UINT32_MAX
+
+// One vertex of the script's dependency graph: a command line, or a join
+// that closes a parallel block
+typedef struct {
+    uint32_t pc;        // its SCRIPT_OP_LINE, or JOIN_NODE
+    int pending;        // dependencies that haven't finished
+    pid_t pid;
+    int pidfd;          // for waiting on this worker and no other child
+    int out_fd;         // memfd holding the line's output until it is printed
+    int status;
+    bool done;
+    struct timespec start_time;
+} ScriptNode;
+
+typedef struct {
+    int from;
+    int to;
+} ScriptEdge;
+
+typedef struct {
+    ScriptNode *nodes;
+    int node_count;
+    ScriptEdge *edges;
+    int edge_count;
+    int edge_capacity;
+    int *next;          // dependents of node i: next[first[i] .. first[i+1])
+    int *first;
+} ScriptGraph;
+
+typedef struct {
+    int out;
+    int err;
+} SavedOutput;
+
+// An open #@ block while the graph is being built. A serial block chains
+// its items; a parallel block starts them all after `entry` and finishes
+// them all at `join`.
+typedef struct {
+    bool parallel;
+    int entry;
+    int prev;
+    int join;
+} ScriptBlock;
+
+// Run one pipeline and return its status; a line that didn't parse
+// (pipeline is NULL) has already reported its error
+static int run_script_pipeline(Pipeline *pipeline, ShellState *state) {
+    if (!pipeline || pipeline->stages[0]->arg_count == 0) return 0;
+
+    Command *cmd = pipeline->stages[0];
+    int status = 0;
+
+    if (pipeline->stage_count > 1) {
+        status = execute_pipeline(pipeline, state, NULL);
+    } else if (!handle_builtin(cmd, state, &status)) {
+        status = execute_command(cmd, state);
+    }
+    return status;
+}
+
+static Command *add_stage(Pipeline *pipeline, Arena *arena) {
+    Command *cmd = arena_alloc(arena, sizeof(Command));
+    memset(cmd, 0, sizeof(*cmd));
+    pipeline->stages[pipeline->stage_count++] = cmd;
+    return cmd;
+}
+
+// Rebuild the command that starts at program->code[pc] in the arena.
+// Strings point into the program's string table, which stays mapped until
+// the script ends. Lines that didn't compile are parsed again (into line)
+// so the syntax error is reported at this point of the script.
+static Pipeline *load_pipeline(const ScriptProgram *program, uint32_t pc,
+                               Arena *arena, char *line) {
+    arena_reset(arena);
+    Pipeline *pipeline = arena_alloc(arena, sizeof(Pipeline));
+    pipeline->stage_count = 0;
+    Command *cmd = add_stage(pipeline, arena);
+
+    for (pc++; pc < program->insn_count; pc++) {
+        const ScriptInsn *insn = &program->code[pc];
+        switch (insn->op) {
+            case SCRIPT_OP_PIPE:
+                cmd = add_stage(pipeline, arena);
+                break;
+            case SCRIPT_OP_ARG:
+                if (cmd->arg_count < MAX_ARGS - 1) {
+                    cmd->args[cmd->arg_count++] = program->strtab + insn->a;
+                }
+                break;
+            case SCRIPT_OP_INPUT:
+                cmd->input_file = program->strtab + insn->a;
+                break;
+            case SCRIPT_OP_OUTPUT:
+                cmd->output_file = program->strtab + insn->a;
+                cmd->append_output = insn->flags;
+                break;
+            case SCRIPT_OP_RUN:
+                pipeline->is_background = insn->flags;
+                cmd->is_background = insn->flags;
+                return pipeline;
+            case SCRIPT_OP_REPARSE:
+                snprintf(line, MAX_COMMAND_LENGTH, "%s", program->strtab + insn->a);
+                return parse_pipeline(line, arena);
+        }
+    }
+    return NULL;
+}
+
+static void print_script_line(const ScriptProgram *program, uint32_t pc) {
+    printf(COLOR_GREEN "Script[%d]> %s\n" COLOR_RESET,
+           (int)program->code[pc].a, program->strtab + program->code[pc].b);
+}
+
+// Default mode: one line after another, output straight to the terminal
+static void run_sequential(const ScriptProgram *program, ShellState *state) {
+    char line[MAX_COMMAND_LENGTH];
+    Arena arena;
+    parse_arena_init(&arena);
+
+    for (uint32_t pc = 0; pc < program->insn_count; pc++) {
+        // Block markers only matter with -j
+        if (program->code[pc].op != SCRIPT_OP_LINE) continue;
+
+        int line_number = program->code[pc].a;
+        print_script_line(program, pc);
+        Pipeline *pipeline = load_pipeline(program, pc, &arena, line);
+        if (run_script_pipeline(pipeline, state) != 0) {
+            printf(COLOR_RED "Script error at line %d\n" COLOR_RESET, line_number);
+        }
+        logger_poll();
+    }
+
+    arena_free(&arena);
+}
+
+static int add_node(ScriptGraph *g, uint32_t pc) {
+    ScriptNode *node = &g->nodes[g->node_count];
+    memset(node, 0, sizeof(*node));
+    node->pc = pc;
+    node->pidfd = -1;
+    node->out_fd = -1;
+    return g->node_count++;
+}
+
+static bool add_edge(ScriptGraph *g, int from, int to) {
+    if (from < 0) return true;
+    if (g->edge_count == g->edge_capacity) {
+        int capacity = g->edge_capacity ? g->edge_capacity * 2 : 64;
+        ScriptEdge *edges = realloc(g->edges, capacity * sizeof(ScriptEdge));
+        if (!edges) return false;
+        g->edges = edges;
+        g->edge_capacity = capacity;
+    }
+    g->edges[g->edge_count++] = (ScriptEdge){from, to};
+    g->nodes[to].pending++;
+    return true;
+}
+
+// Node that the next item of a block waits for
+static int block_dependency(const ScriptBlock *block) {
+    return block->parallel ? block->entry : block->prev;
+}
+
+// An item (command or nested block) that finishes at node `last` was added
+static bool block_finish_item(ScriptGraph *g, ScriptBlock *block, int last) {
+    if (block->parallel) return add_edge(g, last, block->join);
+    block->prev = last;
+    return true;
+}
+
+static bool close_block(ScriptGraph *g, ScriptBlock *blocks, int *depth) {
+    ScriptBlock *block = &blocks[(*depth)--];
+    return block_finish_item(g, &blocks[*depth], block->parallel ? block->join : block->prev);
+}
+
+// Turn the program into a DAG. Every node gets a dependency edge from the
+// item before it, except inside #@ parallel blocks, whose items all depend
+// on what came before the block and are all waited for by its join node.
+static bool build_graph(const ScriptProgram *program, ScriptGraph *g) {
+    memset(g, 0, sizeof(*g));
+    // At most one node per instruction, at most one block per BEGIN
+    g->nodes = malloc((program->insn_count + 1) * sizeof(ScriptNode));
+    ScriptBlock *blocks = malloc((program->insn_count + 1) * sizeof(ScriptBlock));
+    if (!g->nodes || !blocks) {
+        free(blocks);
+        return false;
+    }
+
+    int depth = 0;
+    blocks[0] = (ScriptBlock){false, -1, -1, -1};
+    bool ok = true;
+
+    for (uint32_t pc = 0; ok && pc < program->insn_count; pc++) {
+        const ScriptInsn *insn = &program->code[pc];
+        ScriptBlock *block = &blocks[depth];
+
+        if (insn->op == SCRIPT_OP_LINE) {
+            int node = add_node(g, pc);
+            ok = add_edge(g, block_dependency(block), node) &&
+                 block_finish_item(g, block, node);
+        } else if (insn->op == SCRIPT_OP_BEGIN) {
+            int entry = block_dependency(block);
+            ScriptBlock *inner = &blocks[++depth];
+            *inner = (ScriptBlock){insn->flags, entry, entry, -1};
+            if (inner->parallel) {
+                // The join also waits for the entry, so an empty block
+                // still keeps what follows it after what came before
+                inner->join = add_node(g, JOIN_NODE);
+                ok = add_edge(g, entry, inner->join);
+            }
+        } else if (insn->op == SCRIPT_OP_END && depth > 0) {
+            ok = close_block(g, blocks, &depth);
+        }
+    }
+    while (ok && depth > 0) {
+        ok = close_block(g, blocks, &depth);
+    }
+    free(blocks);
+
+    // Group edges by source so finishing a node visits only its dependents
+    g->first = calloc(g->node_count + 1, sizeof(int));
+    g->next = malloc((g->edge_count + 1) * sizeof(int));
+    if (!ok || !g->first || !g->next) return false;
+
+    for (int i = 0; i < g->edge_count; i++) g->first[g->edges[i].from + 1]++;
+    for (int i = 0; i < g->node_count; i++) g->first[i + 1] += g->first[i];
+    int *fill = malloc((g->node_count + 1) * sizeof(int));
+    if (!fill) return false;
+    memcpy(fill, g->first, (g->node_count + 1) * sizeof(int));
+    for (int i = 0; i < g->edge_count; i++) {
+        g->next[fill[g->edges[i].from]++] = g->edges[i].to;
+    }
+    free(fill);
+    return true;
+}
+
+static void free_graph(ScriptGraph *g) {
+    for (int i = 0; i < g->node_count; i++) {
+        if (g->nodes[i].out_fd >= 0) close(g->nodes[i].out_fd);
+        if (g->nodes[i].pidfd >= 0) close(g->nodes[i].pidfd);
+    }
+    free(g->nodes);
+    free(g->edges);
+    free(g->first);
+    free(g->next);
+}
+
+// A line that changes the shell itself (cd, rm, ...) must run in this
+// process rather than in a worker
+static bool needs_shell(const Pipeline *pipeline) {
+    if (!pipeline) return true;
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        const Command *cmd = pipeline->stages[i];
+        const Builtin *builtin = cmd->arg_count > 0 ? find_builtin(cmd->args[0]) : NULL;
+        if (builtin && (builtin->flags & BUILTIN_SHELL_STATE) && is_builtin(cmd)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void redirect_output(int fd) {
+    if (fd < 0) return;
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+}
+
+// Point this process's stdout and stderr at fd until restore_output
+static SavedOutput capture_output(int fd) {
+    fflush(stdout);
+    fflush(stderr);
+    SavedOutput saved = {dup(STDOUT_FILENO), dup(STDERR_FILENO)};
+    redirect_output(fd);
+    return saved;
+}
+
+static void restore_output(SavedOutput saved) {
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved.out, STDOUT_FILENO);
+    dup2(saved.err, STDERR_FILENO);
+    close(saved.out);
+    close(saved.err);
+}
+
+static pid_t start_worker(Pipeline *pipeline, int out_fd, ShellState *state) {
+    // Anything still buffered would otherwise be written twice
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        redirect_output(out_fd);
+        int status = run_script_pipeline(pipeline, state);
+        fflush(NULL);
+        _exit(status & 0xff);
+    }
+    return pid;
+}
+
+// Reap one of the script's running workers and return its index in
+// `running`. Background jobs are children of the shell too, so this waits
+// on the workers' pidfds rather than on any child; without pidfds it
+// blocks on the oldest worker.
+static int wait_worker(ScriptGraph *g, const int *running, int count, struct pollfd *polls,
+                       int *status) {
+    int found = 0;
+    bool polled = true;
+    for (int r = 0; r < count; r++) {
+        polls[r].fd = g->nodes[running[r]].pidfd;
+        polls[r].events = POLLIN;
+        polls[r].revents = 0;
+        if (polls[r].fd < 0) polled = false;
+    }
+    if (polled) {
+        if (poll(polls, count, -1) < 0) return -1;
+        while (found < count && !polls[found].revents) found++;
+        if (found == count) return -1;
+    }
+
+    ScriptNode *node = &g->nodes[running[found]];
+    if (waitpid(node->pid, status, 0) < 0) return -1;
+    if (node->pidfd >= 0) {
+        close(node->pidfd);
+        node->pidfd = -1;
+    }
+    return found;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Print a finished line: the echo, its captured output, then its error
+static void commit_node(const ScriptProgram *program, ScriptNode *node) {
+    print_script_line(program, node->pc);
+    fflush(stdout);
+    if (node->out_fd >= 0) {
+        lseek(node->out_fd, 0, SEEK_SET);
+        copy_fd(node->out_fd, STDOUT_FILENO);
+        close(node->out_fd);
+        node->out_fd = -1;
+    }
+    if (node->status != 0) {
+        printf(COLOR_RED "Script error at line %d\n" COLOR_RESET, (int)program->code[node->pc].a);
+    }
+    logger_poll();
+}
+
+// Run the script's DAG with up to state->script_jobs lines at once. Each
+// line's output is held in a memfd and printed in script order, so the
+// transcript reads as if the lines had run one by one.
+static bool run_parallel(const ScriptProgram *program, ShellState *state) {
+    ScriptGraph g;
+    if (!build_graph(program, &g)) {
+        free_graph(&g);
+        handle_error("Could not schedule script");
+        return false;
+    }
+
+    int jobs = state->script_jobs;
+    int *ready = malloc((g.node_count + 1) * sizeof(int));
+    int *running = malloc(jobs * sizeof(int));
+    struct pollfd *polls = malloc(jobs * sizeof(struct pollfd));
+    if (!ready || !running || !polls) {
+        free(ready);
+        free(running);
+        free(polls);
+        free_graph(&g);
+        handle_error("Could not schedule script");
         return false;
     }
 
     char line[MAX_COMMAND_LENGTH];
-    int line_number = 0;
+    Arena arena;
+    parse_arena_init(&arena);
 
-    printf("Executing script: %s\n", filename);
+    struct timespec script_start;
+    clock_gettime(CLOCK_MONOTONIC, &script_start);
+    double work_ms = 0;
 
-    while (fgets(line, sizeof(line), script)) {
-        line_number++;
-        
-        // Remove trailing newline
-        line[strcspn(line, "\n")] = 0;
-        
-        // Skip empty lines and comments
-        if (strlen(line) == 0 || line[0] == '#') {
-            continue;
-        }
-
-        // Parse and execute the command
-        Command *cmd = parse_command(line);
-        if (cmd) {
-            printf(COLOR_GREEN "Script[%d]> %s\n" COLOR_RESET, line_number, line);
-            
-            if (!handle_builtin(cmd, state)) {
-                int status = execute_command(cmd, state);
-                if (status != 0) {
-                    printf(COLOR_RED "Script error at line %d\n" COLOR_RESET, line_number);
+    int head = 0, tail = 0;
+    for (int i = 0; i < g.node_count; i++) {
+        if (g.nodes[i].pending == 0) ready[tail++] = i;
+    }
+
+    int running_count = 0;
+    int commit = 0;
+    for (;;) {
+        // Start everything that is ready, up to the worker limit
+        while (head < tail && running_count < jobs) {
+            int id = ready[head++];
+            ScriptNode *node = &g.nodes[id];
+            clock_gettime(CLOCK_MONOTONIC, &node->start_time);
+
+            if (node->pc != JOIN_NODE) {
+                node->out_fd = memfd_create("edushell-script", MFD_CLOEXEC);
+                // Syntax errors and shell-run lines land in the line's own output
+                SavedOutput saved = capture_output(node->out_fd);
+                Pipeline *pipeline = load_pipeline(program, node->pc, &arena, line);
+                bool in_shell = needs_shell(pipeline);
+                if (in_shell) {
+                    node->status = run_script_pipeline(pipeline, state);
+                }
+                restore_output(saved);
+
+                if (!in_shell) {
+                    node->pid = start_worker(pipeline, node->out_fd, state);
+                    if (node->pid > 0) {
+                        node->pidfd = syscall(SYS_pidfd_open, node->pid, 0);
+                        running[running_count++] = id;
+                        continue;
+                    }
+                    // No worker: run it here instead
+                    saved = capture_output(node->out_fd);
+                    node->status = run_script_pipeline(pipeline, state);
+                    restore_output(saved);
                 }
+                work_ms += elapsed_ms(&node->start_time);
+            }
+
+            // Finished without a worker
+            node->done = true;
+            for (int e = g.first[id]; e < g.first[id + 1]; e++) {
+                if (--g.nodes[g.next[e]].pending == 0) ready[tail++] = g.next[e];
             }
-            free_command(cmd);
+        }
+
+        // Print finished lines in script order
+        while (commit < g.node_count &&
+               (g.nodes[commit].pc == JOIN_NODE || g.nodes[commit].done)) {
+            if (g.nodes[commit].pc != JOIN_NODE) commit_node(program, &g.nodes[commit]);
+            commit++;
+        }
+        fflush(stdout);
+
+        if (running_count == 0) break;
+
+        int status;
+        int r = wait_worker(&g, running, running_count, polls, &status);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int id = running[r];
+        ScriptNode *node = &g.nodes[id];
+        running[r] = running[--running_count];
+        node->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        node->done = true;
+        work_ms += elapsed_ms(&node->start_time);
+        for (int e = g.first[id]; e < g.first[id + 1]; e++) {
+            if (--g.nodes[g.next[e]].pending == 0) ready[tail++] = g.next[e];
         }
     }
 
-    fclose(script);
+    printf("Script finished in %.3f ms with -j %d (%.3f ms of command time)\n",
+           elapsed_ms(&script_start), jobs, work_ms);
+
+    arena_free(&arena);
+    free(ready);
+    free(running);
+    free(polls);
+    free_graph(&g);
     return true;
-} 
\ No newline at end of file
+}
+
+bool execute_script(const char *filename, ShellState *state) {
+    ScriptProgram program;
+    if (!load_script_program(filename, &program)) {
+        return false;
+    }
+
+    printf("Executing script: %s\n", filename);
+    if (program.cache_hit) {
+        double saved = program.parse_ns > program.load_ns ?
+                       (program.parse_ns - program.load_ns) / 1e6 : 0.0;
+        printf("Script cache hit: skipped parsing %u lines (saved ~%.3f ms)\n",
+               program.line_count, saved);
+    } else {
+        printf("Script compiled: %u lines in %.3f ms (%s)\n", program.line_count,
+               program.parse_ns / 1e6, program.cached ? "cached for next run" : "not cached");
+    }
+
+    bool ok = true;
+    if (state->script_jobs > 1) {
+        ok = run_parallel(&program, state);
+    } else {
+        run_sequential(&program, state);
+    }
+
+    free_script_program(&program);
+    return ok;
+}
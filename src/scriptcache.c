@@ -0,0 +1,357 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include <sys/mman.h>
+#include <limits.h>
+
+#define SCRIPT_CACHE_MAGIC 0x31435345u  // "ESC1"
+#define SCRIPT_CACHE_VERSION 2
+
+// On-disk layout: header, then insn_count instructions, then the string
+// table. Cache files are only ever read back on the machine that wrote
+// them, so native byte order is fine.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_mtime_ns;
+    uint64_t source_size;
+    uint64_t source_ino;
+    uint64_t parse_ns;
+    uint32_t insn_count;
+    uint32_t strtab_size;
+    uint32_t path_offset;   // canonical script path, in the string table
+    uint32_t line_count;
+} ScriptCacheHeader;
+
+// Growable buffers used while compiling
+typedef struct {
+    ScriptInsn *code;
+    uint32_t insn_count;
+    uint32_t insn_capacity;
+    char *strtab;
+    uint32_t strtab_size;
+    uint32_t strtab_capacity;
+} ScriptBuilder;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool emit(ScriptBuilder *b, uint8_t op, uint8_t flags, uint32_t a, uint32_t arg_b) {
+    if (b->insn_count == b->insn_capacity) {
+        uint32_t capacity = b->insn_capacity ? b->insn_capacity * 2 : 256;
+        ScriptInsn *code = realloc(b->code, capacity * sizeof(ScriptInsn));
+        if (!code) return false;
+        b->code = code;
+        b->insn_capacity = capacity;
+    }
+    b->code[b->insn_count++] = (ScriptInsn){op, flags, 0, a, arg_b};
+    return true;
+}
+
+// Returns the string's offset in the table, or UINT32_MAX on failure
+static uint32_t intern(ScriptBuilder *b, const char *s) {
+    uint32_t len = strlen(s) + 1;
+    if (b->strtab_size + len > b->strtab_capacity) {
+        uint32_t capacity = b->strtab_capacity ? b->strtab_capacity : 4096;
+        while (b->strtab_size + len > capacity) capacity *= 2;
+        char *strtab = realloc(b->strtab, capacity);
+        if (!strtab) return UINT32_MAX;
+        b->strtab = strtab;
+        b->strtab_capacity = capacity;
+    }
+    uint32_t offset = b->strtab_size;
+    memcpy(b->strtab + offset, s, len);
+    b->strtab_size += len;
+    return offset;
+}
+
+static bool emit_str(ScriptBuilder *b, uint8_t op, uint8_t flags, const char *s) {
+    uint32_t offset = intern(b, s);
+    return offset != UINT32_MAX && emit(b, op, flags, offset, 0);
+}
+
+static bool emit_pipeline(ScriptBuilder *b, const Pipeline *pipeline) {
+    for (int i = 0; i < pipeline->stage_count; i++) {
+        const Command *cmd = pipeline->stages[i];
+        if (i > 0 && !emit(b, SCRIPT_OP_PIPE, 0, 0, 0)) return false;
+        for (int j = 0; j < cmd->arg_count; j++) {
+            if (!emit_str(b, SCRIPT_OP_ARG, 0, cmd->args[j])) return false;
+        }
+        if (cmd->input_file && !emit_str(b, SCRIPT_OP_INPUT, 0, cmd->input_file)) return false;
+        if (cmd->output_file &&
+            !emit_str(b, SCRIPT_OP_OUTPUT, cmd->append_output, cmd->output_file)) return false;
+    }
+    return emit(b, SCRIPT_OP_RUN, pipeline->is_background, 0, 0);
+}
+
+static bool compile_directive(ScriptBuilder *b, const char *directive, int line_number) {
+    char word[16];
+    if (sscanf(directive, " %15s", word) != 1) return true;
+
+    if (strcmp(word, "parallel") == 0) {
+        return emit(b, SCRIPT_OP_BEGIN, 1, line_number, 0);
+    } else if (strcmp(word, "serial") == 0) {
+        return emit(b, SCRIPT_OP_BEGIN, 0, line_number, 0);
+    } else if (strcmp(word, "end") == 0) {
+        return emit(b, SCRIPT_OP_END, 0, line_number, 0);
+    }
+    printf("Script warning: unknown directive '%s' at line %d\n", word, line_number);
+    return true;
+}
+
+// Turn the script source into an instruction stream. Lines that don't
+// parse are kept as text and re-parsed at run time, so the usual syntax
+// error is still reported at that point in the script.
+static bool compile_script(FILE *script, ScriptBuilder *b, uint32_t *line_count) {
+    char line[MAX_COMMAND_LENGTH];
+    char work[MAX_COMMAND_LENGTH];
+    int line_number = 0;
+    Arena arena;
+    parse_arena_init(&arena);
+    *line_count = 0;
+
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), script)) {
+        line_number++;
+
+        // Remove trailing newline
+        line[strcspn(line, "\n")] = 0;
+
+        // "#@" comments open and close parallel/serial blocks
+        if (strncmp(line, "#@", 2) == 0) {
+            ok = compile_directive(b, line + 2, line_number);
+            continue;
+        }
+
+        // Skip empty lines and comments
+        if (strlen(line) == 0 || line[0] == '#') {
+            continue;
+        }
+
+        uint32_t text = intern(b, line);
+        ok = text != UINT32_MAX && emit(b, SCRIPT_OP_LINE, 0, line_number, text);
+        (*line_count)++;
+
+        // Parse a copy; the parser unquotes in place
+        strcpy(work, line);
+        Pipeline *pipeline = parse_pipeline_quiet(work, &arena);
+
+        if (ok) {
+            ok = pipeline ? emit_pipeline(b, pipeline) : emit(b, SCRIPT_OP_REPARSE, 0, text, 0);
+        }
+    }
+
+    arena_free(&arena);
+    return ok;
+}
+
+static uint64_t path_key(const char *path) {
+    uint64_t h = 14695981039346656037ull;  // FNV-1a 64
+    while (*path) {
+        h ^= (unsigned char)*path++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static bool cache_file_path(const char *canonical, char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    if (!home) return false;
+
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/.edushell", home);
+    mkdir(dir, 0700);
+    snprintf(dir, sizeof(dir), "%s/.edushell/script-cache", home);
+    mkdir(dir, 0700);
+
+    int len = snprintf(buf, size, "%s/%016llx.esc", dir,
+                       (unsigned long long)path_key(canonical));
+    return len > 0 && (size_t)len < size;
+}
+
+static uint64_t mtime_ns(const struct stat *st) {
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ull + st->st_mtim.tv_nsec;
+}
+
+// Map a cache file and accept it only if it was built from this exact
+// version of the script
+static bool map_cache(const char *cache_path, const char *canonical,
+                      const struct stat *source, ScriptProgram *program) {
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ScriptCacheHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // Private writable mapping: Command args point straight into it
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const ScriptCacheHeader *h = map;
+    size_t expected = sizeof(*h) + (size_t)h->insn_count * sizeof(ScriptInsn) + h->strtab_size;
+    const char *strtab = (const char *)map + sizeof(*h) + (size_t)h->insn_count * sizeof(ScriptInsn);
+
+    bool valid = h->magic == SCRIPT_CACHE_MAGIC &&
+                 h->version == SCRIPT_CACHE_VERSION &&
+                 expected == (size_t)st.st_size &&
+                 h->source_mtime_ns == mtime_ns(source) &&
+                 h->source_size == (uint64_t)source->st_size &&
+                 h->source_ino == (uint64_t)source->st_ino &&
+                 h->path_offset < h->strtab_size &&
+                 h->strtab_size > 0 && strtab[h->strtab_size - 1] == '\0' &&
+                 strcmp(strtab + h->path_offset, canonical) == 0;
+    // Every string reference must land inside the table, and the stream
+    // must have the shape compile_script emits
+    const ScriptInsn *code = (const ScriptInsn *)((const char *)map + sizeof(*h));
+    int stages = 0;     // stages in the open command, 0 between commands
+    for (uint32_t i = 0; valid && i < h->insn_count; i++) {
+        const ScriptInsn *insn = &code[i];
+        switch (insn->op) {
+            case SCRIPT_OP_LINE:
+                valid = stages == 0 && insn->b < h->strtab_size;
+                stages = 1;
+                break;
+            case SCRIPT_OP_PIPE:
+                valid = stages > 0 && stages < MAX_PIPELINE_STAGES;
+                stages++;
+                break;
+            case SCRIPT_OP_ARG:
+            case SCRIPT_OP_INPUT:
+            case SCRIPT_OP_OUTPUT:
+                valid = stages > 0 && insn->a < h->strtab_size;
+                break;
+            case SCRIPT_OP_REPARSE:
+                valid = stages == 1 && insn->a < h->strtab_size;
+                stages = 0;
+                break;
+            case SCRIPT_OP_RUN:
+                valid = stages > 0;
+                stages = 0;
+                break;
+            case SCRIPT_OP_BEGIN:
+            case SCRIPT_OP_END:
+                valid = stages == 0;
+                break;
+            default:
+                valid = false;
+        }
+    }
+    valid = valid && stages == 0;
+    if (!valid) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    program->code = code;
+    program->insn_count = h->insn_count;
+    program->strtab = (char *)strtab;
+    program->line_count = h->line_count;
+    program->parse_ns = h->parse_ns;
+    program->map = map;
+    program->map_size = st.st_size;
+    return true;
+}
+
+// Write the compiled program next to the others; rename() makes the new
+// file appear atomically so a concurrent run never maps a torn one.
+static bool store_cache(const char *cache_path, const void *image, size_t size) {
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", cache_path, (int)getpid());
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+
+    bool ok = write(fd, image, size) == (ssize_t)size;
+    close(fd);
+    if (!ok || rename(tmp_path, cache_path) != 0) {
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+// Load a script as an instruction stream, from the cache when it is still
+// valid, otherwise by compiling the source (and caching the result).
+bool load_script_program(const char *filename, ScriptProgram *program) {
+    memset(program, 0, sizeof(*program));
+    uint64_t start = now_ns();
+
+    FILE *script = fopen(filename, "r");
+    if (!script) {
+        handle_error("Could not open script file");
+        return false;
+    }
+
+    struct stat source;
+    char canonical[PATH_MAX];
+    char cache_path[PATH_MAX];
+    bool cacheable = fstat(fileno(script), &source) == 0 &&
+                     realpath(filename, canonical) != NULL &&
+                     cache_file_path(canonical, cache_path, sizeof(cache_path));
+
+    if (cacheable && map_cache(cache_path, canonical, &source, program)) {
+        fclose(script);
+        program->cache_hit = true;
+        program->load_ns = now_ns() - start;
+        return true;
+    }
+
+    ScriptBuilder b = {0};
+    uint32_t line_count;
+    uint32_t path_offset = cacheable ? intern(&b, canonical) : intern(&b, filename);
+    bool ok = path_offset != UINT32_MAX && compile_script(script, &b, &line_count);
+    fclose(script);
+
+    size_t size = sizeof(ScriptCacheHeader) + b.insn_count * sizeof(ScriptInsn) + b.strtab_size;
+    char *image = ok ? malloc(size) : NULL;
+    if (!image) {
+        free(b.code);
+        free(b.strtab);
+        handle_error("Could not compile script");
+        return false;
+    }
+
+    uint64_t parse_ns = now_ns() - start;
+    ScriptCacheHeader header = {
+        .magic = SCRIPT_CACHE_MAGIC,
+        .version = SCRIPT_CACHE_VERSION,
+        .source_mtime_ns = cacheable ? mtime_ns(&source) : 0,
+        .source_size = cacheable ? (uint64_t)source.st_size : 0,
+        .source_ino = cacheable ? (uint64_t)source.st_ino : 0,
+        .parse_ns = parse_ns,
+        .insn_count = b.insn_count,
+        .strtab_size = b.strtab_size,
+        .path_offset = path_offset,
+        .line_count = line_count
+    };
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + sizeof(header), b.code, b.insn_count * sizeof(ScriptInsn));
+    memcpy(image + sizeof(header) + b.insn_count * sizeof(ScriptInsn), b.strtab, b.strtab_size);
+    free(b.code);
+    free(b.strtab);
+
+    program->cached = cacheable && store_cache(cache_path, image, size);
+
+    program->code = (const ScriptInsn *)(image + sizeof(header));
+    program->insn_count = header.insn_count;
+    program->strtab = image + sizeof(header) + header.insn_count * sizeof(ScriptInsn);
+    program->line_count = line_count;
+    program->parse_ns = parse_ns;
+    program->load_ns = parse_ns;
+    program->image = image;
+    return true;
+}
+
+void free_script_program(ScriptProgram *program) {
+    if (program->map) {
+        munmap(program->map, program->map_size);
+    }
+    free(program->image);
+    memset(program, 0, sizeof(*program));
+}
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include <spawn.h>
+
+extern char **environ;
+
+// Launch latency per engine, so posix_spawn and fork can be compared. Both
+// are timed until the child has exec'd.
+typedef struct {
+    long count;
+    double total_us;
+    double min_us;
+    double max_us;
+} SpawnStats;
+
+static SpawnStats spawn_stats[2];
+
+static const char *SPAWN_MODE_NAMES[] = {"posix_spawn", "fork"};
+
+const char *spawn_mode_name(SpawnMode mode) {
+    return SPAWN_MODE_NAMES[mode];
+}
+
+// posix_spawn uses clone(CLONE_VM|CLONE_VFORK) in glibc, so the parent's
+// page tables are never copied. Pipe ends and redirections become file
+// actions; an explicit redirection wins over the pipe.
+static pid_t spawn_posix(const Command *cmd, const char *path, int in_fd, int out_fd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    if (in_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+    if (out_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    }
+
+    if (cmd->input_file) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,
+                                         cmd->input_file, O_RDONLY, 0);
+    }
+    if (cmd->output_file) {
+        int flags = O_WRONLY | O_CREAT;
+        flags |= cmd->append_output ? O_APPEND : O_TRUNC;
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                         cmd->output_file, flags, 0644);
+    }
+
+    // Unblock what the event loop blocks
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &actions, &attr, cmd->args, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (err != 0) {
+        errno = err;
+        handle_error("Command execution failed");
+        return -1;
+    }
+    return pid;
+}
+
+// posix_spawn only returns once the child has exec'd, so to time the same
+// thing the parent waits for the close-on-exec end of a pipe to close in
+// the child: at exec, or when the child gives up before it.
+static pid_t spawn_fork(const Command *cmd, const char *path, int in_fd, int out_fd) {
+    int exec_pipe[2];
+    if (pipe2(exec_pipe, O_CLOEXEC) != 0) {
+        exec_pipe[0] = exec_pipe[1] = -1;
+    }
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        // Child process
+        if (exec_pipe[0] >= 0) close(exec_pipe[0]);
+        reset_child_signals();
+
+        // Pipe ends are O_CLOEXEC, so only the dup2'ed copies survive exec
+        if (in_fd >= 0) dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+
+        // Handle I/O redirection
+        if (cmd->input_file) {
+            int fd = open(cmd->input_file, O_RDONLY);
+            if (fd < 0) {
+                handle_error("Could not open input file");
+                exit(1);
+            }
+            dup2(fd, STDIN_FILENO);
+            close(fd);
+        }
+
+        if (cmd->output_file) {
+            int flags = O_WRONLY | O_CREAT;
+            flags |= cmd->append_output ? O_APPEND : O_TRUNC;
+            int fd = open(cmd->output_file, flags, 0644);
+            if (fd < 0) {
+                handle_error("Could not open output file");
+                exit(1);
+            }
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+
+        execv(path, cmd->args);
+        handle_error("Command execution failed");
+        exit(1);
+    }
+
+    if (exec_pipe[1] >= 0) close(exec_pipe[1]);
+    if (pid > 0 && exec_pipe[0] >= 0) {
+        char byte;
+        while (read(exec_pipe[0], &byte, 1) < 0 && errno == EINTR) {}
+    }
+    if (exec_pipe[0] >= 0) close(exec_pipe[0]);
+    if (pid < 0) {
+        handle_error("Fork failed");
+        return -1;
+    }
+    return pid;
+}
+
+static void record_latency(SpawnMode mode, double us, bool trace) {
+    SpawnStats *s = &spawn_stats[mode];
+    if (s->count == 0 || us < s->min_us) s->min_us = us;
+    if (us > s->max_us) s->max_us = us;
+    s->total_us += us;
+    s->count++;
+
+    if (trace) {
+        fprintf(stderr, "[spawn] %s: %.1f us\n", spawn_mode_name(mode), us);
+    }
+}
+
+// Start an external command with the selected engine. in_fd/out_fd replace
+// stdin/stdout when >= 0. Returns the child's pid or -1 on failure.
+pid_t spawn_command(const Command *cmd, const char *path, int in_fd, int out_fd,
+                    ShellState *state) {
+    struct timespec start, end;
+    // Don't let buffered shell output land after the child's
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = state->spawn_mode == SPAWN_POSIX ?
+        spawn_posix(cmd, path, in_fd, out_fd) : spawn_fork(cmd, path, in_fd, out_fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (pid > 0) {
+        double us = (end.tv_sec - start.tv_sec) * 1e6 +
+                    (end.tv_nsec - start.tv_nsec) / 1e3;
+        record_latency(state->spawn_mode, us, state->spawn_trace);
+    }
+    return pid;
+}
+
+// Per-process I/O from /proc/<pid>/io. The file stays readable while the
+// child is a zombie, so callers read it between exit and reaping.
+bool read_process_io(pid_t pid, CommandUsage *usage) {
+    char path[64];
+    char buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) return false;
+    buf[len] = '\0';
+
+    // Neither key is on the first line; the leading newline keeps
+    // "cancelled_write_bytes" from matching
+    const char *read_bytes = strstr(buf, "\nread_bytes:");
+    const char *write_bytes = strstr(buf, "\nwrite_bytes:");
+    if (!read_bytes || !write_bytes) return false;
+    usage->read_bytes = strtoull(read_bytes + 12, NULL, 10);
+    usage->write_bytes = strtoull(write_bytes + 13, NULL, 10);
+    return true;
+}
+
+void usage_from_rusage(CommandUsage *usage, const struct rusage *ru) {
+    usage->user_time = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+    usage->sys_time = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+    usage->max_rss_kb = ru->ru_maxrss;
+    usage->major_faults = ru->ru_majflt;
+    usage->minor_faults = ru->ru_minflt;
+    usage->voluntary_switches = ru->ru_nvcsw;
+    usage->involuntary_switches = ru->ru_nivcsw;
+}
+
+// waitpid() for a command the shell launched, also collecting what it used
+// before the kernel forgets it: /proc/<pid>/io while it is a zombie, then
+// its rusage from wait4 as it is reaped. usage may be NULL.
+int wait_for_command(pid_t pid, CommandUsage *usage) {
+    int status = 0;
+    if (!usage) {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+        return status;
+    }
+
+    memset(usage, 0, sizeof(*usage));
+    siginfo_t info;
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) != 0 && errno == EINTR) {}
+    read_process_io(pid, usage);
+
+    struct rusage ru;
+    pid_t result;
+    while ((result = wait4(pid, &status, 0, &ru)) < 0 && errno == EINTR) {}
+    if (result == pid) {
+        usage_from_rusage(usage, &ru);
+    }
+    return status;
+}
+
+void display_spawn_stats(ShellState *state) {
+    printf("Spawn engine: %s\n\n", spawn_mode_name(state->spawn_mode));
+    printf("%-12s %-8s %-12s %-12s %-12s\n",
+           "Engine", "Count", "Avg (us)", "Min (us)", "Max (us)");
+    printf("------------------------------------------------------------\n");
+    for (int mode = SPAWN_POSIX; mode <= SPAWN_FORK; mode++) {
+        SpawnStats *s = &spawn_stats[mode];
+        printf("%-12s %-8ld %-12.1f %-12.1f %-12.1f\n",
+               spawn_mode_name(mode), s->count,
+               s->count ? s->total_us / s->count : 0.0,
+               s->min_us, s->max_us);
+    }
+}
+
+// Mean launch cost over every engine, used to estimate forks saved
+double spawn_average_latency_us(void) {
+    long count = spawn_stats[SPAWN_POSIX].count + spawn_stats[SPAWN_FORK].count;
+    if (count == 0) return 0.0;
+    return (spawn_stats[SPAWN_POSIX].total_us + spawn_stats[SPAWN_FORK].total_us) / count;
+}
@@ -0,0 +1,85 @@
+#include "analytics.h"
+#include "edushell.h"
+
+static const int LEVEL_WIDTHS[RESOURCE_LEVELS] = {1, 60, 3600};
+
+static void point_values(const ResourcePoint *point, double values[RESOURCE_METRIC_COUNT]) {
+    values[METRIC_CPU] = point->cpu_usage;
+    values[METRIC_STEAL] = point->cpu_steal;
+    values[METRIC_GUEST] = point->cpu_guest;
+    values[METRIC_MEMORY] = point->memory_usage;
+    values[METRIC_DISK_IO] = point->disk_io;
+    values[METRIC_DISK_IOPS] = point->disk_iops;
+}
+
+void resource_history_init(ResourceHistory *history) {
+    memset(history, 0, sizeof(*history));
+    for (int level = 0; level < RESOURCE_LEVELS; level++) {
+        history->rings[level].width = LEVEL_WIDTHS[level];
+    }
+}
+
+static ResourceBucket *bucket_for(ResourceRing *ring, int64_t start) {
+    return &ring->buckets[(start / ring->width) % RESOURCE_RING_SIZE];
+}
+
+// Fold a sample into its bucket at every resolution: O(levels), with no
+// walking of gaps since a stale slot is recognized by its start time
+void resource_history_add(ResourceHistory *history, const ResourcePoint *point) {
+    double values[RESOURCE_METRIC_COUNT];
+    point_values(point, values);
+    int64_t t = point->timestamp;
+
+    for (int level = 0; level < RESOURCE_LEVELS; level++) {
+        ResourceRing *ring = &history->rings[level];
+        int64_t start = t - t % ring->width;
+        ResourceBucket *bucket = bucket_for(ring, start);
+
+        // Older than what the slot holds now: past this ring's span
+        if (start < bucket->start) continue;
+        if (start > bucket->start) {
+            bucket->start = start;
+            bucket->count = 0;
+        }
+
+        for (int m = 0; m < RESOURCE_METRIC_COUNT; m++) {
+            if (bucket->count == 0 || values[m] < bucket->min[m]) bucket->min[m] = values[m];
+            if (bucket->count == 0 || values[m] > bucket->max[m]) bucket->max[m] = values[m];
+            bucket->sum[m] = bucket->count == 0 ? values[m] : bucket->sum[m] + values[m];
+        }
+        bucket->count++;
+    }
+}
+
+// Min, max and mean of one metric over the last `seconds` before `now`,
+// from the finest ring that spans the window. False when nothing was
+// sampled in it.
+bool resource_history_window(const ResourceHistory *history, int64_t now, int seconds,
+                             ResourceMetric metric, MetricSummary *summary) {
+    int level = 0;
+    while (level < RESOURCE_LEVELS - 1 &&
+           (int64_t)LEVEL_WIDTHS[level] * RESOURCE_RING_SIZE < seconds) {
+        level++;
+    }
+
+    const ResourceRing *ring = &history->rings[level];
+    int64_t oldest = now - seconds;
+    double sum = 0;
+    memset(summary, 0, sizeof(*summary));
+
+    for (int i = 0; i < RESOURCE_RING_SIZE; i++) {
+        const ResourceBucket *bucket = &ring->buckets[i];
+        // Buckets straddling the window's edge count whole
+        if (bucket->count == 0 || bucket->start + ring->width <= oldest || bucket->start > now) {
+            continue;
+        }
+        if (summary->samples == 0 || bucket->min[metric] < summary->min) summary->min = bucket->min[metric];
+        if (summary->samples == 0 || bucket->max[metric] > summary->max) summary->max = bucket->max[metric];
+        sum += bucket->sum[metric];
+        summary->samples += bucket->count;
+    }
+
+    if (summary->samples == 0) return false;
+    summary->mean = sum / summary->samples;
+    return true;
+}
@@ -1,7 +1,89 @@
 #include "edushell.h"
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <time.h>
 
+// Moves that had to copy say so; big ones say how fast
+static void report_copy(const char *path, const TreeCopyStats *stats) {
+    if (!stats->copied) return;
+    if (stats->bytes < TREE_COPY_REPORT_BYTES && stats->files < TREE_COPY_REPORT_FILES) {
+        printf("Copied '%s' across filesystems\n", path);
+        return;
+    }
+    double mb = stats->bytes / (1024.0 * 1024.0);
+    printf("Copied '%s' across filesystems: %ld files, %ld directories, %.1f MB in %.2f s "
+           "(%.1f MB/s, %.0f files/s, %ld reflinked)\n",
+           path, stats->files, stats->directories, mb, stats->seconds,
+           stats->seconds > 0 ? mb / stats->seconds : 0,
+           stats->seconds > 0 ? stats->files / stats->seconds : 0, stats->cloned);
+}
+
+// A restore copies out of the trash to a staging name beside the original
+// path, which trash_cleanup() can't find by looking in the trash. Until
+// the restore is over, a marker in the trash holds the destination.
+static void mark_restore(const DeletedFile *file, ShellState *state, char *marker, size_t size) {
+    const char *base = strrchr(file->trash_path, '/');
+    snprintf(marker, size, "%s/" TREE_COPY_RESTORING "%d-%s", state->trash_dir, (int)getpid(),
+             base ? base + 1 : file->trash_path);
+    int fd = open(marker, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    size_t length = strlen(file->original_path);
+    bool ok = fd >= 0 && write(fd, file->original_path, length) == (ssize_t)length;
+    if (fd >= 0) close(fd);
+    if (!ok) {
+        if (fd >= 0) unlink(marker);
+        marker[0] = '\0';
+    }
+}
+
+// The staging copy a crashed restore left beside its destination
+static void clear_restore(const char *marker, pid_t pid) {
+    char dst[MAX_PATH_LENGTH], staging[MAX_PATH_LENGTH];
+    int fd = open(marker, O_RDONLY | O_CLOEXEC);
+    ssize_t length = fd >= 0 ? read(fd, dst, sizeof(dst) - 1) : -1;
+    if (fd >= 0) close(fd);
+    if (length > 0) {
+        dst[length] = '\0';
+        tree_copy_staging_path(dst, pid, staging, sizeof(staging));
+        struct stat st;
+        if (lstat(staging, &st) == 0) remove_tree(staging);
+    }
+    unlink(marker);
+}
+
+// Remove copies into and out of the trash that a crashed shell left half
+// done. Staging names and restore markers carry the pid of the shell
+// making them, so moves still in progress in another shell are left alone.
+void trash_cleanup(ShellState *state) {
+    DIR *dir = opendir(state->trash_dir);
+    if (!dir) return;
+
+    struct dirent *entry;
+    size_t staging_prefix = strlen(TREE_COPY_STAGING), restoring_prefix = strlen(TREE_COPY_RESTORING);
+    while ((entry = readdir(dir))) {
+        size_t prefix;
+        if (strncmp(entry->d_name, TREE_COPY_STAGING, staging_prefix) == 0) {
+            prefix = staging_prefix;
+        } else if (strncmp(entry->d_name, TREE_COPY_RESTORING, restoring_prefix) == 0) {
+            prefix = restoring_prefix;
+        } else {
+            continue;
+        }
+        pid_t pid = atoi(entry->d_name + prefix);
+        if (pid > 0 && (kill(pid, 0) == 0 || errno == EPERM)) continue;
+
+        char path[MAX_PATH_LENGTH + NAME_MAX + 2];
+        snprintf(path, sizeof(path), "%s/%s", state->trash_dir, entry->d_name);
+        if (prefix == restoring_prefix) {
+            if (pid > 0) clear_restore(path, pid);
+        } else {
+            remove_tree(path);
+        }
+    }
+    closedir(dir);
+}
+
 bool move_to_trash(const char *path, ShellState *state) {
     char trash_path[MAX_PATH_LENGTH];
     time_t now = time(NULL);
@@ -14,11 +96,13 @@ bool move_to_trash(const char *path, ShellState *state) {
     snprintf(trash_path, sizeof(trash_path), "%s/%d_%s", 
              state->trash_dir, (int)(now % 1000000), base);
     
-    // Move file to trash
-    if (rename(path, trash_path) != 0) {
+    // Move file to trash, copying it when it lives on another filesystem
+    TreeCopyStats stats;
+    if (!move_tree(path, trash_path, 0, &stats)) {
         handle_error("Could not move file to trash");
         return false;
     }
+    report_copy(path, &stats);
     
     // Add to trash list
     DeletedFile *df = malloc(sizeof(DeletedFile));
@@ -45,10 +129,16 @@ bool restore_from_trash(const char *path, ShellState *state) {
     while (current) {
         if (strcmp(current->original_path, path) == 0) {
             // Restore file
-            if (rename(current->trash_path, current->original_path) != 0) {
+            char marker[MAX_PATH_LENGTH + NAME_MAX + 32];
+            mark_restore(current, state, marker, sizeof(marker));
+            TreeCopyStats stats;
+            bool ok = move_tree(current->trash_path, current->original_path, 0, &stats);
+            if (marker[0]) unlink(marker);
+            if (!ok) {
                 handle_error("Could not restore file");
                 return false;
             }
+            report_copy(path, &stats);
             
             // Remove from trash list
             if (prev) {
@@ -0,0 +1,488 @@
+#define _GNU_SOURCE
+#include "edushell.h"
+#include <dirent.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/xattr.h>
+
+#define TREE_COPY_MAX_WORKERS 8
+#define TREE_COPY_XATTR_SIZE (64 * 1024)
+
+// Something to copy: a directory is listed by whichever worker takes it,
+// and its entries become tasks of their own
+typedef struct {
+    char *src;
+    char *dst;
+    struct stat st;
+} CopyTask;
+
+// A copied directory whose mode and times are set once everything in it is written
+typedef struct {
+    char *src;
+    char *path;
+    struct stat st;
+} CopiedDir;
+
+// A file with several names; later names are linked to the first copy
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    char *path;
+} LinkedFile;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    CopyTask **tasks;
+    int task_count;
+    int task_capacity;
+    int busy;               // workers holding a task
+    CopiedDir *dirs;
+    int dir_count;
+    int dir_capacity;
+    LinkedFile *links;
+    int link_count;
+    int link_capacity;
+    bool failed;
+    int error;
+    char error_path[MAX_PATH_LENGTH];
+    TreeCopyStats stats;
+} TreeCopy;
+
+static char *join_path(const char *dir, const char *name) {
+    size_t length = strlen(dir) + strlen(name) + 2;
+    char *path = malloc(length);
+    if (path) snprintf(path, length, "%s/%s", dir, name);
+    return path;
+}
+
+static void free_task(CopyTask *task) {
+    free(task->src);
+    free(task->dst);
+    free(task);
+}
+
+// Keep the first failure; the workers stop taking tasks once there is one
+static void fail(TreeCopy *copy, const char *path, int error) {
+    pthread_mutex_lock(&copy->lock);
+    if (!copy->failed) {
+        copy->failed = true;
+        copy->error = error;
+        snprintf(copy->error_path, sizeof(copy->error_path), "%s", path);
+    }
+    pthread_cond_broadcast(&copy->ready);
+    pthread_mutex_unlock(&copy->lock);
+}
+
+// Extended attributes aren't supported everywhere (user.* on symlinks,
+// tmpfs without xattr support), so only the ones that can be set are kept
+static void copy_xattrs(const char *src, const char *dst) {
+    char *names = malloc(TREE_COPY_XATTR_SIZE);
+    char *value = malloc(TREE_COPY_XATTR_SIZE);
+    ssize_t length = names && value ? llistxattr(src, names, TREE_COPY_XATTR_SIZE) : -1;
+    for (ssize_t at = 0; at < length; at += strlen(names + at) + 1) {
+        ssize_t size = lgetxattr(src, names + at, value, TREE_COPY_XATTR_SIZE);
+        if (size >= 0) lsetxattr(dst, names + at, value, size, 0);
+    }
+    free(names);
+    free(value);
+}
+
+// Ownership only carries over when we're allowed to give it away
+static void copy_owner(int fd, const char *path, const struct stat *st) {
+    int result = fd >= 0 ? fchown(fd, st->st_uid, st->st_gid)
+                         : lchown(path, st->st_uid, st->st_gid);
+    (void)result;
+}
+
+// Link to an earlier copy of the same inode, or claim it with a new file.
+// Returns the new fd, or -1 with `*linked` set when a link was made.
+static int create_file(TreeCopy *copy, const CopyTask *task, bool *linked) {
+    *linked = false;
+    if (task->st.st_nlink < 2) {
+        return open(task->dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    }
+
+    // Held across the create so a second name can't be linked before the first exists
+    pthread_mutex_lock(&copy->lock);
+    int fd = -1;
+    for (int i = 0; i < copy->link_count; i++) {
+        if (copy->links[i].dev == task->st.st_dev && copy->links[i].ino == task->st.st_ino) {
+            *linked = link(copy->links[i].path, task->dst) == 0;
+            pthread_mutex_unlock(&copy->lock);
+            return -1;
+        }
+    }
+    fd = open(task->dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd >= 0 && copy->link_count == copy->link_capacity) {
+        int capacity = copy->link_capacity ? copy->link_capacity * 2 : 16;
+        LinkedFile *links = realloc(copy->links, capacity * sizeof(LinkedFile));
+        if (links) {
+            copy->links = links;
+            copy->link_capacity = capacity;
+        }
+    }
+    if (fd >= 0 && copy->link_count < copy->link_capacity) {
+        LinkedFile *entry = &copy->links[copy->link_count];
+        entry->dev = task->st.st_dev;
+        entry->ino = task->st.st_ino;
+        if ((entry->path = strdup(task->dst))) copy->link_count++;
+    }
+    pthread_mutex_unlock(&copy->lock);
+    return fd;
+}
+
+// Reflink when the filesystems allow it (they won't across devices, but
+// the trash may share one with a bind mount), else copy_file_range and
+// its fallbacks. The data is flushed with one syncfs() at the end.
+static bool copy_file(TreeCopy *copy, const CopyTask *task) {
+    int in_fd = open(task->src, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in_fd < 0) return false;
+
+    bool linked;
+    int out_fd = create_file(copy, task, &linked);
+    if (out_fd < 0) {
+        close(in_fd);
+        return linked;
+    }
+
+    bool cloned = clone_fd(in_fd, out_fd);
+    bool ok = cloned || copy_fd(in_fd, out_fd);
+    if (ok) {
+        copy_owner(out_fd, NULL, &task->st);
+        struct timespec times[2] = {task->st.st_atim, task->st.st_mtim};
+        ok = fchmod(out_fd, task->st.st_mode & 07777) == 0 && futimens(out_fd, times) == 0;
+    }
+    int error = errno;
+    close(in_fd);
+    close(out_fd);
+    if (ok) copy_xattrs(task->src, task->dst);
+
+    if (ok) {
+        pthread_mutex_lock(&copy->lock);
+        copy->stats.files++;
+        copy->stats.bytes += task->st.st_size;
+        if (cloned) copy->stats.cloned++;
+        pthread_mutex_unlock(&copy->lock);
+    }
+    errno = error;
+    return ok;
+}
+
+static bool copy_symlink(TreeCopy *copy, const CopyTask *task) {
+    char target[PATH_MAX];
+    ssize_t length = readlink(task->src, target, sizeof(target) - 1);
+    if (length < 0) return false;
+    target[length] = '\0';
+    if (symlink(target, task->dst) != 0) return false;
+
+    copy_owner(-1, task->dst, &task->st);
+    struct timespec times[2] = {task->st.st_atim, task->st.st_mtim};
+    utimensat(AT_FDCWD, task->dst, times, AT_SYMLINK_NOFOLLOW);
+    pthread_mutex_lock(&copy->lock);
+    copy->stats.files++;
+    pthread_mutex_unlock(&copy->lock);
+    return true;
+}
+
+// FIFOs, sockets and (for root) device nodes
+static bool copy_special(TreeCopy *copy, const CopyTask *task) {
+    if (mknod(task->dst, task->st.st_mode, task->st.st_rdev) != 0) return false;
+    copy_owner(-1, task->dst, &task->st);
+    struct timespec times[2] = {task->st.st_atim, task->st.st_mtim};
+    utimensat(AT_FDCWD, task->dst, times, AT_SYMLINK_NOFOLLOW);
+    pthread_mutex_lock(&copy->lock);
+    copy->stats.files++;
+    pthread_mutex_unlock(&copy->lock);
+    return true;
+}
+
+// Create a directory that only we can write into for now; its own mode
+// is restored with its times after the copy
+static bool make_dir(TreeCopy *copy, const CopyTask *task) {
+    if (mkdir(task->dst, 0700) != 0) return false;
+
+    char *src = strdup(task->src), *path = strdup(task->dst);
+    pthread_mutex_lock(&copy->lock);
+    if (src && path && copy->dir_count == copy->dir_capacity) {
+        int capacity = copy->dir_capacity ? copy->dir_capacity * 2 : 64;
+        CopiedDir *dirs = realloc(copy->dirs, capacity * sizeof(CopiedDir));
+        if (dirs) {
+            copy->dirs = dirs;
+            copy->dir_capacity = capacity;
+        }
+    }
+    if (!src || !path || copy->dir_count == copy->dir_capacity) {
+        pthread_mutex_unlock(&copy->lock);
+        free(src);
+        free(path);
+        errno = ENOMEM;
+        return false;
+    }
+    copy->dirs[copy->dir_count].src = src;
+    copy->dirs[copy->dir_count].path = path;
+    copy->dirs[copy->dir_count].st = task->st;
+    copy->dir_count++;
+    copy->stats.directories++;
+    pthread_mutex_unlock(&copy->lock);
+    return true;
+}
+
+static bool push_tasks(TreeCopy *copy, CopyTask **tasks, int count) {
+    if (count == 0) return true;
+    pthread_mutex_lock(&copy->lock);
+    if (copy->task_count + count > copy->task_capacity) {
+        int capacity = copy->task_capacity ? copy->task_capacity : 256;
+        while (capacity < copy->task_count + count) capacity *= 2;
+        CopyTask **grown = realloc(copy->tasks, capacity * sizeof(CopyTask *));
+        if (!grown) {
+            pthread_mutex_unlock(&copy->lock);
+            return false;
+        }
+        copy->tasks = grown;
+        copy->task_capacity = capacity;
+    }
+    memcpy(copy->tasks + copy->task_count, tasks, count * sizeof(CopyTask *));
+    copy->task_count += count;
+    pthread_cond_broadcast(&copy->ready);
+    pthread_mutex_unlock(&copy->lock);
+    return true;
+}
+
+// List one directory. Subdirectories are created here, before they're
+// queued, so their entries always have somewhere to go.
+static bool walk_dir(TreeCopy *copy, const CopyTask *task) {
+    int dir_fd = open(task->src, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR *dir = dir_fd >= 0 ? fdopendir(dir_fd) : NULL;
+    if (!dir) {
+        if (dir_fd >= 0) close(dir_fd);
+        return false;
+    }
+
+    CopyTask **batch = NULL;
+    int count = 0, capacity = 0;
+    bool ok = true;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        if (count == capacity) {
+            int grown_capacity = capacity ? capacity * 2 : 64;
+            CopyTask **grown = realloc(batch, grown_capacity * sizeof(CopyTask *));
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            batch = grown;
+            capacity = grown_capacity;
+        }
+        CopyTask *child = calloc(1, sizeof(CopyTask));
+        if (!child) {
+            ok = false;
+            break;
+        }
+        child->src = join_path(task->src, entry->d_name);
+        child->dst = join_path(task->dst, entry->d_name);
+        ok = child->src && child->dst &&
+             fstatat(dir_fd, entry->d_name, &child->st, AT_SYMLINK_NOFOLLOW) == 0;
+        if (ok && S_ISDIR(child->st.st_mode)) ok = make_dir(copy, child);
+        if (!ok) {
+            free_task(child);
+            break;
+        }
+        batch[count++] = child;
+    }
+    int error = errno;
+    closedir(dir);
+
+    if (ok) ok = push_tasks(copy, batch, count);
+    if (!ok) {
+        for (int i = 0; i < count; i++) free_task(batch[i]);
+    }
+    free(batch);
+    errno = error;
+    return ok;
+}
+
+static bool copy_entry(TreeCopy *copy, const CopyTask *task) {
+    if (S_ISDIR(task->st.st_mode)) return walk_dir(copy, task);
+    if (S_ISREG(task->st.st_mode)) return copy_file(copy, task);
+    if (S_ISLNK(task->st.st_mode)) return copy_symlink(copy, task);
+    return copy_special(copy, task);
+}
+
+// Each worker both walks and copies: whatever it takes off the queue,
+// a directory to list or a file to copy. The copy is finished when the
+// queue is empty and no worker is holding a task that could add to it.
+static void *copy_worker(void *arg) {
+    TreeCopy *copy = arg;
+    pthread_mutex_lock(&copy->lock);
+    while (1) {
+        while (!copy->failed && copy->task_count == 0 && copy->busy > 0) {
+            pthread_cond_wait(&copy->ready, &copy->lock);
+        }
+        if (copy->failed || copy->task_count == 0) break;
+
+        // Newest first keeps the walk depth-first and the queue short
+        CopyTask *task = copy->tasks[--copy->task_count];
+        copy->busy++;
+        pthread_mutex_unlock(&copy->lock);
+
+        if (!copy_entry(copy, task)) fail(copy, task->src, errno);
+        free_task(task);
+
+        pthread_mutex_lock(&copy->lock);
+        copy->busy--;
+        if (copy->busy == 0 && copy->task_count == 0) pthread_cond_broadcast(&copy->ready);
+    }
+    pthread_mutex_unlock(&copy->lock);
+    return NULL;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+// Delete a tree without following symlinks out of it
+bool remove_tree(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return errno == ENOENT;
+    if (!S_ISDIR(st.st_mode)) return unlink(path) == 0;
+    return nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+static int default_workers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus > TREE_COPY_MAX_WORKERS ? TREE_COPY_MAX_WORKERS : (int)cpus;
+}
+
+// Copy `src` (a file or a whole tree) to `dst`, which must not exist,
+// with `workers` threads walking and copying in parallel (0 picks one
+// per CPU, up to TREE_COPY_MAX_WORKERS)
+static bool copy_tree(const char *src, const char *dst, int workers, TreeCopyStats *stats) {
+    TreeCopy copy;
+    memset(&copy, 0, sizeof(copy));
+    pthread_mutex_init(&copy.lock, NULL);
+    pthread_cond_init(&copy.ready, NULL);
+
+    CopyTask *root = calloc(1, sizeof(CopyTask));
+    bool ok = root && (root->src = strdup(src)) && (root->dst = strdup(dst)) &&
+              lstat(src, &root->st) == 0;
+    if (ok && S_ISDIR(root->st.st_mode)) ok = make_dir(&copy, root);
+    if (!ok) {
+        fail(&copy, src, errno);
+        if (root) free_task(root);
+    }
+
+    if (ok && !S_ISDIR(root->st.st_mode)) {
+        // A single file needs no threads
+        if (!copy_entry(&copy, root)) fail(&copy, src, errno);
+        free_task(root);
+    } else if (ok) {
+        push_tasks(&copy, &root, 1);
+        if (workers <= 0) workers = default_workers();
+        pthread_t threads[TREE_COPY_MAX_WORKERS];
+        int started = 0;
+        for (; started < workers && started < TREE_COPY_MAX_WORKERS; started++) {
+            if (pthread_create(&threads[started], NULL, copy_worker, &copy) != 0) break;
+        }
+        if (started == 0) copy_worker(&copy);
+        for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        for (int i = 0; i < copy.task_count; i++) free_task(copy.tasks[i]);
+    }
+
+    // Directories were created parent first, so going backwards sets each
+    // one's times after everything inside it has been written
+    for (int i = copy.dir_count - 1; i >= 0; i--) {
+        CopiedDir *dir = &copy.dirs[i];
+        if (!copy.failed) {
+            struct timespec times[2] = {dir->st.st_atim, dir->st.st_mtim};
+            copy_owner(-1, dir->path, &dir->st);
+            copy_xattrs(dir->src, dir->path);
+            if (chmod(dir->path, dir->st.st_mode & 07777) != 0 ||
+                utimensat(AT_FDCWD, dir->path, times, 0) != 0) {
+                fail(&copy, dir->path, errno);
+            }
+        }
+        free(dir->src);
+        free(dir->path);
+    }
+    for (int i = 0; i < copy.link_count; i++) free(copy.links[i].path);
+
+    *stats = copy.stats;
+    ok = !copy.failed;
+    if (!ok) {
+        fprintf(stderr, COLOR_RED "Could not copy '%s': %s\n" COLOR_RESET,
+                copy.error_path, strerror(copy.error));
+        errno = copy.error;
+    }
+    free(copy.tasks);
+    free(copy.dirs);
+    free(copy.links);
+    pthread_cond_destroy(&copy.ready);
+    pthread_mutex_destroy(&copy.lock);
+    return ok;
+}
+
+// Name of the copy shell `pid` builds for `dst`, next to it on the same
+// filesystem
+void tree_copy_staging_path(const char *dst, pid_t pid, char *out, size_t size) {
+    const char *base = strrchr(dst, '/');
+    int dir_length = base ? (int)(base - dst + 1) : 0;
+    snprintf(out, size, "%.*s" TREE_COPY_STAGING "%d-%s", dir_length, dst, (int)pid,
+             base ? base + 1 : dst);
+}
+
+// Move `src` to `dst` like rename(), across filesystems too. When rename()
+// fails with EXDEV the tree is copied to a staging name beside `dst`,
+// flushed to disk, renamed into place, and only then removed from `src`:
+// a crash part way leaves the source whole and at most a staging copy
+// behind, for the caller to clear (trash_cleanup() does for the trash).
+// `stats` says whether a copy was needed and how it went.
+bool move_tree(const char *src, const char *dst, int workers, TreeCopyStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (rename(src, dst) == 0) return true;
+    if (errno != EXDEV) return false;
+
+    char staging[MAX_PATH_LENGTH];
+    tree_copy_staging_path(dst, getpid(), staging, sizeof(staging));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool ok = copy_tree(src, staging, workers, stats);
+    stats->copied = true;
+
+    // One flush for the whole copy rather than an fsync per file
+    int fd = ok ? open(staging, O_RDONLY | O_NOFOLLOW | O_CLOEXEC) : -1;
+    if (ok && fd < 0) {
+        // A top-level symlink can't be opened; its directory is on the same filesystem
+        char parent[MAX_PATH_LENGTH];
+        snprintf(parent, sizeof(parent), "%s", staging);
+        char *slash = strrchr(parent, '/');
+        if (slash) *slash = '\0';
+        fd = open(slash ? (parent[0] ? parent : "/") : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (ok) ok = fd >= 0 && syncfs(fd) == 0;
+    if (fd >= 0) close(fd);
+
+    if (ok) ok = rename(staging, dst) == 0;
+    int error = errno;
+    if (!ok) {
+        remove_tree(staging);
+        errno = error;
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // The copy is in place; a source that can't be fully removed is
+    // reported, but the move itself has happened
+    if (!remove_tree(src)) {
+        fprintf(stderr, COLOR_RED "Warning: copied '%s' but could not remove all of it: %s\n" COLOR_RESET,
+                src, strerror(errno));
+    }
+    return true;
+}
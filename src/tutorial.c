@@ -56,7 +56,7 @@ void start_tutorial(ShellState *state) {
             Command *cmd = parse_command(input);
             if (cmd) {
                 // Try built-in commands first
-                if (!handle_builtin(cmd, state)) {
+                if (!handle_builtin(cmd, state, NULL)) {
                     // If not a built-in command, execute it normally
                     execute_command(cmd, state);
                 }
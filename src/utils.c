@@ -8,106 +8,58 @@ void handle_error(const char *message) {
     }
 }
 
+// Arguments point into the parsed line, so the Command is one allocation
 void free_command(Command *cmd) {
-    if (!cmd) return;
-    
-    for (int i = 0; i < cmd->arg_count; i++) {
-        free(cmd->args[i]);
-    }
-    free(cmd->input_file);
-    free(cmd->output_file);
     free(cmd);
 }
 
 void cleanup_shell(ShellState *state) {
-    // Free history
-    for (int i = 0; i < state->history_count; i++) {
-        free(state->history[i]);
-    }
-    
-    // Close log file
-    if (state->log_file) {
-        fclose(state->log_file);
-    }
-}
-
-void log_command(ShellState *state, const char *command, int status) {
-    if (state->log_file) {
-        time_t now = time(NULL);
-        char *timestamp = ctime(&now);
-        // Remove newline from timestamp
-        timestamp[strlen(timestamp) - 1] = '\0';
-        fprintf(state->log_file, "[%s] Command: %s (Status: %d)\n", 
-                timestamp, command, status);
-        fflush(state->log_file);
-    }
+    (void)state;
+    hash_reset();
+    jobs_cleanup();
+    events_cleanup();
+    cleanup_analytics();
+    history_close();
+    logger_stop();
 }
 
-// Helper function to find command path
-bool find_command_path(const char *cmd, char *path_buf, size_t buf_size) {
-    char *path_env = getenv("PATH");
-    if (!path_env) return false;
-
-    char *path_copy = strdup(path_env);
-    char *dir = strtok(path_copy, ":");
-
-    while (dir) {
-        snprintf(path_buf, buf_size, "%s/%s", dir, cmd);
-        if (access(path_buf, X_OK) == 0) {
-            free(path_copy);
-            return true;
-        }
-        dir = strtok(NULL, ":");
-    }
-
-    free(path_copy);
-    return false;
+int execute_command(Command *cmd, ShellState *state) {
+    CommandUsage usage;
+    return execute_command_usage(cmd, state, &usage);
 }
 
-int execute_command(Command *cmd, ShellState *state) {
+// Same, and fill usage with what a foreground command used (zeroed for
+// background commands, whose usage is collected by the job table)
+int execute_command_usage(Command *cmd, ShellState *state, CommandUsage *usage) {
+    memset(usage, 0, sizeof(*usage));
     if (!cmd || cmd->arg_count == 0) return 1;
 
-    pid_t pid = fork();
-    
-    if (pid == 0) {
-        // Child process
-        // Handle I/O redirection
-        if (cmd->input_file) {
-            int fd = open(cmd->input_file, O_RDONLY);
-            if (fd < 0) {
-                handle_error("Could not open input file");
-                exit(1);
-            }
-            dup2(fd, STDIN_FILENO);
-            close(fd);
-        }
-
-        if (cmd->output_file) {
-            int flags = O_WRONLY | O_CREAT;
-            flags |= cmd->append_output ? O_APPEND : O_TRUNC;
-            int fd = open(cmd->output_file, flags, 0644);
-            if (fd < 0) {
-                handle_error("Could not open output file");
-                exit(1);
-            }
-            dup2(fd, STDOUT_FILENO);
-            close(fd);
-        }
-
-        execvp(cmd->args[0], cmd->args);
-        handle_error("Command execution failed");
-        exit(1);
-    } else if (pid < 0) {
-        handle_error("Fork failed");
-        return 1;
+    // Resolve through the hash table so the child can execv directly
+    char path[MAX_PATH_LENGTH];
+    if (!find_command_path(cmd->args[0], path, sizeof(path))) {
+        fprintf(stderr, COLOR_RED "%s: command not found\n" COLOR_RESET, cmd->args[0]);
+        return 127;
     }
 
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = spawn_command(cmd, path, -1, -1, state);
+    if (pid < 0) return 1;
+
     // Parent process
     if (!cmd->is_background) {
-        int status;
-        waitpid(pid, &status, 0);
-        log_command(state, cmd->args[0], status);
+        int status = wait_for_command(pid, usage);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        log_command(cmd->args[0], LOG_COMMAND, status,
+                    (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+        if (state->analytics_enabled) {
+            track_command_usage(cmd->args[0], usage);
+        }
+        if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
         return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
     }
+
+    // Reaped later through the job table
+    jobs_add(&cmd, &pid, 1);
     return 0;
 } 
\ No newline at end of file
@@ -0,0 +1,53 @@
+// Build-time generator for the builtin dispatch table.
+//
+// Reads the builtin names from include/builtins.def and searches for a seed
+// that makes builtin_name_hash() collision-free over a power-of-two table,
+// then prints that table as a C header on stdout.
+
+#include "edushell.h"
+
+#define BUILTIN(name, ...) name,
+static const char *NAMES[] = {
+#include "builtins.def"
+};
+#undef BUILTIN
+
+#define NAME_COUNT (int)(sizeof(NAMES) / sizeof(NAMES[0]))
+#define MAX_SEEDS 1000000u
+
+int main(void) {
+    // Load factor of at most 1/2 keeps the seed search short
+    int size = 1;
+    while (size < 2 * NAME_COUNT) size <<= 1;
+
+    signed char slots[256];
+    if (size > (int)sizeof(slots)) {
+        fprintf(stderr, "gen_builtin_hash: too many builtins\n");
+        return 1;
+    }
+
+    for (uint32_t seed = 1; seed < MAX_SEEDS; seed++) {
+        memset(slots, -1, sizeof(slots));
+        bool ok = true;
+        for (int i = 0; i < NAME_COUNT && ok; i++) {
+            uint32_t slot = builtin_name_hash(NAMES[i], seed) & (size - 1);
+            ok = slots[slot] < 0;
+            slots[slot] = i;
+        }
+        if (!ok) continue;
+
+        printf("// Generated by tools/gen_builtin_hash.c from include/builtins.def.\n");
+        printf("// Do not edit.\n\n");
+        printf("#define BUILTIN_HASH_SEED 0x%08xu\n", seed);
+        printf("#define BUILTIN_HASH_SIZE %d\n\n", size);
+        printf("static const signed char BUILTIN_HASH_SLOTS[BUILTIN_HASH_SIZE] = {");
+        for (int i = 0; i < size; i++) {
+            printf("%s%s%d", i ? "," : "", i % 16 ? " " : "\n    ", slots[i]);
+        }
+        printf("\n};\n");
+        return 0;
+    }
+
+    fprintf(stderr, "gen_builtin_hash: no perfect seed found\n");
+    return 1;
+}